@@ -0,0 +1,256 @@
+#include "AnimationBaker.h"
+#include "JobSystem.h"
+
+#include <assimp/scene.h>
+#include <glm/glm/gtc/matrix_transform.hpp>
+#include <glm/glm/gtc/quaternion.hpp>
+#include <glm/glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+//assimp matrices are row major
+static glm::mat4 toMat4(const aiMatrix4x4& m)
+{
+	return glm::transpose(glm::make_mat4(&m.a1));
+}
+
+//index of the last key at or before ticks, and how far ticks is on the way to the next one
+template<typename Key>
+static unsigned int findKey(const Key* keys, unsigned int count, double ticks, float& blend)
+{
+	const Key* next = std::upper_bound(keys, keys + count, ticks, [](double t, const Key& key) { return t < key.mTime; });
+	unsigned int index = next == keys ? 0 : static_cast<unsigned int>(next - keys) - 1;
+	blend = 0.0f;
+	if (index + 1 < count && keys[index + 1].mTime > keys[index].mTime) {
+		blend = static_cast<float>(glm::clamp((ticks - keys[index].mTime) / (keys[index + 1].mTime - keys[index].mTime), 0.0, 1.0));
+	}
+	return index;
+}
+
+static glm::vec3 sampleVector(const aiVectorKey* keys, unsigned int count, double ticks, const glm::vec3& fallback)
+{
+	if (count == 0) {
+		return fallback;
+	}
+	float blend;
+	unsigned int i = findKey(keys, count, ticks, blend);
+	const aiVector3D& a = keys[i].mValue;
+	const aiVector3D& b = keys[std::min(i + 1, count - 1)].mValue;
+	return glm::mix(glm::vec3(a.x, a.y, a.z), glm::vec3(b.x, b.y, b.z), blend);
+}
+
+static glm::quat sampleRotation(const aiQuatKey* keys, unsigned int count, double ticks)
+{
+	if (count == 0) {
+		return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	}
+	float blend;
+	unsigned int i = findKey(keys, count, ticks, blend);
+	const aiQuaternion& a = keys[i].mValue;
+	const aiQuaternion& b = keys[std::min(i + 1, count - 1)].mValue;
+	return glm::normalize(glm::slerp(glm::quat(a.w, a.x, a.y, a.z), glm::quat(b.w, b.x, b.y, b.z), blend));
+}
+
+//transform of the node of channel relative to its parent at ticks
+static glm::mat4 sampleChannel(const aiNodeAnim* channel, double ticks)
+{
+	glm::vec3 position = sampleVector(channel->mPositionKeys, channel->mNumPositionKeys, ticks, glm::vec3(0.0f));
+	glm::quat rotation = sampleRotation(channel->mRotationKeys, channel->mNumRotationKeys, ticks);
+	glm::vec3 scale = sampleVector(channel->mScalingKeys, channel->mNumScalingKeys, ticks, glm::vec3(1.0f));
+	return glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+}
+
+//the smallest sphere around both that is centered on the middle of their bounding box, a w of 0 is empty
+static glm::vec4 mergeSpheres(const glm::vec4& a, const glm::vec4& b)
+{
+	if (a.w <= 0.0f) {
+		return b;
+	}
+	if (b.w <= 0.0f) {
+		return a;
+	}
+	glm::vec3 minimum = glm::min(glm::vec3(a) - a.w, glm::vec3(b) - b.w);
+	glm::vec3 maximum = glm::max(glm::vec3(a) + a.w, glm::vec3(b) + b.w);
+	glm::vec3 center = (minimum + maximum) * 0.5f;
+	float radius = std::max(glm::length(glm::vec3(a) - center) + a.w, glm::length(glm::vec3(b) - center) + b.w);
+	return glm::vec4(center, radius);
+}
+
+AnimationBaker::AnimationBaker(const aiScene* scene) : m_globalInverse(1.0f), m_scene(scene)
+{
+	if (scene->mRootNode != nullptr) {
+		addNode(scene->mRootNode, -1);
+		m_globalInverse = glm::inverse(m_nodes[0].transform);
+	}
+	std::unordered_map<std::string, int> nodeOf;
+	for (unsigned int i = 0; i < m_nodes.size(); i++) {
+		nodeOf.emplace(m_nodes[i].name, static_cast<int>(i));
+	}
+	for (unsigned int m = 0; m < scene->mNumMeshes; m++) {
+		const aiMesh* mesh = scene->mMeshes[m];
+		for (unsigned int b = 0; b < mesh->mNumBones; b++) {
+			const aiBone* bone = mesh->mBones[b];
+			std::string name = bone->mName.C_Str();
+			if (!m_boneOf.emplace(name, static_cast<glm::uint>(m_offsets.size())).second) {
+				continue;
+			}
+			auto node = nodeOf.find(name);
+			m_nodeOfBone.push_back(node != nodeOf.end() ? node->second : -1);
+			m_offsets.push_back(toMat4(bone->mOffsetMatrix));
+		}
+	}
+}
+
+void AnimationBaker::addNode(const aiNode* node, int parent)
+{
+	int index = static_cast<int>(m_nodes.size());
+	m_nodes.push_back(Node{ node->mName.C_Str(), parent, toMat4(node->mTransformation) });
+	for (unsigned int i = 0; i < node->mNumChildren; i++) {
+		addNode(node->mChildren[i], index);
+	}
+}
+
+glm::uint AnimationBaker::boneCount() const
+{
+	return static_cast<glm::uint>(m_offsets.size());
+}
+
+void AnimationBaker::addWeights(const aiMesh* mesh, std::vector<Vertex>& vertices) const
+{
+	if (mesh->mNumBones == 0) {
+		return;
+	}
+	for (unsigned int b = 0; b < mesh->mNumBones; b++) {
+		const aiBone* bone = mesh->mBones[b];
+		glm::uint id = m_boneOf.at(bone->mName.C_Str());
+		if (id >= MAX_BONES) {
+			continue;
+		}
+		for (unsigned int w = 0; w < bone->mNumWeights; w++) {
+			const aiVertexWeight& weight = bone->mWeights[w];
+			if (weight.mVertexId >= vertices.size() || weight.mWeight <= 0.0f) {
+				continue;
+			}
+			//replaces the weakest influence if this one is stronger
+			Vertex& vertex = vertices[weight.mVertexId];
+			float* weakest = std::min_element(vertex.m_Weights, vertex.m_Weights + MAX_BONE_INFLUENCE);
+			if (weight.mWeight > *weakest) {
+				vertex.m_BoneIDs[weakest - vertex.m_Weights] = static_cast<int>(id);
+				*weakest = weight.mWeight;
+			}
+		}
+	}
+	for (Vertex& vertex : vertices) {
+		float total = 0.0f;
+		for (unsigned int j = 0; j < MAX_BONE_INFLUENCE; j++) {
+			total += vertex.m_Weights[j];
+		}
+		if (total > 0.0f) {
+			for (unsigned int j = 0; j < MAX_BONE_INFLUENCE; j++) {
+				vertex.m_Weights[j] /= total;
+			}
+		}
+	}
+}
+
+glm::vec4 AnimationBaker::sampleFrame(const std::vector<const aiNodeAnim*>& channels, double ticks, const std::vector<glm::vec4>& boneSpheres, glm::vec4* texels) const
+{
+	std::vector<glm::mat4> global(m_nodes.size());
+	for (unsigned int i = 0; i < m_nodes.size(); i++) {
+		glm::mat4 local = channels[i] != nullptr ? sampleChannel(channels[i], ticks) : m_nodes[i].transform;
+		global[i] = m_nodes[i].parent >= 0 ? global[m_nodes[i].parent] * local : local;
+	}
+	glm::uint bones = std::min(boneCount(), static_cast<glm::uint>(MAX_BONES));
+	glm::vec4 bounds(0.0f);
+	for (glm::uint b = 0; b < bones; b++) {
+		glm::mat4 skin = m_nodeOfBone[b] >= 0 ? m_globalInverse * global[m_nodeOfBone[b]] * m_offsets[b] : glm::mat4(1.0f);
+		for (int row = 0; row < 3; row++) {
+			texels[b * 3 + row] = glm::vec4(skin[0][row], skin[1][row], skin[2][row], skin[3][row]);
+		}
+		//the blend of the bones of a vertex stays within the spheres of its bones moved along
+		if (boneSpheres[b].w > 0.0f) {
+			float scale = std::max(std::max(glm::length(glm::vec3(skin[0])), glm::length(glm::vec3(skin[1]))), glm::length(glm::vec3(skin[2])));
+			bounds = mergeSpheres(bounds, glm::vec4(glm::vec3(skin * glm::vec4(glm::vec3(boneSpheres[b]), 1.0f)), boneSpheres[b].w * scale));
+		}
+	}
+	return bounds;
+}
+
+BakedAnimation AnimationBaker::bake(const std::vector<CookedMesh>& meshes) const
+{
+	BakedAnimation animation;
+	if (boneCount() == 0 || m_scene->mNumAnimations == 0) {
+		return animation;
+	}
+	animation.boneCount = std::min(boneCount(), static_cast<glm::uint>(MAX_BONES));
+
+	//bind pose box of the vertices of every bone, vertices without bones never move
+	std::vector<glm::vec3> minimum(animation.boneCount + 1, glm::vec3(FLT_MAX)), maximum(animation.boneCount + 1, glm::vec3(-FLT_MAX));
+	for (const CookedMesh& mesh : meshes) {
+		for (const Vertex& vertex : mesh.vertices) {
+			bool skinned = false;
+			for (unsigned int j = 0; j < MAX_BONE_INFLUENCE; j++) {
+				if (vertex.m_Weights[j] > 0.0f) {
+					glm::uint bone = static_cast<glm::uint>(vertex.m_BoneIDs[j]);
+					minimum[bone] = glm::min(minimum[bone], vertex.Position);
+					maximum[bone] = glm::max(maximum[bone], vertex.Position);
+					skinned = true;
+				}
+			}
+			if (!skinned) {
+				minimum[animation.boneCount] = glm::min(minimum[animation.boneCount], vertex.Position);
+				maximum[animation.boneCount] = glm::max(maximum[animation.boneCount], vertex.Position);
+			}
+		}
+	}
+	std::vector<glm::vec4> boneSpheres(animation.boneCount + 1, glm::vec4(0.0f));
+	for (glm::uint b = 0; b <= animation.boneCount; b++) {
+		if (minimum[b].x <= maximum[b].x) {
+			//a single point still needs a radius to count
+			boneSpheres[b] = glm::vec4((minimum[b] + maximum[b]) * 0.5f, std::max(glm::length(maximum[b] - minimum[b]) * 0.5f, 1e-4f));
+		}
+	}
+	//instances that play no clip stay in the bind pose
+	glm::vec4 bounds(0.0f);
+	for (const glm::vec4& sphere : boneSpheres) {
+		bounds = mergeSpheres(bounds, sphere);
+	}
+
+	for (unsigned int a = 0; a < m_scene->mNumAnimations; a++) {
+		const aiAnimation* source = m_scene->mAnimations[a];
+		std::vector<const aiNodeAnim*> channels(m_nodes.size(), nullptr);
+		for (unsigned int c = 0; c < source->mNumChannels; c++) {
+			for (unsigned int n = 0; n < m_nodes.size(); n++) {
+				if (m_nodes[n].name == source->mChannels[c]->mNodeName.C_Str()) {
+					channels[n] = source->mChannels[c];
+				}
+			}
+		}
+		//files that leave out the rate are meant to play at 25 ticks a second
+		double ticksPerSecond = source->mTicksPerSecond > 0.0 ? source->mTicksPerSecond : 25.0;
+		double seconds = source->mDuration / ticksPerSecond;
+
+		AnimationClip clip;
+		clip.name = source->mName.C_Str();
+		clip.firstFrame = animation.height();
+		//the last frame blends back into the first, the clips loop
+		clip.frameCount = std::max(1u, static_cast<glm::uint>(std::lround(seconds * ANIMATION_BAKE_FPS)));
+		clip.framesPerSecond = ANIMATION_BAKE_FPS;
+		animation.clips.push_back(clip);
+
+		size_t first = animation.texels.size();
+		animation.texels.resize(first + static_cast<size_t>(clip.frameCount) * animation.width());
+		std::vector<glm::vec4> frameBounds(clip.frameCount);
+		JobSystem::instance().parallelFor(clip.frameCount, [&](unsigned int frame) {
+			double ticks = frame / static_cast<double>(ANIMATION_BAKE_FPS) * ticksPerSecond;
+			frameBounds[frame] = sampleFrame(channels, ticks, boneSpheres, animation.texels.data() + first + static_cast<size_t>(frame) * animation.width());
+		});
+		for (const glm::vec4& frame : frameBounds) {
+			bounds = mergeSpheres(bounds, frame);
+		}
+	}
+	animation.bounds = bounds;
+	return animation;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm/glm.hpp>
+
+#include "Mesh.h"
+#include "MeshCache.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct aiScene;
+struct aiMesh;
+struct aiNode;
+struct aiNodeAnim;
+
+// bone ids are stored as bytes in the vertices, see VertexLayout
+#define MAX_BONES 256
+// rate the clips are sampled at, the vertex shader blends between neighbouring frames
+#define ANIMATION_BAKE_FPS 30.0f
+
+// imports the skeleton of a scene, the bone weights of its meshes and its clips. The clips are pre-sampled into the
+// skinning matrices of every bone at every frame (see BakedAnimation), so playing them back needs nothing but a
+// texture fetch per bone in the vertex shader and no skinning is ever done on the CPU.
+class AnimationBaker
+{
+private:
+	struct Node
+	{
+		std::string name;
+		int parent; //-1 for the root
+		glm::mat4 transform; //relative to the parent, in the bind pose
+	};
+
+	std::vector<Node> m_nodes; //parents come before their children
+	std::unordered_map<std::string, glm::uint> m_boneOf; //bone name -> id
+	std::vector<int> m_nodeOfBone;
+	std::vector<glm::mat4> m_offsets; //model space of the bind pose to the space of the bone
+	glm::mat4 m_globalInverse;
+	const aiScene* m_scene;
+
+	void addNode(const aiNode* node, int parent);
+	//writes the skinning matrices of every bone at ticks into texels, returns the bounds of the bone spheres moved along
+	glm::vec4 sampleFrame(const std::vector<const aiNodeAnim*>& channels, double ticks, const std::vector<glm::vec4>& boneSpheres, glm::vec4* texels) const;
+
+public:
+	// collects the node hierarchy and the bones of every mesh of scene, bones are numbered in the order they are
+	// first met. The scene has to outlive the baker
+	AnimationBaker(const aiScene* scene);
+
+	glm::uint boneCount() const;
+
+	// fills in the bone ids and weights of vertices, converted from mesh in order. The MAX_BONE_INFLUENCE strongest
+	// bones of a vertex are kept and their weights normalized, vertices without bones keep all weights 0
+	void addWeights(const aiMesh* mesh, std::vector<Vertex>& vertices) const;
+
+	// samples every clip of the scene at ANIMATION_BAKE_FPS. meshes hold the weights from addWeights, they bound the
+	// model over all frames. Empty if the scene has no bones or no clips
+	BakedAnimation bake(const std::vector<CookedMesh>& meshes) const;
+};
@@ -0,0 +1,291 @@
+#include "AssetArchive.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+//bump when the layout of the archive changes
+const unsigned int ASSET_ARCHIVE_VERSION = 1;
+const char ASSET_ARCHIVE_MAGIC[4] = { 'P', 'A', 'C', 'K' };
+
+//files start on a page of their own, so every file is mapped from its first byte and its blocks are never split
+//across more pages than they need to be
+const unsigned long long ASSET_ARCHIVE_ALIGNMENT = 4096;
+
+namespace
+{
+	struct ArchiveHeader
+	{
+		char magic[4];
+		unsigned int version;
+		unsigned int fileCount;
+		unsigned int reserved;
+		unsigned long long tocOffset;
+		unsigned long long tocSize;
+	};
+
+	unsigned long long aligned(unsigned long long offset)
+	{
+		return (offset + ASSET_ARCHIVE_ALIGNMENT - 1) / ASSET_ARCHIVE_ALIGNMENT * ASSET_ARCHIVE_ALIGNMENT;
+	}
+
+	void pad(std::ofstream& file, unsigned long long& offset, unsigned long long target)
+	{
+		static const char zeros[ASSET_ARCHIVE_ALIGNMENT] = {};
+		file.write(zeros, static_cast<std::streamsize>(target - offset));
+		offset = target;
+	}
+}
+
+AssetArchive::AssetArchive() : m_recording(false)
+{
+}
+
+AssetArchive& AssetArchive::instance()
+{
+	static AssetArchive archive;
+	return archive;
+}
+
+std::string AssetArchive::normalizePath(const std::string& path)
+{
+	std::vector<std::string> parts;
+	std::string part;
+	for (unsigned int i = 0; i <= path.size(); i++) {
+		char c = i < path.size() ? path[i] : '/';
+		if (c != '/' && c != '\\') {
+#ifdef _WIN32
+			c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+#endif
+			part += c;
+			continue;
+		}
+		if (part == ".." && !parts.empty() && parts.back() != "..") {
+			parts.pop_back();
+		}
+		else if (!part.empty() && part != ".") {
+			parts.push_back(part);
+		}
+		part.clear();
+	}
+	std::string normalized = !path.empty() && (path[0] == '/' || path[0] == '\\') ? "/" : "";
+	for (unsigned int i = 0; i < parts.size(); i++) {
+		normalized += (i > 0 ? "/" : "") + parts[i];
+	}
+	return normalized;
+}
+
+std::string AssetArchive::keyOf(const std::string& path)
+{
+	std::string key = normalizePath(path);
+	for (char& c : key) {
+		c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	}
+	return key;
+}
+
+bool AssetArchive::mount(const std::string& path)
+{
+	m_entries.clear();
+	if (!m_file.open(path)) {
+		return false;
+	}
+	ArchiveHeader header;
+	if (m_file.size() < sizeof(header)) {
+		m_file.close();
+		return false;
+	}
+	std::memcpy(&header, m_file.data(), sizeof(header));
+	if (!std::equal(ASSET_ARCHIVE_MAGIC, ASSET_ARCHIVE_MAGIC + 4, header.magic) || header.version != ASSET_ARCHIVE_VERSION
+		|| header.tocOffset < sizeof(header) || header.tocOffset > m_file.size() || header.tocSize != m_file.size() - header.tocOffset) {
+		std::cout << "WARNING::ARCHIVE:: " << path << " is no asset archive of this version" << std::endl;
+		m_file.close();
+		return false;
+	}
+
+	//the table of contents, every file has to lie between the header and the table
+	const unsigned char* position = m_file.data() + header.tocOffset;
+	const unsigned char* end = m_file.data() + m_file.size();
+	for (unsigned int i = 0; i < header.fileCount; i++) {
+		Entry entry;
+		unsigned int length;
+		if (static_cast<size_t>(end - position) < sizeof(entry.offset) + sizeof(entry.size) + sizeof(length)) {
+			break;
+		}
+		std::memcpy(&entry.offset, position, sizeof(entry.offset));
+		std::memcpy(&entry.size, position + 8, sizeof(entry.size));
+		std::memcpy(&length, position + 16, sizeof(length));
+		position += 20;
+		if (length > static_cast<size_t>(end - position) || entry.offset < sizeof(header) || entry.offset > header.tocOffset
+			|| entry.size > header.tocOffset - entry.offset) {
+			break;
+		}
+		m_entries[keyOf(std::string(reinterpret_cast<const char*>(position), length))] = entry;
+		position += length;
+	}
+	if (m_entries.size() != header.fileCount) {
+		std::cout << "WARNING::ARCHIVE:: the table of contents of " << path << " is damaged" << std::endl;
+		m_entries.clear();
+		m_file.close();
+		return false;
+	}
+	std::cout << "ARCHIVE:: mounted " << path << ", " << m_entries.size() << " files in " << m_file.size() / (1024 * 1024) << " MB" << std::endl;
+	return true;
+}
+
+bool AssetArchive::isMounted() const
+{
+	return m_file.isOpen();
+}
+
+unsigned int AssetArchive::fileCount() const
+{
+	return static_cast<unsigned int>(m_entries.size());
+}
+
+bool AssetArchive::contains(const std::string& path) const
+{
+	return !m_entries.empty() && m_entries.count(keyOf(path)) > 0;
+}
+
+bool AssetArchive::find(const std::string& path, const unsigned char*& data, size_t& size) const
+{
+	if (m_entries.empty()) {
+		return false;
+	}
+	auto it = m_entries.find(keyOf(path));
+	if (it == m_entries.end()) {
+		return false;
+	}
+	data = m_file.data() + it->second.offset;
+	size = static_cast<size_t>(it->second.size);
+	return true;
+}
+
+void AssetArchive::record()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_recording = true;
+}
+
+void AssetArchive::request(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_recording && m_recordedKeys.insert(keyOf(path)).second) {
+		m_recorded.push_back(normalizePath(path));
+	}
+}
+
+bool AssetArchive::write(const std::string& path) const
+{
+	std::vector<std::string> paths;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		paths = m_recorded;
+	}
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cout << "ERROR::ARCHIVE:: could not write " << path << std::endl;
+		return false;
+	}
+
+	//the header is written again once the table of contents is known
+	ArchiveHeader header = {};
+	std::memcpy(header.magic, ASSET_ARCHIVE_MAGIC, sizeof(header.magic));
+	header.version = ASSET_ARCHIVE_VERSION;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	unsigned long long offset = sizeof(header);
+
+	std::vector<std::string> packed;
+	std::vector<Entry> entries;
+	for (const std::string& assetPath : paths) {
+		MappedFile asset(assetPath);
+		if (!asset.isOpen()) {
+			continue; //opened but never found, the loader fell back on something else
+		}
+		pad(file, offset, aligned(offset));
+		file.write(reinterpret_cast<const char*>(asset.data()), static_cast<std::streamsize>(asset.size()));
+		packed.push_back(assetPath);
+		entries.push_back(Entry{ offset, asset.size() });
+		offset += asset.size();
+	}
+
+	header.fileCount = static_cast<unsigned int>(packed.size());
+	header.tocOffset = offset;
+	for (unsigned int i = 0; i < packed.size(); i++) {
+		unsigned int length = static_cast<unsigned int>(packed[i].size());
+		file.write(reinterpret_cast<const char*>(&entries[i].offset), sizeof(entries[i].offset));
+		file.write(reinterpret_cast<const char*>(&entries[i].size), sizeof(entries[i].size));
+		file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+		file.write(packed[i].data(), length);
+		offset += 20 + length;
+	}
+	header.tocSize = offset - header.tocOffset;
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (!file) {
+		std::cout << "ERROR::ARCHIVE:: could not write " << path << std::endl;
+		return false;
+	}
+	std::cout << "ARCHIVE:: packed " << packed.size() << " files into " << path << ", " << offset / (1024 * 1024) << " MB" << std::endl;
+	return true;
+}
+
+AssetFile::AssetFile() : m_data(nullptr), m_size(0), m_open(false), m_packed(false)
+{
+}
+
+AssetFile::AssetFile(const std::string& path) : AssetFile()
+{
+	open(path);
+}
+
+bool AssetFile::open(const std::string& path)
+{
+	close();
+	AssetArchive& archive = AssetArchive::instance();
+	archive.request(path);
+	if (archive.find(path, m_data, m_size)) {
+		m_open = true;
+		m_packed = true;
+		return true;
+	}
+	if (!m_loose.open(path)) {
+		return false;
+	}
+	m_data = m_loose.data();
+	m_size = m_loose.size();
+	m_open = true;
+	return true;
+}
+
+void AssetFile::close()
+{
+	m_loose.close();
+	m_data = nullptr;
+	m_size = 0;
+	m_open = false;
+	m_packed = false;
+}
+
+bool AssetFile::isOpen() const
+{
+	return m_open;
+}
+
+bool AssetFile::packed() const
+{
+	return m_packed;
+}
+
+const unsigned char* AssetFile::data() const
+{
+	return m_data;
+}
+
+size_t AssetFile::size() const
+{
+	return m_size;
+}
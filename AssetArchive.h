@@ -0,0 +1,101 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// every asset the game reads packed into one file: a header, the files one after another, each starting on a page,
+// and a table of contents at the end with the path, offset and size of every file. It is mapped once at startup and
+// the loaders read their files straight out of the mapping, so a cold start touches one large file instead of opening
+// dozens of small ones. Files that aren't packed are still read from the disk.
+//
+// The archive is cooked by running the game with --cook: everything opened through AssetFile is recorded while the
+// scene loads and packed in the order it was first opened, which is the order the next start reads it in.
+class AssetArchive
+{
+private:
+	struct Entry
+	{
+		unsigned long long offset;
+		unsigned long long size;
+	};
+
+	MappedFile m_file;
+	std::unordered_map<std::string, Entry> m_entries; //by keyOf their path
+
+	bool m_recording;
+	std::vector<std::string> m_recorded;
+	std::unordered_set<std::string> m_recordedKeys;
+	mutable std::mutex m_mutex;
+
+	AssetArchive();
+
+	//the normalized path without case, an archive cooked on one system is found on any other
+	static std::string keyOf(const std::string& path);
+
+public:
+	static AssetArchive& instance();
+
+	AssetArchive(const AssetArchive&) = delete;
+	AssetArchive& operator=(const AssetArchive&) = delete;
+
+	// separators become '/', "." and "dir/.." are resolved. Paths on Windows don't care about case
+	static std::string normalizePath(const std::string& path);
+
+	// maps the archive at path, its files are found before the loose ones from then on. False if there is no valid
+	// archive at path
+	bool mount(const std::string& path);
+	bool isMounted() const;
+	unsigned int fileCount() const;
+
+	bool contains(const std::string& path) const;
+
+	// the bytes of the file at path inside the mapping, false if it isn't packed
+	bool find(const std::string& path, const unsigned char*& data, size_t& size) const;
+
+	// remembers every path opened through AssetFile from now on, they are packed by write
+	void record();
+
+	// called by AssetFile for every path it opens, safe from any thread
+	void request(const std::string& path);
+
+	// packs every recorded file that exists by now into an archive at path
+	bool write(const std::string& path) const;
+};
+
+// a file of the mounted archive or, when it isn't packed, the loose file mapped on its own. Either way data points
+// straight at the mapped bytes, nothing is copied
+class AssetFile
+{
+private:
+	MappedFile m_loose;
+	const unsigned char* m_data;
+	size_t m_size;
+	bool m_open; //on its own, data may be null for an empty file
+	bool m_packed;
+
+public:
+	AssetFile();
+	// opens path, isOpen is false if it is neither packed nor on the disk
+	AssetFile(const std::string& path);
+
+	AssetFile(const AssetFile&) = delete;
+	AssetFile& operator=(const AssetFile&) = delete;
+
+	// opens path instead of the file opened so far, false if it can't be found
+	bool open(const std::string& path);
+
+	// lets go of the file, so a loose one can be written again on Windows
+	void close();
+
+	bool isOpen() const;
+	// true if the bytes come from the archive
+	bool packed() const;
+	const unsigned char* data() const;
+	size_t size() const;
+};
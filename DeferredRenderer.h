@@ -0,0 +1,387 @@
+#ifndef DEFERRED_RENDERER_H
+#define DEFERRED_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm/glm.hpp>
+#include <glm/glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+#include "GpuResources.h"
+#include "ShaderVariants.h"
+#include "LightmapBaker.h"
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#include <cstddef>
+
+// a cone of light like the flashlight, dynamic lights are passed in every frame
+struct DeferredSpotLight
+{
+    glm::vec3 position;
+    glm::vec3 direction;
+    float cutOff;      // cosine of the inner angle
+    float outerCutOff; // cosine of the outer angle
+    float constant;
+    float linear;
+    float quadratic;
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+};
+
+// the alternative to lighting every fragment in light_object.fs: the scene is drawn once with the GBUFFER shader
+// variants into a G-buffer (light, albedo, normal and depth), then every light adds itself in screen space, only on
+// the pixels it can reach. Point and spot lights are drawn as boxes around their range, so a light costs the pixels
+// it covers no matter how much geometry is in the scene. The directional light covers the whole screen.
+//
+// Lights that are baked into the lightmap are written to the light target by the geometry pass already and are
+// skipped here. Usage per frame: resize, beginGeometryPass, draw the scene, lightingPass, present.
+class DeferredRenderer
+{
+public:
+    DeferredRenderer(const StaticLights& lights)
+        : directionalShader("deferred_light.vs", "deferred_light.fs", nullptr, "#define DIRECTIONAL_LIGHT\n"),
+          pointShader("deferred_light.vs", "deferred_light.fs", nullptr, "#define POINT_LIGHT\n"),
+          spotShader("deferred_light.vs", "deferred_light.fs", nullptr, "#define SPOT_LIGHT\n"),
+          dirLight(lights.dirLight)
+    {
+        Shader* shaders[] = { &directionalShader, &pointShader, &spotShader };
+        for (Shader* shader : shaders)
+        {
+            shader->use();
+            shader->setInt("gAlbedo", 0);
+            shader->setInt("gNormal", 1);
+            shader->setInt("gDepth", 2);
+            shader->setFloat("shininess", 90.0f);
+            LightUniforms& uniforms = uniformsOf(*shader);
+            uniforms.inverseViewProjection = shader->uniform<glm::mat4>("inverseViewProjection");
+            uniforms.viewProjection = shader->uniform<glm::mat4>("viewProjection");
+            uniforms.screenSize = shader->uniform<glm::vec2>("screenSize");
+            uniforms.viewPos = shader->uniform<glm::vec3>("viewPos");
+            uniforms.specular = shader->uniform<bool>("specular");
+        }
+        directionalShader.use();
+        directionalShader.setVec3("dirLight.direction", dirLight.direction);
+        directionalShader.setVec3("dirLight.ambient", dirLight.ambient);
+        directionalShader.setVec3("dirLight.diffuse", dirLight.diffuse);
+        spotVolume = spotShader.uniform<glm::vec4>("volume");
+
+        createGeometry();
+        setPointLights(lights.pointLights);
+    }
+
+    DeferredRenderer(const DeferredRenderer&) = delete;
+    DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+    // the point lights, call again whenever they move or change
+    void setPointLights(const std::vector<StaticPointLight>& lights)
+    {
+        std::vector<PointLightInstance> instances(lights.size());
+        for (unsigned int i = 0; i < lights.size(); i++)
+        {
+            const StaticPointLight& light = lights[i];
+            instances[i].positionRange = glm::vec4(light.position, lightRange(light.constant, light.linear, light.quadratic, light.ambient + light.diffuse));
+            instances[i].ambient = light.ambient;
+            instances[i].diffuse = light.diffuse;
+            instances[i].attenuation = glm::vec3(light.constant, light.linear, light.quadratic);
+        }
+        pointLightCount = static_cast<unsigned int>(instances.size());
+        GpuResources::bufferData(GL_ARRAY_BUFFER, pointInstanceVBO, instances.size() * sizeof(PointLightInstance), instances.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // (re)allocates the G-buffer for the size of the default framebuffer, does nothing if it didn't change
+    void resize(int width, int height)
+    {
+        if (width <= 0 || height <= 0 || (width == this->width && height == this->height))
+            return;
+        release();
+        this->width = width;
+        this->height = height;
+
+        lightTexture = createTexture(GL_RGBA16F, GL_RGBA, GL_FLOAT, 8);
+        albedoTexture = createTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4);
+        normalTexture = createTexture(GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, 4);
+        // same format as the GLFW default depth buffer, so it can be blitted there for the forward passes that follow
+        depthTexture = createTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 4);
+
+        gBuffer = GpuResources::instance().create(GPU_FRAMEBUFFER, GPU_RENDER_TARGETS);
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer.id());
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, lightTexture.id(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, albedoTexture.id(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, normalTexture.id(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture.id(), 0);
+        GLenum attachments[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+        glDrawBuffers(3, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::DEFERRED:: G-buffer is not complete" << std::endl;
+
+        // the lighting pass samples depth, so it renders into a framebuffer with only the light target attached
+        lightBuffer = GpuResources::instance().create(GPU_FRAMEBUFFER, GPU_RENDER_TARGETS);
+        glBindFramebuffer(GL_FRAMEBUFFER, lightBuffer.id());
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, lightTexture.id(), 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::DEFERRED:: light framebuffer is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // binds and clears the G-buffer, the scene is drawn next with the GBUFFER variants. Blending is switched off, an
+    // unlit fragment (alpha 0) in front would otherwise keep the albedo and normal of the surface behind it
+    void beginGeometryPass()
+    {
+        glDisable(GL_BLEND);
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer.id());
+        const GLfloat background[] = { 0.2f, 0.3f, 0.3f, 1.0f };
+        const GLfloat zero[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const GLfloat farDepth = 1.0f;
+        glClearBufferfv(GL_COLOR, 0, background);
+        glClearBufferfv(GL_COLOR, 1, zero);
+        glClearBufferfv(GL_COLOR, 2, zero); // alpha 0 marks pixels no light touches
+        glClearBufferfi(GL_DEPTH_STENCIL, 0, farDepth, 0);
+    }
+
+    // the framebuffer of the geometry pass, e.g. to build the Hi-Z buffer from
+    unsigned int framebuffer() const
+    {
+        return gBuffer.id();
+    }
+
+    // adds the lights to the light target. features are the ShaderFeature flags of the frame: with SHADER_LIGHTMAP
+    // the directional and point lights are already in the lightmap, SHADER_FLASHLIGHT adds the spot lights and
+    // SHADER_SPECULAR the highlights. Leaves the usual alpha blending on for the forward passes that follow
+    void lightingPass(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& viewPos, unsigned int features,
+        const std::vector<DeferredSpotLight>& spotLights)
+    {
+        glm::mat4 viewProjection = projection * view;
+        glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, lightBuffer.id());
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, albedoTexture.id());
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, normalTexture.id());
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, depthTexture.id());
+        glActiveTexture(GL_TEXTURE0);
+
+        // every light adds to what is there, the volumes are drawn from the inside (back faces) so the camera can be
+        // within them, without depth test since the fragment shader rejects what is out of range anyway. Depth clamp
+        // keeps the far side of a volume that reaches beyond the far plane
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_DEPTH_CLAMP);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glCullFace(GL_FRONT);
+
+        Shader* shaders[] = { &directionalShader, &pointShader, &spotShader };
+        for (Shader* shader : shaders)
+        {
+            const LightUniforms& uniforms = uniformsOf(*shader);
+            shader->use();
+            shader->set(uniforms.inverseViewProjection, inverseViewProjection);
+            shader->set(uniforms.viewProjection, viewProjection);
+            shader->set(uniforms.screenSize, glm::vec2(static_cast<float>(width), static_cast<float>(height)));
+            shader->set(uniforms.viewPos, viewPos);
+            shader->set(uniforms.specular, (features & SHADER_SPECULAR) != 0);
+        }
+
+        if (!(features & SHADER_LIGHTMAP))
+        {
+            // the screen triangle faces the camera, it is drawn before culling is switched on
+            directionalShader.use();
+            glBindVertexArray(screenVAO.id());
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glEnable(GL_CULL_FACE);
+        if (!(features & SHADER_LIGHTMAP) && pointLightCount > 0)
+        {
+            pointShader.use();
+            glBindVertexArray(pointVAO.id());
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 36, pointLightCount);
+        }
+        if (features & SHADER_FLASHLIGHT)
+        {
+            spotShader.use();
+            glBindVertexArray(spotVAO.id());
+            for (const DeferredSpotLight& light : spotLights)
+            {
+                float range = lightRange(light.constant, light.linear, light.quadratic, light.ambient + glm::max(light.diffuse, light.specular));
+                spotShader.set(spotVolume, glm::vec4(light.position, range));
+                spotShader.setVec3("spotLight.position", light.position);
+                spotShader.setVec3("spotLight.direction", light.direction);
+                spotShader.setFloat("spotLight.cutOff", light.cutOff);
+                spotShader.setFloat("spotLight.outerCutOff", light.outerCutOff);
+                spotShader.setFloat("spotLight.constant", light.constant);
+                spotShader.setFloat("spotLight.linear", light.linear);
+                spotShader.setFloat("spotLight.quadratic", light.quadratic);
+                spotShader.setVec3("spotLight.ambient", light.ambient);
+                spotShader.setVec3("spotLight.diffuse", light.diffuse);
+                spotShader.setVec3("spotLight.specular", light.specular);
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+            }
+        }
+
+        glBindVertexArray(0);
+        glCullFace(GL_BACK);
+        glDisable(GL_CULL_FACE);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_DEPTH_CLAMP);
+        glEnable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // copies the lit image and the depth to the default framebuffer, so skybox and text can be drawn forward on top
+    void present()
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer.id());
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // distance at which a light has faded below 5/256 of the brightest color it can add, too little to show in an
+    // 8 bit image. Used as the size of its volume
+    static float lightRange(float constant, float linear, float quadratic, const glm::vec3& color)
+    {
+        float brightest = std::max(std::max(color.r, color.g), color.b);
+        float limit = brightest * 256.0f / 5.0f;
+        if (quadratic <= 0.0f)
+            return linear > 0.0f ? std::max(0.0f, (limit - constant) / linear) : 100000.0f;
+        return (-linear + std::sqrt(std::max(0.0f, linear * linear - 4.0f * quadratic * (constant - limit)))) / (2.0f * quadratic);
+    }
+
+private:
+    struct PointLightInstance
+    {
+        glm::vec4 positionRange;
+        glm::vec3 ambient;
+        glm::vec3 diffuse;
+        glm::vec3 attenuation;
+    };
+
+    struct LightUniforms
+    {
+        Uniform<glm::mat4> inverseViewProjection;
+        Uniform<glm::mat4> viewProjection;
+        Uniform<glm::vec2> screenSize;
+        Uniform<glm::vec3> viewPos;
+        Uniform<bool> specular;
+    };
+
+    Shader directionalShader;
+    Shader pointShader;
+    Shader spotShader;
+    LightUniforms lightUniforms[3];
+    Uniform<glm::vec4> spotVolume;
+    StaticDirLight dirLight;
+
+    int width = 0, height = 0;
+    GpuHandle gBuffer, lightBuffer;
+    GpuHandle lightTexture, albedoTexture, normalTexture, depthTexture;
+    GpuHandle screenVAO, screenVBO;
+    GpuHandle pointVAO, spotVAO, cubeVBO, pointInstanceVBO;
+    unsigned int pointLightCount = 0;
+
+    LightUniforms& uniformsOf(const Shader& shader)
+    {
+        if (&shader == &directionalShader)
+            return lightUniforms[0];
+        return &shader == &pointShader ? lightUniforms[1] : lightUniforms[2];
+    }
+
+    GpuHandle createTexture(GLint internalFormat, GLenum format, GLenum type, unsigned int bytesPerTexel)
+    {
+        GpuHandle texture = GpuResources::instance().create(GPU_TEXTURE, GPU_RENDER_TARGETS);
+        glBindTexture(GL_TEXTURE_2D, texture.id());
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        texture.setBytes(static_cast<size_t>(width) * height * bytesPerTexel);
+        return texture;
+    }
+
+    void release()
+    {
+        gBuffer = lightBuffer = GpuHandle();
+        lightTexture = albedoTexture = normalTexture = depthTexture = GpuHandle();
+        width = height = 0;
+    }
+
+    void createGeometry()
+    {
+        // one triangle that covers the screen
+        float screenVertices[] = {
+            -1.0f, -1.0f, 0.0f,
+             3.0f, -1.0f, 0.0f,
+            -1.0f,  3.0f, 0.0f
+        };
+        GpuResources& resources = GpuResources::instance();
+        screenVAO = resources.create(GPU_VERTEX_ARRAY, GPU_GEOMETRY);
+        screenVBO = resources.create(GPU_BUFFER, GPU_GEOMETRY);
+        glBindVertexArray(screenVAO.id());
+        GpuResources::bufferData(GL_ARRAY_BUFFER, screenVBO, sizeof(screenVertices), screenVertices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+
+        // unit box around a light, counter-clockwise seen from outside
+        float cubeVertices[] = {
+            // +x
+             1.0f, -1.0f, -1.0f,   1.0f,  1.0f, -1.0f,   1.0f,  1.0f,  1.0f,
+             1.0f, -1.0f, -1.0f,   1.0f,  1.0f,  1.0f,   1.0f, -1.0f,  1.0f,
+            // -x
+            -1.0f, -1.0f, -1.0f,  -1.0f,  1.0f,  1.0f,  -1.0f,  1.0f, -1.0f,
+            -1.0f, -1.0f, -1.0f,  -1.0f, -1.0f,  1.0f,  -1.0f,  1.0f,  1.0f,
+            // +y
+            -1.0f,  1.0f, -1.0f,  -1.0f,  1.0f,  1.0f,   1.0f,  1.0f,  1.0f,
+            -1.0f,  1.0f, -1.0f,   1.0f,  1.0f,  1.0f,   1.0f,  1.0f, -1.0f,
+            // -y
+            -1.0f, -1.0f, -1.0f,   1.0f, -1.0f,  1.0f,  -1.0f, -1.0f,  1.0f,
+            -1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,   1.0f, -1.0f,  1.0f,
+            // +z
+            -1.0f, -1.0f,  1.0f,   1.0f, -1.0f,  1.0f,   1.0f,  1.0f,  1.0f,
+            -1.0f, -1.0f,  1.0f,   1.0f,  1.0f,  1.0f,  -1.0f,  1.0f,  1.0f,
+            // -z
+            -1.0f, -1.0f, -1.0f,   1.0f,  1.0f, -1.0f,   1.0f, -1.0f, -1.0f,
+            -1.0f, -1.0f, -1.0f,  -1.0f,  1.0f, -1.0f,   1.0f,  1.0f, -1.0f
+        };
+        cubeVBO = resources.create(GPU_BUFFER, GPU_GEOMETRY);
+        GpuResources::bufferData(GL_ARRAY_BUFFER, cubeVBO, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
+
+        // the spot lights draw the box once per light, placed by a uniform
+        spotVAO = resources.create(GPU_VERTEX_ARRAY, GPU_GEOMETRY);
+        glBindVertexArray(spotVAO.id());
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+
+        // the point lights draw it instanced, one instance per light
+        pointVAO = resources.create(GPU_VERTEX_ARRAY, GPU_GEOMETRY);
+        pointInstanceVBO = resources.create(GPU_BUFFER, GPU_GEOMETRY);
+        glBindVertexArray(pointVAO.id());
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, pointInstanceVBO.id());
+        GLsizei stride = sizeof(PointLightInstance);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(PointLightInstance, positionRange));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(PointLightInstance, ambient));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(PointLightInstance, diffuse));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(PointLightInstance, attenuation));
+        for (unsigned int i = 1; i <= 4; i++)
+            glVertexAttribDivisor(i, 1);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+#endif
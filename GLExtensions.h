@@ -0,0 +1,174 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+// glad is generated for OpenGL 3.3 only. The optional OpenGL 4.x render paths load the few entry points they need
+// here, after glad, and check the capability flags before using them. The 3.3 paths never touch anything in this file.
+
+#include <cstring>
+
+// constants
+// ---------
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_TEXTURE_FETCH_BARRIER_BIT
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#endif
+#ifndef GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+#define GL_SHADER_IMAGE_ACCESS_BARRIER_BIT 0x00000020
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// function types
+// --------------
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+typedef void (APIENTRYP PFNGLDISPATCHCOMPUTEPROC)(GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z);
+typedef void (APIENTRYP PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+typedef void (APIENTRYP PFNGLBINDIMAGETEXTUREPROC)(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format);
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+typedef void (APIENTRYP PFNGLTEXSTORAGE2DPROC)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+
+struct GLExtensionFunctions {
+    // capabilities
+    bool multiDrawIndirect;     // OpenGL 4.3: glMultiDrawElementsIndirect and shader storage buffers
+    bool computeShaders;        // OpenGL 4.3: compute shaders, memory barriers and image load/store
+    bool programBinary;         // OpenGL 4.1 or ARB_get_program_binary, with at least one binary format
+    bool parallelShaderCompile; // KHR/ARB_parallel_shader_compile: compiles and links return immediately
+    bool textureStorage;        // OpenGL 4.2 or ARB_texture_storage: immutable texture storage
+    bool textureCompressionS3tc;     // EXT_texture_compression_s3tc: BC1 and BC3 textures, BC5 is core as RGTC
+    bool textureCompressionS3tcSrgb; // EXT_texture_sRGB or EXT_texture_compression_s3tc_srgb: the same as sRGB
+
+    // entry points
+    PFNGLMULTIDRAWELEMENTSINDIRECTPROC MultiDrawElementsIndirectProc;
+    PFNGLDISPATCHCOMPUTEPROC DispatchComputeProc;
+    PFNGLMEMORYBARRIERPROC MemoryBarrierProc;
+    PFNGLBINDIMAGETEXTUREPROC BindImageTextureProc;
+    PFNGLGETPROGRAMBINARYPROC GetProgramBinaryProc;
+    PFNGLPROGRAMBINARYPROC ProgramBinaryProc;
+    PFNGLPROGRAMPARAMETERIPROC ProgramParameteriProc;
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC MaxShaderCompilerThreadsProc;
+    PFNGLTEXSTORAGE2DPROC TexStorage2DProc;
+};
+
+inline GLExtensionFunctions& glExtensions()
+{
+    static GLExtensionFunctions functions = {};
+    return functions;
+}
+
+#define glMultiDrawElementsIndirect glExtensions().MultiDrawElementsIndirectProc
+#define glDispatchCompute glExtensions().DispatchComputeProc
+#define glMemoryBarrier glExtensions().MemoryBarrierProc
+#define glBindImageTexture glExtensions().BindImageTextureProc
+#define glGetProgramBinary glExtensions().GetProgramBinaryProc
+#define glProgramBinary glExtensions().ProgramBinaryProc
+#define glProgramParameteri glExtensions().ProgramParameteriProc
+#define glMaxShaderCompilerThreadsKHR glExtensions().MaxShaderCompilerThreadsProc
+#define glTexStorage2D glExtensions().TexStorage2DProc
+
+// whether the context reports the extension, only valid on a current context
+inline bool hasGLExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension != nullptr && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// call once after gladLoadGLLoader with the same loader
+inline void loadGLExtensions(GLADloadproc load)
+{
+    GLExtensionFunctions& ext = glExtensions();
+    bool gl43 = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3);
+
+    if (gl43)
+    {
+        ext.MultiDrawElementsIndirectProc = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+        ext.DispatchComputeProc = (PFNGLDISPATCHCOMPUTEPROC)load("glDispatchCompute");
+        ext.MemoryBarrierProc = (PFNGLMEMORYBARRIERPROC)load("glMemoryBarrier");
+        ext.BindImageTextureProc = (PFNGLBINDIMAGETEXTUREPROC)load("glBindImageTexture");
+    }
+    ext.multiDrawIndirect = gl43 && ext.MultiDrawElementsIndirectProc != nullptr;
+    ext.computeShaders = gl43 && ext.DispatchComputeProc != nullptr && ext.MemoryBarrierProc != nullptr && ext.BindImageTextureProc != nullptr;
+
+    bool gl41 = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1);
+    if (gl41 || hasGLExtension("GL_ARB_get_program_binary"))
+    {
+        ext.GetProgramBinaryProc = (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+        ext.ProgramBinaryProc = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+        ext.ProgramParameteriProc = (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+    }
+    GLint binaryFormats = 0;
+    if (ext.GetProgramBinaryProc != nullptr && ext.ProgramBinaryProc != nullptr && ext.ProgramParameteriProc != nullptr)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    ext.programBinary = binaryFormats > 0; // some drivers expose the entry points but no format to store
+
+    if (hasGLExtension("GL_KHR_parallel_shader_compile"))
+        ext.MaxShaderCompilerThreadsProc = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsKHR");
+    else if (hasGLExtension("GL_ARB_parallel_shader_compile"))
+        ext.MaxShaderCompilerThreadsProc = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsARB");
+    ext.parallelShaderCompile = ext.MaxShaderCompilerThreadsProc != nullptr;
+    if (ext.parallelShaderCompile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // as many threads as the driver likes
+
+    bool gl42 = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 2);
+    if (gl42 || hasGLExtension("GL_ARB_texture_storage"))
+        ext.TexStorage2DProc = (PFNGLTEXSTORAGE2DPROC)load("glTexStorage2D");
+    ext.textureStorage = ext.TexStorage2DProc != nullptr;
+
+    ext.textureCompressionS3tc = hasGLExtension("GL_EXT_texture_compression_s3tc");
+    ext.textureCompressionS3tcSrgb = ext.textureCompressionS3tc
+        && (hasGLExtension("GL_EXT_texture_sRGB") || hasGLExtension("GL_EXT_texture_compression_s3tc_srgb"));
+}
+#endif
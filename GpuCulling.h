@@ -0,0 +1,405 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm/glm/glm.hpp>
+#include <glm/glm/gtc/type_ptr.hpp>
+
+#include "GLExtensions.h"
+#include "GpuResources.h"
+#include "shader.h"
+#include "StaticBatch.h"
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+
+using namespace std;
+
+#define CULL_GROUP_SIZE 64
+#define HIZ_GROUP_SIZE 8
+
+// culls the instances of a StaticBatch on the GPU. A compute pass tests the bounding sphere of every instance against
+// the view frustum, and optionally against a hierarchical z buffer of the previous frame, and writes the transform
+// indices of the visible ones straight into the batch's instance buffer and their number into its indirect commands.
+// The CPU never looks at single instances. Needs OpenGL 4.3, check glExtensions().computeShaders.
+//
+// Visible instances also pick their level of detail there, by the same rule as Model::selectLod, and are moved to
+// the command of that level.
+//
+// buffer bindings of cull.cs: 0 transforms, 1 indirect commands, 2 cull items, 3 bounds, 4 visible instances,
+// 6 level of detail errors, 7 level of every item in the previous frame, 8 region of every transform, 9 regions
+// drawn as their proxy
+//
+// instances that are far enough to be drawn only as impostors (see Impostor.h and setImpostors) are dropped as well,
+// so are the ones of maze regions drawn as one merged proxy (see RegionProxies.h and setRegions)
+class GpuCuller {
+public:
+    GpuCuller(StaticBatch& batch) : batch(batch), cullShader("cull.cs"), reduceShader("hiz_reduce.cs")
+    {
+        const vector<DrawElementsIndirectCommand>& commands = batch.getCommands();
+        const vector<GLuint>& instanceTransforms = batch.getInstanceTransforms();
+
+        // one item per instance, pointing at its command and transform. Only full detail commands have instances
+        // to begin with, the coarser levels follow them
+        vector<GLuint> items;
+        items.reserve(instanceTransforms.size() * 2);
+        for (unsigned int c = 0; c < commands.size(); c++)
+        {
+            for (unsigned int i = 0; i < commands[c].instanceCount; i++)
+            {
+                items.push_back(c);
+                items.push_back(instanceTransforms[commands[c].baseInstance + i]);
+            }
+        }
+        itemCount = static_cast<unsigned int>(items.size() / 2);
+
+        vector<DrawElementsIndirectCommand> emptyCommands = commands;
+        for (unsigned int c = 0; c < emptyCommands.size(); c++)
+            emptyCommands[c].instanceCount = 0;
+
+        itemBuffer = createBuffer(items.size() * sizeof(GLuint), items.data());
+        boundsBuffer = createBuffer(batch.getCommandBounds().size() * sizeof(glm::vec4), batch.getCommandBounds().data());
+        emptyCommandBuffer = createBuffer(emptyCommands.size() * sizeof(DrawElementsIndirectCommand), emptyCommands.data());
+        fullCommandBuffer = createBuffer(commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+        fullInstanceBuffer = createBuffer(instanceTransforms.size() * sizeof(GLuint), instanceTransforms.data());
+        lodErrorBuffer = createBuffer(batch.getCommandLodErrors().size() * sizeof(glm::vec4), batch.getCommandLodErrors().data());
+        vector<GLuint> itemLods(itemCount, 0);
+        itemLodBuffer = createBuffer(itemLods.size() * sizeof(GLuint), itemLods.data());
+
+        // uniforms
+        itemCountUniform = cullShader.uniform<int>("itemCount");
+        planesLocation = cullShader.getUniformLocation("planes");
+        useHiZUniform = cullShader.uniform<bool>("useHiZ");
+        hiZLevelsUniform = cullShader.uniform<int>("hiZLevels");
+        hiZSizeUniform = cullShader.uniform<glm::vec2>("hiZSize");
+        previousViewProjectionUniform = cullShader.uniform<glm::mat4>("previousViewProjection");
+        cameraPositionUniform = cullShader.uniform<glm::vec3>("cameraPosition");
+        lodPixelsPerUnitUniform = cullShader.uniform<float>("lodPixelsPerUnit");
+        impostorFadeUniform = cullShader.uniform<glm::vec2>("impostorFade");
+        sourceLevelUniform = reduceShader.uniform<int>("sourceLevel");
+        copyDepthUniform = reduceShader.uniform<bool>("copyDepth");
+        cullShader.use();
+        cullShader.setInt("hiZ", 0);
+        cullShader.setFloat("lodPixelError", LOD_PIXEL_ERROR);
+        cullShader.setFloat("lodHysteresis", LOD_HYSTERESIS);
+        cullShader.setInt("impostorFirstTransform", 0);
+        cullShader.setInt("impostorTransformCount", 0);
+        cullShader.setInt("regionFirstTransform", 0);
+        cullShader.setInt("regionTransformCount", 0);
+        reduceShader.use();
+        reduceShader.setInt("source", 0);
+        glUseProgram(0);
+    }
+
+    // the count transforms from first on have an impostor, they are left out past LodView::impostorFade
+    void setImpostors(unsigned int first, unsigned int count)
+    {
+        cullShader.use();
+        cullShader.setInt("impostorFirstTransform", static_cast<int>(first));
+        cullShader.setInt("impostorTransformCount", static_cast<int>(count));
+        glUseProgram(0);
+    }
+
+    // the transforms from first on belong to the regions in regionOfTransforms, their instances are left out while
+    // setProxyRegions marks the region
+    void setRegions(unsigned int first, const vector<unsigned int>& regionOfTransforms, unsigned int regionCount)
+    {
+        regionBuffer = createBuffer(regionOfTransforms.size() * sizeof(GLuint), regionOfTransforms.data());
+        vector<GLuint> proxyRegions(regionCount, 0);
+        proxyRegionBuffer = createBuffer(proxyRegions.size() * sizeof(GLuint), proxyRegions.data());
+        cullShader.use();
+        cullShader.setInt("regionFirstTransform", static_cast<int>(first));
+        cullShader.setInt("regionTransformCount", static_cast<int>(regionOfTransforms.size()));
+        glUseProgram(0);
+    }
+
+    // 1 for every region that is drawn as its proxy, see RegionProxies::getProxyRegions
+    void setProxyRegions(const vector<unsigned int>& proxyRegions)
+    {
+        if (!proxyRegionBuffer.valid())
+            return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, proxyRegionBuffer.id());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, proxyRegions.size() * sizeof(GLuint), proxyRegions.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // rewrites the batch's indirect commands and instance buffer so only visible instances are drawn.
+    // Hi-Z is only used once updateHiZ has captured a frame. Without a lodView every instance is drawn in full detail
+    // and none is left to an impostor.
+    void cull(const glm::mat4& viewProjection, bool useHiZ, const LodView& lodView = LodView())
+    {
+        glm::vec4 planes[6];
+        frustumPlanes(viewProjection, planes);
+
+        // every command starts out empty, the shader counts its visible instances up again
+        copyBuffer(emptyCommandBuffer.id(), batch.indirectBufferID(), batch.getCommands().size() * sizeof(DrawElementsIndirectCommand));
+
+        cullShader.use();
+        cullShader.set(itemCountUniform, static_cast<int>(itemCount));
+        glUniform4fv(planesLocation, 6, glm::value_ptr(planes[0]));
+        bool hiZ = useHiZ && hiZTexture.valid();
+        cullShader.set(useHiZUniform, hiZ);
+        cullShader.set(cameraPositionUniform, lodView.position);
+        cullShader.set(lodPixelsPerUnitUniform, lodView.pixelsPerUnit);
+        cullShader.set(impostorFadeUniform, lodView.impostorFade);
+        if (hiZ)
+        {
+            cullShader.set(hiZLevelsUniform, hiZLevels);
+            cullShader.set(hiZSizeUniform, glm::vec2(static_cast<float>(hiZWidth), static_cast<float>(hiZHeight)));
+            cullShader.set(previousViewProjectionUniform, hiZViewProjection);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, hiZTexture.id());
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, batch.transformBufferID());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, batch.indirectBufferID());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, itemBuffer.id());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, boundsBuffer.id());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, batch.instanceBufferID());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, lodErrorBuffer.id());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, itemLodBuffer.id());
+        if (regionBuffer.valid())
+        {
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, regionBuffer.id());
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, proxyRegionBuffer.id());
+        }
+        glDispatchCompute((itemCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+        // the draw reads the results as indirect commands and instance attributes
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+        for (unsigned int i = 1; i <= 9; i++)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glUseProgram(0);
+        culled = true;
+    }
+
+    // makes the batch draw every instance again, call when culling gets switched off
+    void reset()
+    {
+        if (!culled)
+            return;
+        copyBuffer(fullCommandBuffer.id(), batch.indirectBufferID(), batch.getCommands().size() * sizeof(DrawElementsIndirectCommand));
+        copyBuffer(fullInstanceBuffer.id(), batch.instanceBufferID(), batch.getInstanceTransforms().size() * sizeof(GLuint));
+        culled = false;
+    }
+
+    // builds the hierarchical z buffer from the depth buffer of a framebuffer (the default one unless given), which has
+    // to be GL_DEPTH24_STENCIL8 like the GLFW default. viewProjection is the matrix the depth buffer was rendered with.
+    void updateHiZ(int width, int height, const glm::mat4& viewProjection, unsigned int framebuffer = 0)
+    {
+        if (width <= 0 || height <= 0)
+            return;
+        if (width != hiZWidth || height != hiZHeight)
+            allocateHiZ(width, height);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFBO.id());
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        // drawing goes on into the same framebuffer
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+        reduceShader.use();
+        glActiveTexture(GL_TEXTURE0);
+        for (int level = 0; level < hiZLevels; level++)
+        {
+            int levelWidth = std::max(1, width >> level);
+            int levelHeight = std::max(1, height >> level);
+            if (level == 0)
+                glBindTexture(GL_TEXTURE_2D, depthTexture.id());
+            else
+                glBindTexture(GL_TEXTURE_2D, hiZTexture.id());
+            reduceShader.set(copyDepthUniform, level == 0);
+            reduceShader.set(sourceLevelUniform, level - 1);
+            glBindImageTexture(0, hiZTexture.id(), level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            glDispatchCompute((levelWidth + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (levelHeight + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+            // the next level reads this one
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glUseProgram(0);
+        hiZViewProjection = viewProjection;
+    }
+
+    // compares a frustum only cull on the GPU with the same test on the CPU. Instances that touch a plane within
+    // floating point tolerance may go either way, every other one has to match. Prints the result and leaves the
+    // batch culled for viewProjection at full detail.
+    bool validate(const glm::mat4& viewProjection)
+    {
+        cull(viewProjection, false);
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        const vector<DrawElementsIndirectCommand>& commands = batch.getCommands();
+        vector<DrawElementsIndirectCommand> result(commands.size());
+        vector<GLuint> visible(batch.getInstanceTransforms().size());
+        glBindBuffer(GL_COPY_READ_BUFFER, batch.indirectBufferID());
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, result.size() * sizeof(DrawElementsIndirectCommand), result.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, batch.instanceBufferID());
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, visible.size() * sizeof(GLuint), visible.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+        glm::vec4 planes[6];
+        frustumPlanes(viewProjection, planes);
+        const vector<GLuint>& instanceTransforms = batch.getInstanceTransforms();
+        const vector<glm::mat4>& transforms = batch.getTransforms();
+        unsigned int mismatches = 0, total = 0, ambiguous = 0;
+        for (unsigned int c = 0; c < commands.size(); c++)
+        {
+            if (result[c].instanceCount > commands[c].instanceCount)
+            {
+                std::cout << "CULLING::VALIDATE:: command " << c << " has " << result[c].instanceCount << " instances, at most " << commands[c].instanceCount << " expected" << std::endl;
+                mismatches++;
+                continue;
+            }
+            vector<GLuint> gpu(visible.begin() + commands[c].baseInstance, visible.begin() + commands[c].baseInstance + result[c].instanceCount);
+            std::sort(gpu.begin(), gpu.end());
+            for (unsigned int i = 0; i < commands[c].instanceCount; i++)
+            {
+                GLuint transform = instanceTransforms[commands[c].baseInstance + i];
+                int expected = classify(transforms[transform], batch.getCommandBounds()[c], planes);
+                bool drawn = std::binary_search(gpu.begin(), gpu.end(), transform);
+                total++;
+                if (expected == 0)
+                    ambiguous++;
+                else if ((expected > 0) != drawn)
+                    mismatches++;
+            }
+        }
+        std::cout << "CULLING::VALIDATE:: " << total << " instances, " << ambiguous << " on a plane, " << mismatches << " mismatches" << std::endl;
+        return mismatches == 0;
+    }
+
+    // planes of the frustum of a view projection matrix (Gribb/Hartmann), normals point inwards
+    static void frustumPlanes(const glm::mat4& m, glm::vec4 planes[6])
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+        for (unsigned int i = 0; i < 6; i++)
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+
+private:
+    StaticBatch& batch;
+    Shader cullShader;
+    Shader reduceShader;
+    unsigned int itemCount = 0;
+    bool culled = false;
+
+    GpuHandle itemBuffer, boundsBuffer, lodErrorBuffer, itemLodBuffer;
+    GpuHandle regionBuffer, proxyRegionBuffer;
+    // copied over the batch's buffers: commands without instances before culling, the originals on reset
+    GpuHandle emptyCommandBuffer, fullCommandBuffer, fullInstanceBuffer;
+
+    // previous frame's depth
+    GpuHandle depthFBO, depthTexture, hiZTexture;
+    int hiZWidth = 0, hiZHeight = 0, hiZLevels = 0;
+    glm::mat4 hiZViewProjection = glm::mat4(1.0f);
+
+    Uniform<int> itemCountUniform;
+    GLint planesLocation = -1;
+    Uniform<bool> useHiZUniform;
+    Uniform<int> hiZLevelsUniform;
+    Uniform<glm::vec2> hiZSizeUniform;
+    Uniform<glm::mat4> previousViewProjectionUniform;
+    Uniform<glm::vec3> cameraPositionUniform;
+    Uniform<float> lodPixelsPerUnitUniform;
+    Uniform<glm::vec2> impostorFadeUniform;
+    Uniform<int> sourceLevelUniform;
+    Uniform<bool> copyDepthUniform;
+
+    static GpuHandle createBuffer(size_t size, const void* data)
+    {
+        GpuHandle buffer = GpuResources::instance().create(GPU_BUFFER, GPU_GEOMETRY);
+        GpuResources::bufferData(GL_COPY_WRITE_BUFFER, buffer, size, data, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return buffer;
+    }
+
+    static void copyBuffer(unsigned int source, unsigned int destination, size_t size)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, source);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // 1 inside, -1 outside, 0 too close to a plane to tell. Same test as cull.cs
+    static int classify(const glm::mat4& model, const glm::vec4& sphere, const glm::vec4 planes[6])
+    {
+        if (model[3][3] == 0.0f)
+            return -1;
+        glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f));
+        float scale = glm::max(glm::max(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1]))), glm::length(glm::vec3(model[2])));
+        float radius = sphere.w * scale;
+        float tolerance = 1e-4f * (glm::length(center) + radius) + 1e-3f;
+        int result = 1;
+        for (unsigned int i = 0; i < 6; i++)
+        {
+            float distance = glm::dot(glm::vec3(planes[i]), center) + planes[i].w + radius;
+            if (distance < -tolerance)
+                return -1;
+            if (distance <= tolerance)
+                result = 0;
+        }
+        return result;
+    }
+
+    void allocateHiZ(int width, int height)
+    {
+        releaseHiZ();
+        hiZWidth = width;
+        hiZHeight = height;
+        hiZLevels = 1 + static_cast<int>(std::floor(std::log2(static_cast<float>(std::max(width, height)))));
+
+        depthTexture = GpuResources::instance().create(GPU_TEXTURE, GPU_RENDER_TARGETS);
+        glBindTexture(GL_TEXTURE_2D, depthTexture.id());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        depthTexture.setBytes(static_cast<size_t>(width) * height * 4);
+
+        depthFBO = GpuResources::instance().create(GPU_FRAMEBUFFER, GPU_RENDER_TARGETS);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO.id());
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture.id(), 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::CULLING:: Hi-Z depth framebuffer is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        hiZTexture = GpuResources::instance().create(GPU_TEXTURE, GPU_RENDER_TARGETS);
+        glBindTexture(GL_TEXTURE_2D, hiZTexture.id());
+        size_t hiZBytes = 0;
+        for (int level = 0; level < hiZLevels; level++)
+        {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, std::max(1, width >> level), std::max(1, height >> level), 0, GL_RED, GL_FLOAT, NULL);
+            hiZBytes += static_cast<size_t>(std::max(1, width >> level)) * std::max(1, height >> level) * 4;
+        }
+        hiZTexture.setBytes(hiZBytes);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, hiZLevels - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void releaseHiZ()
+    {
+        depthFBO = GpuHandle();
+        depthTexture = GpuHandle();
+        hiZTexture = GpuHandle();
+        hiZWidth = hiZHeight = hiZLevels = 0;
+    }
+};
+#endif
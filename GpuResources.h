@@ -0,0 +1,285 @@
+#ifndef GPU_RESOURCES_H
+#define GPU_RESOURCES_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <iostream>
+#include <algorithm>
+
+// the kinds of GL objects the GpuResources own, each is deleted its own way
+enum GpuObjectType {
+    GPU_BUFFER,
+    GPU_VERTEX_ARRAY,
+    GPU_TEXTURE,
+    GPU_FRAMEBUFFER,
+    GPU_RENDERBUFFER,
+    GPU_PROGRAM,
+    GPU_QUERY
+};
+
+// what the memory of an object is counted as
+enum GpuCategory {
+    GPU_GEOMETRY = 0,       // vertex, index, instance and indirect buffers
+    GPU_TEXTURES = 1,       // textures sampled by materials, streamed by the TextureManager
+    GPU_RENDER_TARGETS = 2, // G-buffer, depth pyramid, atlases rendered at startup
+    GPU_STAGING = 3,        // buffers that only carry data to the GPU
+    GPU_PROGRAMS = 4,       // linked shaders and queries, counted but their size is up to the driver
+    GPU_CATEGORY_COUNT = 5
+};
+
+// memory the GPU objects may take before the TextureManager starts to evict textures that haven't been drawn for a
+// while, see GpuResources::setBudget
+#define GPU_MEMORY_BUDGET_MB 512
+
+// a counted reference to a GL object of the GpuResources. Copies share the object, it is deleted together with the
+// last handle to it
+class GpuHandle
+{
+public:
+    GpuHandle() : slot(-1)
+    {
+    }
+
+    GpuHandle(const GpuHandle& other);
+    GpuHandle(GpuHandle&& other) : slot(other.slot)
+    {
+        other.slot = -1;
+    }
+    GpuHandle& operator=(GpuHandle other)
+    {
+        std::swap(slot, other.slot);
+        return *this;
+    }
+    ~GpuHandle();
+
+    // the GL name, 0 for an empty handle
+    unsigned int id() const;
+
+    bool valid() const
+    {
+        return slot >= 0;
+    }
+
+    // bytes the object takes on the GPU, set whenever its storage is (re)allocated
+    void setBytes(size_t bytes) const;
+
+private:
+    friend class GpuResources;
+
+    // takes over the reference the owner counted when it created the object
+    explicit GpuHandle(int slot) : slot(slot)
+    {
+    }
+
+    int slot;
+};
+
+// owns every buffer, vertex array, texture, framebuffer, renderbuffer, program and query: they are made through create and
+// deleted with their last handle, so a model, renderer or level that is destroyed takes its GL objects with it. The
+// bytes of every object are counted per category, against a budget that the TextureManager keeps by evicting the
+// textures that were used least recently.
+class GpuResources
+{
+public:
+    static GpuResources& instance()
+    {
+        static GpuResources resources;
+        return resources;
+    }
+
+    // a new GL object of type, its memory counted as category
+    GpuHandle create(GpuObjectType type, GpuCategory category)
+    {
+        Entry entry = { type, category, generate(type), 1, 0 };
+        int slot;
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+            entries[slot] = entry;
+        }
+        else
+        {
+            slot = static_cast<int>(entries.size());
+            entries.push_back(entry);
+        }
+        counts[category]++;
+        return GpuHandle(slot);
+    }
+
+    // binds buffer to target and fills it with size bytes of data, which may be null, counting their size
+    static void bufferData(GLenum target, const GpuHandle& buffer, size_t size, const void* data, GLenum usage)
+    {
+        glBindBuffer(target, buffer.id());
+        glBufferData(target, static_cast<GLsizeiptr>(size), data, usage);
+        buffer.setBytes(size);
+    }
+
+    // bytes of all objects of category
+    size_t memoryUsage(GpuCategory category) const
+    {
+        return bytes[category];
+    }
+
+    // bytes of all objects
+    size_t memoryUsage() const
+    {
+        size_t total = 0;
+        for (unsigned int i = 0; i < GPU_CATEGORY_COUNT; i++)
+            total += bytes[i];
+        return total;
+    }
+
+    unsigned int objectCount(GpuCategory category) const
+    {
+        return counts[category];
+    }
+
+    // memory the objects should fit into, 0 for no limit. Only streamed textures can be evicted to keep it
+    void setBudget(size_t budgetBytes)
+    {
+        budget = budgetBytes;
+    }
+
+    size_t memoryBudget() const
+    {
+        return budget;
+    }
+
+    bool overBudget() const
+    {
+        return budget > 0 && memoryUsage() > budget;
+    }
+
+    void report() const
+    {
+        static const char* names[GPU_CATEGORY_COUNT] = { "geometry", "textures", "render targets", "staging", "programs" };
+        std::cout << "GPU:: " << memoryUsage() / (1024.0 * 1024.0) << " MB of " << budget / (1024 * 1024) << " MB budget";
+        for (unsigned int i = 0; i < GPU_CATEGORY_COUNT; i++)
+            std::cout << (i > 0 ? ", " : ": ") << names[i] << " " << bytes[i] / (1024.0 * 1024.0) << " MB in " << counts[i];
+        std::cout << std::endl;
+    }
+
+    // deletes every object while the context is still there. Handles released afterwards do nothing
+    void releaseAll()
+    {
+        for (unsigned int i = 0; i < entries.size(); i++)
+        {
+            if (entries[i].references > 0)
+                destroy(entries[i]);
+        }
+        entries.clear();
+        freeSlots.clear();
+        std::fill(bytes, bytes + GPU_CATEGORY_COUNT, 0);
+        std::fill(counts, counts + GPU_CATEGORY_COUNT, 0);
+        released = true;
+    }
+
+private:
+    friend class GpuHandle;
+
+    struct Entry {
+        GpuObjectType type;
+        GpuCategory category;
+        unsigned int id;
+        unsigned int references;
+        size_t bytes;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<int> freeSlots;
+    size_t bytes[GPU_CATEGORY_COUNT] = {};
+    unsigned int counts[GPU_CATEGORY_COUNT] = {};
+    size_t budget = static_cast<size_t>(GPU_MEMORY_BUDGET_MB) * 1024 * 1024;
+    bool released = false;
+
+    GpuResources()
+    {
+    }
+
+    // nothing is deleted here, the context is gone by the time statics are destroyed. See releaseAll
+    ~GpuResources()
+    {
+    }
+
+    GpuResources(const GpuResources&) = delete;
+    GpuResources& operator=(const GpuResources&) = delete;
+
+    static unsigned int generate(GpuObjectType type)
+    {
+        unsigned int id = 0;
+        switch (type)
+        {
+        case GPU_BUFFER: glGenBuffers(1, &id); break;
+        case GPU_VERTEX_ARRAY: glGenVertexArrays(1, &id); break;
+        case GPU_TEXTURE: glGenTextures(1, &id); break;
+        case GPU_FRAMEBUFFER: glGenFramebuffers(1, &id); break;
+        case GPU_RENDERBUFFER: glGenRenderbuffers(1, &id); break;
+        case GPU_PROGRAM: id = glCreateProgram(); break;
+        case GPU_QUERY: glGenQueries(1, &id); break;
+        }
+        return id;
+    }
+
+    static void destroy(const Entry& entry)
+    {
+        switch (entry.type)
+        {
+        case GPU_BUFFER: glDeleteBuffers(1, &entry.id); break;
+        case GPU_VERTEX_ARRAY: glDeleteVertexArrays(1, &entry.id); break;
+        case GPU_TEXTURE: glDeleteTextures(1, &entry.id); break;
+        case GPU_FRAMEBUFFER: glDeleteFramebuffers(1, &entry.id); break;
+        case GPU_RENDERBUFFER: glDeleteRenderbuffers(1, &entry.id); break;
+        case GPU_PROGRAM: glDeleteProgram(entry.id); break;
+        case GPU_QUERY: glDeleteQueries(1, &entry.id); break;
+        }
+    }
+
+    void release(int slot)
+    {
+        if (released || slot < 0 || slot >= static_cast<int>(entries.size()))
+            return;
+        Entry& entry = entries[slot];
+        if (entry.references == 0 || --entry.references > 0)
+            return;
+        destroy(entry);
+        bytes[entry.category] -= entry.bytes;
+        counts[entry.category]--;
+        entry.bytes = 0;
+        freeSlots.push_back(slot);
+    }
+};
+
+inline GpuHandle::GpuHandle(const GpuHandle& other) : slot(other.slot)
+{
+    if (slot >= 0 && !GpuResources::instance().released)
+        GpuResources::instance().entries[slot].references++;
+}
+
+inline GpuHandle::~GpuHandle()
+{
+    if (slot >= 0)
+        GpuResources::instance().release(slot);
+}
+
+inline unsigned int GpuHandle::id() const
+{
+    GpuResources& resources = GpuResources::instance();
+    if (slot < 0 || resources.released)
+        return 0;
+    return resources.entries[slot].id;
+}
+
+inline void GpuHandle::setBytes(size_t bytes) const
+{
+    GpuResources& resources = GpuResources::instance();
+    if (slot < 0 || resources.released)
+        return;
+    GpuResources::Entry& entry = resources.entries[slot];
+    resources.bytes[entry.category] += bytes - entry.bytes;
+    entry.bytes = bytes;
+}
+#endif
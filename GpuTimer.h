@@ -0,0 +1,72 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include "GpuResources.h"
+
+// measures how long the GPU spends on a section of the frame with GL_TIME_ELAPSED queries. A result is only read
+// QUERY_FRAMES frames after it was issued, by then it is available and reading it never stalls the CPU.
+// Only one timer can be running at a time, sections can't be nested.
+class GpuTimer
+{
+public:
+    GpuTimer()
+    {
+        for (unsigned int i = 0; i < QUERY_FRAMES; i++)
+        {
+            queries[i] = GpuResources::instance().create(GPU_QUERY, GPU_PROGRAMS);
+            issued[i] = false;
+        }
+    }
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void begin()
+    {
+        unsigned int query = frame % QUERY_FRAMES;
+        if (issued[query])
+        {
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(queries[query].id(), GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(queries[query].id(), GL_QUERY_RESULT, &nanoseconds);
+                // exponential moving average, a single frame's number jumps around too much to read
+                float ms = nanoseconds / 1000000.0f;
+                average = average < 0.0f ? ms : average * 0.9f + ms * 0.1f;
+            }
+        }
+        glBeginQuery(GL_TIME_ELAPSED, queries[query].id());
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        issued[frame % QUERY_FRAMES] = true;
+        frame++;
+    }
+
+    // averaged over the last frames, negative until the first result is in
+    float milliseconds() const
+    {
+        return average;
+    }
+
+    // forget the average, e.g. when what is measured changes
+    void reset()
+    {
+        average = -1.0f;
+    }
+
+private:
+    static const unsigned int QUERY_FRAMES = 4;
+
+    GpuHandle queries[QUERY_FRAMES];
+    bool issued[QUERY_FRAMES];
+    unsigned int frame = 0;
+    float average = -1.0f;
+};
+#endif
@@ -0,0 +1,230 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include <glad/glad.h>
+
+#include <glm/glm/glm.hpp>
+#include <glm/glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+#include "GpuResources.h"
+#include "Material.h"
+#include "Model.h"
+#include "RenderQueue.h"
+
+#include <vector>
+#include <set>
+#include <iostream>
+#include <cmath>
+
+// views of the model in the atlas, evenly spread around it and from the horizon up to 60 degrees
+#define IMPOSTOR_AZIMUTHS 16
+#define IMPOSTOR_ELEVATIONS 3
+#define IMPOSTOR_TILE_SIZE 128
+// the atlas stays bound on the units after the lightmap
+#define IMPOSTOR_ALBEDO_UNIT (LIGHTMAP_TEXTURE_UNIT + 1)
+#define IMPOSTOR_NORMAL_UNIT (LIGHTMAP_TEXTURE_UNIT + 2)
+
+// how much of an instance with its origin at origin is drawn as impostor: 0 up to fadeRange.x, 1 from fadeRange.y on.
+// A range of 0 switches impostors off. Same as light_object.vs and cull.cs
+inline float impostorWeight(const glm::vec3& origin, const glm::vec3& viewPos, const glm::vec2& fadeRange)
+{
+    if (fadeRange.y <= 0.0f)
+        return 0.0f;
+    return glm::clamp((glm::length(origin - viewPos) - fadeRange.x) / glm::max(fadeRange.y - fadeRange.x, 1e-4f), 0.0f, 1.0f);
+}
+
+// direction from the model towards the camera of a captured view, same as light_object.vs
+inline glm::vec3 impostorDirection(unsigned int azimuth, unsigned int elevation)
+{
+    float a = azimuth * glm::two_pi<float>() / IMPOSTOR_AZIMUTHS;
+    float e = elevation * glm::half_pi<float>() / IMPOSTOR_ELEVATIONS;
+    return glm::vec3(sin(a) * cos(e), sin(e), cos(a) * cos(e));
+}
+
+// camera facing quads that stand in for far away instances of a model. The model is rendered once, from
+// IMPOSTOR_AZIMUTHS x IMPOSTOR_ELEVATIONS directions around its upper half, into an albedo and a normal atlas. A quad
+// shows the view closest to the camera and is lit like the model itself, so only the silhouette gets coarser. All
+// impostors of a frame are one instanced draw with the IMPOSTOR variant of light_object. Instances may only be
+// translated, the views are captured in model space.
+//
+// Between the two distances of the fade range an instance is drawn both ways, the model with the CROSSFADE variant.
+// Both dither with the same pattern and cover complementary pixels, so the transition needs no sorting or blending.
+class ImpostorAtlas
+{
+public:
+    // captureShader is the GBUFFER variant of light_object (without LIGHTMAP), which writes albedo and normal
+    ImpostorAtlas(Model& model, Shader& captureShader) : bounds(model.bounds)
+    {
+        capture(model, captureShader);
+
+        // one quad, every instance only adds its origin
+        float corners[] = { -1.0f, -1.0f, 0.0f,  1.0f, -1.0f, 0.0f,  -1.0f, 1.0f, 0.0f,  1.0f, 1.0f, 0.0f };
+        GpuResources& resources = GpuResources::instance();
+        VAO = resources.create(GPU_VERTEX_ARRAY, GPU_GEOMETRY);
+        quadVBO = resources.create(GPU_BUFFER, GPU_GEOMETRY);
+        instanceVBO = resources.create(GPU_BUFFER, GPU_GEOMETRY);
+        glBindVertexArray(VAO.id());
+        GpuResources::bufferData(GL_ARRAY_BUFFER, quadVBO, sizeof(corners), corners, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO.id());
+        glEnableVertexAttribArray(9);
+        glVertexAttribPointer(9, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glVertexAttribDivisor(9, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    ImpostorAtlas(const ImpostorAtlas&) = delete;
+    ImpostorAtlas& operator=(const ImpostorAtlas&) = delete;
+
+    // the distance from which one texel of the atlas covers at most one pixel, see lodPixelsPerUnit. A good start
+    // for the fade range
+    float fullResolutionDistance(float pixelsPerUnit) const
+    {
+        return pixelsPerUnit * 2.0f * bounds.w / IMPOSTOR_TILE_SIZE;
+    }
+
+    // forgets the instances of the last frame
+    void begin()
+    {
+        origins.clear();
+    }
+
+    // draws an impostor for the instance at origin this frame, its weight decides how much of it shows
+    void add(const glm::vec3& origin)
+    {
+        origins.push_back(origin);
+    }
+
+    unsigned int size() const
+    {
+        return static_cast<unsigned int>(origins.size());
+    }
+
+    // draws every impostor added since begin with an IMPOSTOR variant of light_object. Per frame uniforms, including
+    // impostorFade, have to be set on the shader beforehand
+    void draw(GLStateCache& state, Shader& shader)
+    {
+        if (origins.empty())
+            return;
+        // orphaned every frame, the driver hands out fresh memory instead of waiting for last frame's draw
+        GpuResources::bufferData(GL_ARRAY_BUFFER, instanceVBO, origins.size() * sizeof(glm::vec3), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, origins.size() * sizeof(glm::vec3), origins.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        state.invalidate();
+        state.useProgram(shader.ID);
+        // the atlas never changes, its uniforms only have to reach every variant once
+        if (setUp.insert(shader.ID).second)
+        {
+            shader.setInt("impostorAlbedo", IMPOSTOR_ALBEDO_UNIT);
+            shader.setInt("impostorNormal", IMPOSTOR_NORMAL_UNIT);
+            shader.setVec4("impostorBounds", bounds);
+        }
+        state.bindTexture(IMPOSTOR_ALBEDO_UNIT, GL_TEXTURE_2D, albedoTexture.id());
+        state.bindTexture(IMPOSTOR_NORMAL_UNIT, GL_TEXTURE_2D, normalTexture.id());
+        state.bindVertexArray(VAO.id());
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(origins.size()));
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        state.invalidate();
+    }
+
+    const glm::vec4& getBounds() const { return bounds; }
+    unsigned int getAlbedoTexture() const { return albedoTexture.id(); }
+    unsigned int getNormalTexture() const { return normalTexture.id(); }
+
+private:
+    glm::vec4 bounds; // bounding sphere of the model, the quads are its diameter wide
+    GpuHandle albedoTexture, normalTexture;
+    GpuHandle VAO, quadVBO, instanceVBO;
+    std::vector<glm::vec3> origins;
+    std::set<unsigned int> setUp; // programs that got the atlas uniforms
+
+    // renders every view orthographically into its tile. Empty texels stay 0 in all channels, so after filtering
+    // color / alpha is the average of the covered texels only
+    void capture(Model& model, Shader& captureShader)
+    {
+        const int width = IMPOSTOR_AZIMUTHS * IMPOSTOR_TILE_SIZE;
+        const int height = IMPOSTOR_ELEVATIONS * IMPOSTOR_TILE_SIZE;
+        albedoTexture = createTexture(width, height);
+        normalTexture = createTexture(width, height);
+
+        // both only live through the capture, they are deleted with their handles at the end
+        GpuHandle framebuffer = GpuResources::instance().create(GPU_FRAMEBUFFER, GPU_RENDER_TARGETS);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id());
+        GpuHandle depthBuffer = GpuResources::instance().create(GPU_RENDERBUFFER, GPU_RENDER_TARGETS);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer.id());
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        depthBuffer.setBytes(static_cast<size_t>(width) * height * 4);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTexture.id(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture.id(), 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer.id());
+        // the GBUFFER variant writes light, albedo and normal, the light is not needed
+        GLenum attachments[] = { GL_NONE, GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(3, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::IMPOSTOR:: capture framebuffer is not complete" << std::endl;
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        const float empty[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 1, empty);
+        glClearBufferfv(GL_COLOR, 2, empty);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        captureShader.use();
+        captureShader.setMat4("model", glm::mat4(1.0f));
+        captureShader.setVec4("lightmapRect", glm::vec4(0.0f));
+        glm::vec3 center(bounds);
+        float radius = glm::max(bounds.w, 1e-4f);
+        glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 4.0f * radius);
+        captureShader.setMat4("projection", projection);
+        for (unsigned int elevation = 0; elevation < IMPOSTOR_ELEVATIONS; elevation++)
+        {
+            for (unsigned int azimuth = 0; azimuth < IMPOSTOR_AZIMUTHS; azimuth++)
+            {
+                glm::vec3 direction = impostorDirection(azimuth, elevation);
+                glm::mat4 view = glm::lookAt(center + direction * 2.0f * radius, center, glm::vec3(0.0f, 1.0f, 0.0f));
+                captureShader.setMat4("view", view);
+                glViewport(azimuth * IMPOSTOR_TILE_SIZE, elevation * IMPOSTOR_TILE_SIZE, IMPOSTOR_TILE_SIZE, IMPOSTOR_TILE_SIZE);
+                model.Draw();
+            }
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        if (blend)
+            glEnable(GL_BLEND);
+
+        // tiles are a power of two and start on multiples of their size, so mip levels never mix two views
+        glBindTexture(GL_TEXTURE_2D, albedoTexture.id());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, normalTexture.id());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    static GpuHandle createTexture(int width, int height)
+    {
+        GpuHandle texture = GpuResources::instance().create(GPU_TEXTURE, GPU_RENDER_TARGETS);
+        glBindTexture(GL_TEXTURE_2D, texture.id());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // down to one texel per view
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<int>(std::log2(static_cast<float>(IMPOSTOR_TILE_SIZE))));
+        glBindTexture(GL_TEXTURE_2D, 0);
+        // with the mip chain
+        texture.setBytes(static_cast<size_t>(width) * height * 4 * 4 / 3);
+        return texture;
+    }
+};
+#endif
@@ -0,0 +1,117 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <memory>
+
+JobSystem::JobSystem(unsigned int threadCount) : m_stopping{ false }
+{
+	if (threadCount == 0) {
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+	for (unsigned int i = 0; i < threadCount; i++) {
+		m_workers.push_back(std::thread(&JobSystem::workerLoop, this));
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wakeUp.notify_all();
+	for (std::thread& worker : m_workers) {
+		worker.join();
+	}
+}
+
+JobSystem& JobSystem::instance()
+{
+	static JobSystem jobSystem;
+	return jobSystem;
+}
+
+unsigned int JobSystem::getThreadCount() const
+{
+	return static_cast<unsigned int>(m_workers.size());
+}
+
+void JobSystem::workerLoop()
+{
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeUp.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+			if (m_jobs.empty()) { //only reached when stopping
+				return;
+			}
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+		job();
+	}
+}
+
+void JobSystem::submit(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(std::move(job));
+	}
+	m_wakeUp.notify_one();
+}
+
+void JobSystem::parallelFor(unsigned int count, const std::function<void(unsigned int)>& job, unsigned int grainSize)
+{
+	if (count == 0) {
+		return;
+	}
+	grainSize = std::max(grainSize, 1u);
+
+	//every participant grabs the next chunk until none are left. The helpers may only start once the caller has
+	//done everything, when it runs inside a job itself and the other workers are busy, so the caller only waits for
+	//the helpers that actually started and the shared state outlives the others
+	struct Progress
+	{
+		std::atomic<unsigned int> next{ 0 };
+		unsigned int working = 0;
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+	std::shared_ptr<Progress> progress = std::make_shared<Progress>();
+	const std::function<void(unsigned int)>* work = &job;
+	auto claim = [progress, work, count, grainSize]() {
+		unsigned int begin;
+		while ((begin = progress->next.fetch_add(grainSize)) < count) {
+			unsigned int end = std::min(begin + grainSize, count);
+			for (unsigned int i = begin; i < end; i++) {
+				(*work)(i);
+			}
+		}
+	};
+
+	unsigned int helpers = std::min(getThreadCount(), (count + grainSize - 1) / grainSize - 1);
+	for (unsigned int i = 0; i < helpers; i++) {
+		submit([progress, claim, count]() {
+			{
+				std::lock_guard<std::mutex> lock(progress->mutex);
+				if (progress->next >= count) {
+					return;
+				}
+				progress->working++;
+			}
+			claim();
+			std::lock_guard<std::mutex> lock(progress->mutex);
+			if (--progress->working == 0) {
+				progress->done.notify_one();
+			}
+		});
+	}
+	claim();
+
+	//the helpers that got a chunk reference job, wait until all of them are finished
+	std::unique_lock<std::mutex> lock(progress->mutex);
+	progress->done.wait(lock, [&] { return progress->working == 0; });
+}
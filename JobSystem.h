@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a fixed pool of worker threads, one per hardware thread minus the caller.
+// parallelFor blocks until every index has been processed and the calling thread helps out meanwhile.
+class JobSystem
+{
+private:
+	std::vector<std::thread> m_workers;
+	std::deque<std::function<void()>> m_jobs;
+	std::mutex m_mutex;
+	std::condition_variable m_wakeUp;
+	bool m_stopping;
+
+	void workerLoop();
+
+public:
+	JobSystem(unsigned int threadCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// the pool shared by the whole program
+	static JobSystem& instance();
+
+	unsigned int getThreadCount() const;
+
+	// runs job asynchronously on one of the workers
+	void submit(std::function<void()> job);
+
+	// calls job(i) for every i in [0, count), spread over the workers in chunks of grainSize. May be called from inside
+	// a job, the caller does the work alone when no worker is free
+	void parallelFor(unsigned int count, const std::function<void(unsigned int)>& job, unsigned int grainSize = 1);
+};
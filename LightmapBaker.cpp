@@ -0,0 +1,738 @@
+#include "LightmapBaker.h"
+#include "JobSystem.h"
+
+#include <glad/glad.h>
+#include <glm/glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+//bump when the baked result changes for the same input
+const glm::uint LIGHTMAP_CACHE_VERSION = 2;
+const char LIGHTMAP_CACHE_MAGIC[4] = { 'L', 'M', 'A', 'P' };
+//rows of a tile baked by one job, keeps the big floor tile from ending up on a single thread
+const unsigned int LIGHTMAP_ROWS_PER_JOB = 32;
+
+//FNV-1a
+static unsigned long long hashBytes(unsigned long long hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static float cross2(const glm::vec2& a, const glm::vec2& b)
+{
+	return a.x * b.y - a.y * b.x;
+}
+
+LightmapBaker::LightmapBaker(const StaticLights& lights) : m_lights{ lights }, m_width{ 0 }, m_height{ 0 }
+{
+}
+
+LightmapBaker::~LightmapBaker()
+{
+}
+
+LightmapCharts LightmapBaker::unwrap(std::vector<Mesh>& meshes, unsigned int tileSize, bool boxFaces)
+{
+	std::vector<Mesh*> pointers;
+	for (Mesh& mesh : meshes) {
+		pointers.push_back(&mesh);
+	}
+	return unwrap(pointers, tileSize, boxFaces);
+}
+
+LightmapCharts LightmapBaker::unwrap(Mesh& mesh, unsigned int tileSize, bool boxFaces)
+{
+	return unwrap(std::vector<Mesh*>{ &mesh }, tileSize, boxFaces);
+}
+
+static glm::vec3 normalOf(const Vertex& a, const Vertex& b, const Vertex& c)
+{
+	glm::vec3 normal = glm::cross(b.Position - a.Position, c.Position - a.Position);
+	if (glm::length(normal) < 1e-12f) {
+		normal = a.Normal + b.Normal + c.Normal;
+	}
+	return normal;
+}
+
+//face of the bounding box a normal points to: the axis it points along most and the side it faces
+static int faceOf(const glm::vec3& normal)
+{
+	glm::vec3 magnitude = glm::abs(normal);
+	int axis = magnitude.x >= magnitude.y && magnitude.x >= magnitude.z ? 0 : (magnitude.y >= magnitude.z ? 1 : 2);
+	return axis * 2 + (normal[axis] < 0.0f ? 1 : 0);
+}
+
+//the axes the lightmap coords of a face of the bounding box run along
+static void faceAxes(int face, int& uAxis, int& vAxis)
+{
+	int axis = face / 2;
+	uAxis = axis == 0 ? 2 : 0;
+	vAxis = axis == 1 ? 2 : 1;
+}
+
+bool LightmapCharts::hasFace(int face) const
+{
+	return blockOfFace[face] >= 0;
+}
+
+glm::vec2 LightmapCharts::coords(const glm::vec3& position, int face) const
+{
+	int uAxis, vAxis;
+	faceAxes(face, uAxis, vAxis);
+	glm::vec2 local((position[uAxis] - minimum[uAxis]) / extent[uAxis], (position[vAxis] - minimum[vAxis]) / extent[vAxis]);
+	const glm::uvec4& block = blocks[blockOfFace[face]];
+	glm::vec2 texel = glm::vec2(block.x, block.y) + 0.5f + glm::clamp(local, 0.0f, 1.0f) * (glm::vec2(block.z, block.w) - 1.0f);
+	return texel / static_cast<float>(tileSize);
+}
+
+//a connected planar region of the triangles of one mesh, projected onto its plane
+struct LightmapChart
+{
+	unsigned int mesh;
+	std::vector<unsigned int> triangles; //first index of every triangle
+	glm::vec3 u;
+	glm::vec3 v;
+	glm::vec2 minimum;
+	glm::vec2 extent; //in model units
+};
+
+//flood fills the triangles of a mesh across shared edges as long as their normals stay close to the first one
+static void findCharts(const Mesh& mesh, unsigned int meshIndex, std::vector<LightmapChart>& charts)
+{
+	const float planarity = 0.999f; //cosine of the largest angle between the normals in a chart
+	const vector<Vertex>& vertices = mesh.vertices;
+	const vector<unsigned int>& indices = mesh.indices;
+	unsigned int triangleCount = static_cast<unsigned int>(indices.size() / 3);
+
+	//corners are welded by position, the vertices are split wherever the normal or the uv changes
+	std::map<std::tuple<float, float, float>, unsigned int> positionIds;
+	std::vector<unsigned int> corners(triangleCount * 3);
+	for (unsigned int i = 0; i < corners.size(); i++) {
+		const glm::vec3& position = vertices[indices[i]].Position;
+		unsigned int id = static_cast<unsigned int>(positionIds.size());
+		corners[i] = positionIds.emplace(std::make_tuple(position.x, position.y, position.z), id).first->second;
+	}
+	auto edgeKey = [&corners](unsigned int triangle, unsigned int edge) {
+		unsigned long long a = corners[triangle * 3 + edge];
+		unsigned long long b = corners[triangle * 3 + (edge + 1) % 3];
+		return std::min(a, b) << 32 | std::max(a, b);
+	};
+	std::unordered_map<unsigned long long, std::vector<unsigned int>> edgeTriangles;
+	std::vector<glm::vec3> normals(triangleCount);
+	for (unsigned int t = 0; t < triangleCount; t++) {
+		for (unsigned int edge = 0; edge < 3; edge++) {
+			edgeTriangles[edgeKey(t, edge)].push_back(t);
+		}
+		glm::vec3 normal = normalOf(vertices[indices[t * 3]], vertices[indices[t * 3 + 1]], vertices[indices[t * 3 + 2]]);
+		normals[t] = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+	}
+
+	std::vector<bool> assigned(triangleCount, false);
+	for (unsigned int seed = 0; seed < triangleCount; seed++) {
+		if (assigned[seed]) {
+			continue;
+		}
+		LightmapChart chart;
+		chart.mesh = meshIndex;
+		glm::vec3 areaNormal(0.0f);
+		std::vector<unsigned int> stack{ seed };
+		assigned[seed] = true;
+		while (!stack.empty()) {
+			unsigned int t = stack.back();
+			stack.pop_back();
+			chart.triangles.push_back(t * 3);
+			const glm::vec3& a = vertices[indices[t * 3]].Position;
+			areaNormal += glm::cross(vertices[indices[t * 3 + 1]].Position - a, vertices[indices[t * 3 + 2]].Position - a);
+			for (unsigned int edge = 0; edge < 3; edge++) {
+				for (unsigned int neighbour : edgeTriangles[edgeKey(t, edge)]) {
+					if (!assigned[neighbour] && glm::dot(normals[neighbour], normals[seed]) > planarity) {
+						assigned[neighbour] = true;
+						stack.push_back(neighbour);
+					}
+				}
+			}
+		}
+
+		//the plane axes follow the model axes, like the faces of the bounding box
+		glm::vec3 normal = glm::length(areaNormal) > 1e-12f ? glm::normalize(areaNormal) : normals[seed];
+		int uAxis, vAxis;
+		faceAxes(faceOf(normal), uAxis, vAxis);
+		glm::vec3 uHint(0.0f), vHint(0.0f);
+		uHint[uAxis] = 1.0f;
+		vHint[vAxis] = 1.0f;
+		chart.u = glm::normalize(uHint - normal * glm::dot(normal, uHint));
+		chart.v = glm::normalize(glm::cross(normal, chart.u));
+		if (glm::dot(chart.v, vHint) < 0.0f) {
+			chart.v = -chart.v;
+		}
+
+		glm::vec2 lower(FLT_MAX), upper(-FLT_MAX);
+		for (unsigned int first : chart.triangles) {
+			for (unsigned int corner = first; corner < first + 3; corner++) {
+				const glm::vec3& position = vertices[indices[corner]].Position;
+				glm::vec2 projected(glm::dot(position, chart.u), glm::dot(position, chart.v));
+				lower = glm::min(lower, projected);
+				upper = glm::max(upper, projected);
+			}
+		}
+		chart.minimum = lower;
+		chart.extent = upper - lower;
+		charts.push_back(chart);
+	}
+}
+
+//texels a chart takes at about a density: its extent spans the centers of the outer texels, so bilinear filtering
+//inside the chart never reads past its block. A chart smaller than a texel shrinks into a single one
+static glm::uvec2 blockSize(const glm::vec2& extent, float texelsPerUnit)
+{
+	return glm::uvec2(1) + glm::uvec2(glm::round(extent * texelsPerUnit));
+}
+
+//shelves of blocks, tallest first. False if they don't fit into the tile
+static bool packBlocks(const std::vector<glm::uvec2>& sizes, unsigned int tileSize, std::vector<glm::uvec4>& blocks)
+{
+	std::vector<unsigned int> order(sizes.size());
+	for (unsigned int i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&sizes](unsigned int a, unsigned int b) {
+		return sizes[a].y > sizes[b].y;
+	});
+
+	blocks.assign(sizes.size(), glm::uvec4(0));
+	unsigned int x = 0, y = 0, shelfHeight = 0;
+	for (unsigned int i : order) {
+		if (sizes[i].x > tileSize) {
+			return false;
+		}
+		if (x + sizes[i].x > tileSize) {
+			y += shelfHeight;
+			x = 0;
+			shelfHeight = 0;
+		}
+		if (y + sizes[i].y > tileSize) {
+			return false;
+		}
+		blocks[i] = glm::uvec4(x, y, sizes[i].x, sizes[i].y);
+		x += sizes[i].x;
+		shelfHeight = std::max(shelfHeight, sizes[i].y);
+	}
+	return true;
+}
+
+LightmapCharts LightmapBaker::unwrap(const std::vector<Mesh*>& meshes, unsigned int tileSize, bool boxFaces)
+{
+	LightmapCharts layout;
+	layout.tileSize = tileSize;
+	layout.minimum = glm::vec3(FLT_MAX);
+	glm::vec3 maximum(-FLT_MAX);
+	bool used[6] = { false, false, false, false, false, false };
+	std::vector<LightmapChart> charts;
+	for (unsigned int m = 0; m < meshes.size(); m++) {
+		const Mesh& mesh = *meshes[m];
+		for (const Vertex& vertex : mesh.vertices) {
+			layout.minimum = glm::min(layout.minimum, vertex.Position);
+			maximum = glm::max(maximum, vertex.Position);
+		}
+		for (unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3) {
+			used[faceOf(normalOf(mesh.vertices[mesh.indices[i]], mesh.vertices[mesh.indices[i + 1]], mesh.vertices[mesh.indices[i + 2]]))] = true;
+		}
+		findCharts(mesh, m, charts);
+	}
+	layout.extent = glm::max(maximum - layout.minimum, glm::vec3(1e-6f));
+
+	//the extents of all blocks in model units, the charts first and then the box faces at half the density
+	std::vector<glm::vec2> extents;
+	std::vector<float> densities;
+	for (const LightmapChart& chart : charts) {
+		extents.push_back(chart.extent);
+		densities.push_back(1.0f);
+	}
+	for (int face = 0; face < 6; face++) {
+		layout.blockOfFace[face] = -1;
+		if (boxFaces && used[face]) {
+			int uAxis, vAxis;
+			faceAxes(face, uAxis, vAxis);
+			layout.blockOfFace[face] = static_cast<int>(extents.size());
+			extents.push_back(glm::vec2(layout.extent[uAxis], layout.extent[vAxis]));
+			densities.push_back(0.5f);
+		}
+	}
+	if (extents.empty()) {
+		return layout;
+	}
+
+	//the highest density that still packs every block into the tile
+	std::vector<glm::uvec2> sizes(extents.size());
+	auto fits = [&](float texelsPerUnit) {
+		for (unsigned int i = 0; i < extents.size(); i++) {
+			sizes[i] = blockSize(extents[i], texelsPerUnit * densities[i]);
+		}
+		return packBlocks(sizes, tileSize, layout.blocks);
+	};
+	if (!fits(0.0f)) {
+		std::cout << "ERROR::LIGHTMAP:: " << extents.size() << " charts don't fit into a " << tileSize << "x" << tileSize << " tile" << std::endl;
+		layout.blocks.clear();
+		std::fill(layout.blockOfFace, layout.blockOfFace + 6, -1);
+		return layout;
+	}
+	float largest = 0.0f;
+	for (unsigned int i = 0; i < extents.size(); i++) {
+		largest = std::max(largest, std::max(extents[i].x, extents[i].y) * densities[i]);
+	}
+	float low = 0.0f;
+	float high = largest > 0.0f ? (tileSize - 1) / largest : 1.0f; //any higher and the largest block is wider than the tile
+	for (int step = 0; step < 24; step++) {
+		float middle = 0.5f * (low + high);
+		(fits(middle) ? low : high) = middle;
+	}
+	fits(low);
+
+	for (unsigned int m = 0; m < meshes.size(); m++) {
+		const vector<Vertex>& vertices = meshes[m]->vertices;
+		const vector<unsigned int>& indices = meshes[m]->indices;
+		vector<Vertex> newVertices;
+		vector<unsigned int> newIndices;
+		std::unordered_map<unsigned long long, unsigned int> splitVertices; //old index and chart -> new index
+		for (unsigned int c = 0; c < charts.size(); c++) {
+			const LightmapChart& chart = charts[c];
+			if (chart.mesh != m) {
+				continue;
+			}
+			//from the center of the first texel of the block to the center of the last one
+			const glm::uvec4& block = layout.blocks[c];
+			glm::vec2 span = glm::vec2(block.z, block.w) - 1.0f;
+			glm::vec2 scale(chart.extent.x > 0.0f ? span.x / chart.extent.x : 0.0f, chart.extent.y > 0.0f ? span.y / chart.extent.y : 0.0f);
+			for (unsigned int first : chart.triangles) {
+				for (unsigned int corner = first; corner < first + 3; corner++) {
+					unsigned long long key = static_cast<unsigned long long>(indices[corner]) << 32 | c;
+					auto it = splitVertices.find(key);
+					if (it != splitVertices.end()) {
+						newIndices.push_back(it->second);
+						continue;
+					}
+
+					Vertex vertex = vertices[indices[corner]];
+					glm::vec2 projected(glm::dot(vertex.Position, chart.u), glm::dot(vertex.Position, chart.v));
+					glm::vec2 texel = glm::vec2(block.x, block.y) + 0.5f + (projected - chart.minimum) * scale;
+					vertex.LightmapCoords = texel / static_cast<float>(tileSize);
+
+					unsigned int index = static_cast<unsigned int>(newVertices.size());
+					newVertices.push_back(vertex);
+					newIndices.push_back(index);
+					splitVertices[key] = index;
+				}
+			}
+		}
+		meshes[m]->setGeometry(newVertices, newIndices);
+	}
+	return layout;
+}
+
+unsigned int LightmapBaker::findGroup(const std::vector<const Mesh*>& meshes, const LightmapCharts& charts)
+{
+	for (unsigned int i = 0; i < m_groups.size(); i++) {
+		if (m_groups[i].meshes == meshes && m_groups[i].tileSize == charts.tileSize) {
+			return i;
+		}
+	}
+	SurfaceGroup group;
+	group.meshes = meshes;
+	group.tileSize = charts.tileSize;
+	group.charts = charts;
+	m_groups.push_back(group);
+	return static_cast<unsigned int>(m_groups.size() - 1);
+}
+
+unsigned int LightmapBaker::add(const std::vector<Mesh>& meshes, const std::vector<glm::mat4>& transforms, const LightmapCharts& charts)
+{
+	std::vector<const Mesh*> pointers;
+	for (const Mesh& mesh : meshes) {
+		pointers.push_back(&mesh);
+	}
+	return addSurfaces(pointers, transforms, charts);
+}
+
+unsigned int LightmapBaker::add(const Mesh& mesh, const std::vector<glm::mat4>& transforms, const LightmapCharts& charts)
+{
+	return addSurfaces(std::vector<const Mesh*>{ &mesh }, transforms, charts);
+}
+
+unsigned int LightmapBaker::addSurfaces(const std::vector<const Mesh*>& meshes, const std::vector<glm::mat4>& transforms, const LightmapCharts& charts)
+{
+	unsigned int group = findGroup(meshes, charts);
+	unsigned int first = static_cast<unsigned int>(m_surfaces.size());
+	for (const glm::mat4& transform : transforms) {
+		Surface surface;
+		surface.group = group;
+		surface.transform = transform;
+		surface.origin = glm::uvec2(0);
+		m_surfaces.push_back(surface);
+	}
+	return first;
+}
+
+void LightmapBaker::rasterizeGroup(SurfaceGroup& group) const
+{
+	unsigned int size = group.tileSize;
+	const LightmapCharts& charts = group.charts;
+	TileTexel empty = { glm::vec3(0.0f), glm::vec3(0.0f), false };
+	group.texels.assign(size * size, empty);
+	std::vector<int> blockOfTexel(size * size, -1);
+	for (unsigned int b = 0; b < charts.blocks.size(); b++) {
+		const glm::uvec4& block = charts.blocks[b];
+		for (unsigned int y = block.y; y < block.y + block.w; y++) {
+			std::fill_n(blockOfTexel.begin() + y * size + block.x, block.z, static_cast<int>(b));
+		}
+	}
+
+	for (const Mesh* mesh : group.meshes) {
+		for (unsigned int i = 0; i + 2 < mesh->indices.size(); i += 3) {
+			const Vertex& a = mesh->vertices[mesh->indices[i]];
+			const Vertex& b = mesh->vertices[mesh->indices[i + 1]];
+			const Vertex& c = mesh->vertices[mesh->indices[i + 2]];
+			glm::vec2 pa = a.LightmapCoords * static_cast<float>(size);
+			glm::vec2 pb = b.LightmapCoords * static_cast<float>(size);
+			glm::vec2 pc = c.LightmapCoords * static_cast<float>(size);
+			float area = cross2(pb - pa, pc - pa);
+			bool hit = false;
+			if (std::abs(area) >= 1e-12f) {
+				glm::vec2 lower = glm::min(pa, glm::min(pb, pc));
+				glm::vec2 upper = glm::max(pa, glm::max(pb, pc));
+				int minX = std::max(0, static_cast<int>(std::floor(lower.x)));
+				int minY = std::max(0, static_cast<int>(std::floor(lower.y)));
+				int maxX = std::min(static_cast<int>(size) - 1, static_cast<int>(std::ceil(upper.x)));
+				int maxY = std::min(static_cast<int>(size) - 1, static_cast<int>(std::ceil(upper.y)));
+				for (int y = minY; y <= maxY; y++) {
+					for (int x = minX; x <= maxX; x++) {
+						glm::vec2 p(x + 0.5f, y + 0.5f);
+						float wa = cross2(pc - pb, p - pb) / area;
+						float wb = cross2(pa - pc, p - pc) / area;
+						float wc = 1.0f - wa - wb;
+						if (wa < -1e-5f || wb < -1e-5f || wc < -1e-5f) {
+							continue;
+						}
+						TileTexel& texel = group.texels[y * size + x];
+						texel.position = a.Position * wa + b.Position * wb + c.Position * wc;
+						texel.normal = a.Normal * wa + b.Normal * wb + c.Normal * wc;
+						texel.covered = true;
+						hit = true;
+					}
+				}
+			}
+			//a triangle between the texel centers, e.g. of a chart smaller than a texel, lights the texel it lies in
+			if (!hit) {
+				glm::ivec2 p = glm::clamp(glm::ivec2(glm::floor((pa + pb + pc) / 3.0f)), glm::ivec2(0), glm::ivec2(size - 1));
+				TileTexel& texel = group.texels[p.y * size + p.x];
+				if (!texel.covered) {
+					texel.position = (a.Position + b.Position + c.Position) / 3.0f;
+					texel.normal = a.Normal + b.Normal + c.Normal;
+					texel.covered = true;
+				}
+			}
+		}
+	}
+
+	//the faces of the bounding box
+	for (int face = 0; face < 6; face++) {
+		if (!charts.hasFace(face)) {
+			continue;
+		}
+		int axis = face / 2;
+		int uAxis, vAxis;
+		faceAxes(face, uAxis, vAxis);
+		const glm::uvec4& block = charts.blocks[charts.blockOfFace[face]];
+		glm::vec3 normal(0.0f);
+		normal[axis] = face % 2 == 0 ? 1.0f : -1.0f;
+		for (unsigned int y = block.y; y < block.y + block.w; y++) {
+			for (unsigned int x = block.x; x < block.x + block.z; x++) {
+				TileTexel& texel = group.texels[y * size + x];
+				texel.position[axis] = charts.minimum[axis] + (face % 2 == 0 ? charts.extent[axis] : 0.0f);
+				texel.position[uAxis] = charts.minimum[uAxis] + charts.extent[uAxis] * (block.z > 1 ? (x - block.x) / (block.z - 1.0f) : 0.5f);
+				texel.position[vAxis] = charts.minimum[vAxis] + charts.extent[vAxis] * (block.w > 1 ? (y - block.y) / (block.w - 1.0f) : 0.5f);
+				texel.normal = normal;
+				texel.covered = true;
+			}
+		}
+	}
+
+	//the texels along the chart borders that no triangle covers are still read by bilinear filtering, they get the
+	//average of their covered neighbours in the same block until the whole block is covered
+	bool grown = true;
+	while (grown) {
+		grown = false;
+		std::vector<TileTexel> source = group.texels;
+		for (int y = 0; y < static_cast<int>(size); y++) {
+			for (int x = 0; x < static_cast<int>(size); x++) {
+				int block = blockOfTexel[y * size + x];
+				if (source[y * size + x].covered || block < 0) {
+					continue;
+				}
+				TileTexel sum = empty;
+				int count = 0;
+				for (int dy = -1; dy <= 1; dy++) {
+					for (int dx = -1; dx <= 1; dx++) {
+						int nx = x + dx;
+						int ny = y + dy;
+						if (nx < 0 || ny < 0 || nx >= static_cast<int>(size) || ny >= static_cast<int>(size)
+							|| blockOfTexel[ny * size + nx] != block || !source[ny * size + nx].covered) {
+							continue;
+						}
+						sum.position += source[ny * size + nx].position;
+						sum.normal += source[ny * size + nx].normal;
+						count++;
+					}
+				}
+				if (count > 0) {
+					TileTexel& texel = group.texels[y * size + x];
+					texel.position = sum.position / static_cast<float>(count);
+					texel.normal = sum.normal;
+					texel.covered = true;
+					grown = true;
+				}
+			}
+		}
+	}
+	for (TileTexel& texel : group.texels) {
+		if (texel.covered && glm::length(texel.normal) > 0.0f) {
+			texel.normal = glm::normalize(texel.normal);
+		}
+	}
+}
+
+bool LightmapBaker::pack(unsigned int maxSize)
+{
+	//shelves of tiles, biggest first
+	std::vector<unsigned int> order(m_surfaces.size());
+	for (unsigned int i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+		return m_groups[m_surfaces[a].group].tileSize > m_groups[m_surfaces[b].group].tileSize;
+	});
+
+	unsigned int largest = order.empty() ? 1 : m_groups[m_surfaces[order[0]].group].tileSize;
+	m_width = std::min(maxSize, std::max(2048u, largest));
+	if (largest > m_width) {
+		return false;
+	}
+	unsigned int x = 0, y = 0, shelfHeight = 0;
+	for (unsigned int i : order) {
+		unsigned int size = m_groups[m_surfaces[i].group].tileSize;
+		if (x + size > m_width) {
+			y += shelfHeight;
+			x = 0;
+			shelfHeight = 0;
+		}
+		m_surfaces[i].origin = glm::uvec2(x, y);
+		x += size;
+		shelfHeight = std::max(shelfHeight, size);
+	}
+	m_height = std::max(1u, y + shelfHeight);
+	return m_height <= maxSize;
+}
+
+glm::vec3 LightmapBaker::lightAt(const glm::vec3& position, const glm::vec3& normal) const
+{
+	//the diffuse and ambient terms of CalcDirLight and CalcPointLight in light_object.fs, without the albedo
+	glm::vec3 lightDir = glm::normalize(-m_lights.dirLight.direction);
+	glm::vec3 result = m_lights.dirLight.ambient + m_lights.dirLight.diffuse * std::max(glm::dot(normal, lightDir), 0.0f);
+	for (const StaticPointLight& light : m_lights.pointLights) {
+		glm::vec3 toLight = light.position - position;
+		float distance = glm::length(toLight);
+		float diff = distance > 0.0f ? std::max(glm::dot(normal, toLight / distance), 0.0f) : 0.0f;
+		float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+		result += (light.ambient + light.diffuse * diff) * attenuation;
+	}
+	return result;
+}
+
+void LightmapBaker::bakeRows(const Surface& surface, unsigned int firstRow, unsigned int rowCount)
+{
+	const SurfaceGroup& group = m_groups[surface.group];
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(surface.transform)));
+	unsigned int lastRow = std::min(firstRow + rowCount, group.tileSize);
+	for (unsigned int y = firstRow; y < lastRow; y++) {
+		for (unsigned int x = 0; x < group.tileSize; x++) {
+			const TileTexel& texel = group.texels[y * group.tileSize + x];
+			if (!texel.covered) {
+				continue;
+			}
+			glm::vec3 position = glm::vec3(surface.transform * glm::vec4(texel.position, 1.0f));
+			glm::vec3 normal = glm::normalize(normalMatrix * texel.normal);
+			size_t index = static_cast<size_t>(surface.origin.y + y) * m_width + surface.origin.x + x;
+			m_texels[index] = glm::packF2x11_1x10(lightAt(position, normal));
+		}
+	}
+}
+
+unsigned long long LightmapBaker::cacheKey() const
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	hash = hashBytes(hash, &LIGHTMAP_CACHE_VERSION, sizeof(LIGHTMAP_CACHE_VERSION));
+	hash = hashBytes(hash, &m_lights.dirLight, sizeof(StaticDirLight));
+	for (const StaticPointLight& light : m_lights.pointLights) {
+		hash = hashBytes(hash, &light, sizeof(StaticPointLight));
+	}
+	for (const SurfaceGroup& group : m_groups) {
+		hash = hashBytes(hash, &group.tileSize, sizeof(group.tileSize));
+		hash = hashBytes(hash, group.charts.blocks.data(), group.charts.blocks.size() * sizeof(glm::uvec4));
+		hash = hashBytes(hash, &group.charts.minimum, sizeof(group.charts.minimum));
+		hash = hashBytes(hash, &group.charts.extent, sizeof(group.charts.extent));
+		hash = hashBytes(hash, group.charts.blockOfFace, sizeof(group.charts.blockOfFace));
+		for (const Mesh* mesh : group.meshes) {
+			for (const Vertex& vertex : mesh->vertices) {
+				hash = hashBytes(hash, &vertex.Position, sizeof(vertex.Position));
+				hash = hashBytes(hash, &vertex.Normal, sizeof(vertex.Normal));
+				hash = hashBytes(hash, &vertex.LightmapCoords, sizeof(vertex.LightmapCoords));
+			}
+			hash = hashBytes(hash, mesh->indices.data(), mesh->indices.size() * sizeof(unsigned int));
+		}
+	}
+	for (const Surface& surface : m_surfaces) {
+		hash = hashBytes(hash, &surface.group, sizeof(surface.group));
+		hash = hashBytes(hash, &surface.transform, sizeof(surface.transform));
+	}
+	return hash;
+}
+
+bool LightmapBaker::readCache(const std::string& path, unsigned long long key)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	char magic[4];
+	glm::uint version = 0, width = 0, height = 0;
+	unsigned long long fileKey = 0;
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char*>(&version), sizeof(version));
+	file.read(reinterpret_cast<char*>(&fileKey), sizeof(fileKey));
+	file.read(reinterpret_cast<char*>(&width), sizeof(width));
+	file.read(reinterpret_cast<char*>(&height), sizeof(height));
+	if (!file || !std::equal(magic, magic + 4, LIGHTMAP_CACHE_MAGIC) || version != LIGHTMAP_CACHE_VERSION
+		|| fileKey != key || width != m_width || height != m_height) {
+		return false;
+	}
+	m_texels.resize(static_cast<size_t>(m_width) * m_height);
+	file.read(reinterpret_cast<char*>(m_texels.data()), m_texels.size() * sizeof(glm::uint));
+	return static_cast<bool>(file);
+}
+
+void LightmapBaker::writeCache(const std::string& path, unsigned long long key) const
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cout << "WARNING::LIGHTMAP:: could not write " << path << std::endl;
+		return;
+	}
+	file.write(LIGHTMAP_CACHE_MAGIC, sizeof(LIGHTMAP_CACHE_MAGIC));
+	file.write(reinterpret_cast<const char*>(&LIGHTMAP_CACHE_VERSION), sizeof(LIGHTMAP_CACHE_VERSION));
+	file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+	file.write(reinterpret_cast<const char*>(&m_width), sizeof(m_width));
+	file.write(reinterpret_cast<const char*>(&m_height), sizeof(m_height));
+	file.write(reinterpret_cast<const char*>(m_texels.data()), m_texels.size() * sizeof(glm::uint));
+}
+
+bool LightmapBaker::bake(const std::string& cachePath)
+{
+	GLint maxSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	if (!pack(static_cast<unsigned int>(maxSize))) {
+		std::cout << "ERROR::LIGHTMAP:: " << m_surfaces.size() << " surfaces don't fit into a " << maxSize << "x" << maxSize << " atlas" << std::endl;
+		return false;
+	}
+
+	unsigned long long key = cacheKey();
+	if (readCache(cachePath, key)) {
+		std::cout << "LIGHTMAP:: loaded " << m_width << "x" << m_height << " atlas from " << cachePath << std::endl;
+	}
+	else {
+		auto start = std::chrono::steady_clock::now();
+		JobSystem& jobs = JobSystem::instance();
+		jobs.parallelFor(static_cast<unsigned int>(m_groups.size()), [this](unsigned int i) {
+			rasterizeGroup(m_groups[i]);
+		});
+
+		//one job per band of rows of a tile
+		struct BakeJob
+		{
+			unsigned int surface;
+			unsigned int firstRow;
+		};
+		std::vector<BakeJob> bakeJobs;
+		for (unsigned int i = 0; i < m_surfaces.size(); i++) {
+			for (unsigned int row = 0; row < m_groups[m_surfaces[i].group].tileSize; row += LIGHTMAP_ROWS_PER_JOB) {
+				bakeJobs.push_back(BakeJob{ i, row });
+			}
+		}
+		m_texels.assign(static_cast<size_t>(m_width) * m_height, 0);
+		jobs.parallelFor(static_cast<unsigned int>(bakeJobs.size()), [this, &bakeJobs](unsigned int j) {
+			bakeRows(m_surfaces[bakeJobs[j].surface], bakeJobs[j].firstRow, LIGHTMAP_ROWS_PER_JOB);
+		});
+
+		float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "LIGHTMAP:: baked " << m_surfaces.size() << " surfaces into a " << m_width << "x" << m_height << " atlas in "
+			<< milliseconds << " ms on " << jobs.getThreadCount() + 1 << " threads" << std::endl;
+		writeCache(cachePath, key);
+		for (SurfaceGroup& group : m_groups) {
+			group.texels.clear();
+			group.texels.shrink_to_fit();
+		}
+	}
+
+	upload();
+	m_texels.clear();
+	m_texels.shrink_to_fit();
+	return true;
+}
+
+void LightmapBaker::upload()
+{
+	m_texture = GpuResources::instance().create(GPU_TEXTURE, GPU_RENDER_TARGETS);
+	glBindTexture(GL_TEXTURE_2D, m_texture.id());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, m_width, m_height, 0, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, m_texels.data());
+	m_texture.setBytes(m_texels.size() * sizeof(glm::uint));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+unsigned int LightmapBaker::getTexture() const
+{
+	return m_texture.id();
+}
+
+glm::vec4 LightmapBaker::getRect(unsigned int surface) const
+{
+	if (!m_texture.valid()) { //not baked
+		return glm::vec4(0.0f);
+	}
+	const Surface& s = m_surfaces[surface];
+	float size = static_cast<float>(m_groups[s.group].tileSize);
+	return glm::vec4(size / m_width, size / m_height, s.origin.x / static_cast<float>(m_width), s.origin.y / static_cast<float>(m_height));
+}
+
+std::vector<glm::vec4> LightmapBaker::getRects(unsigned int first, unsigned int count) const
+{
+	std::vector<glm::vec4> rects;
+	for (unsigned int i = first; i < first + count; i++) {
+		rects.push_back(getRect(i));
+	}
+	return rects;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <glm/glm/glm.hpp>
+
+#include "Mesh.h"
+
+#include <string>
+#include <vector>
+
+// the lights that never move, shared by the lighting shaders and the lightmap baker
+struct StaticDirLight
+{
+	glm::vec3 direction;
+	glm::vec3 ambient;
+	glm::vec3 diffuse;
+};
+
+struct StaticPointLight
+{
+	glm::vec3 position;
+	glm::vec3 ambient;
+	glm::vec3 diffuse;
+	float constant;
+	float linear;
+	float quadratic;
+};
+
+struct StaticLights
+{
+	StaticDirLight dirLight;
+	std::vector<StaticPointLight> pointLights;
+};
+
+// where LightmapBaker::unwrap put the charts of a set of meshes in their tile. Every chart owns a block of texels
+// that no other chart touches, and its lightmap coords stay between the centers of the outer texels of the block, so
+// not even bilinear filtering reads the texels of another chart
+struct LightmapCharts
+{
+	unsigned int tileSize;
+	std::vector<glm::uvec4> blocks; //x, y, width, height in texels
+	// the faces of the bounding box of the meshes get blocks of their own if unwrap was asked for them, for stand-ins
+	// that replace the meshes by the box such as RegionProxies
+	glm::vec3 minimum;
+	glm::vec3 extent;
+	int blockOfFace[6]; //-1 for the faces no triangle points to
+
+	bool hasFace(int face) const;
+	// lightmap coords of a point on a face of the bounding box. face is the axis times 2, plus 1 for the negative side
+	glm::vec2 coords(const glm::vec3& position, int face) const;
+};
+
+// bakes the diffuse lighting of the static lights into one atlas texture. Every surface (a set of meshes at one
+// transform) gets its own tile. The meshes need a second uv set first, see unwrap. The LIGHTMAP variant of
+// light_object.fs multiplies the baked value with the albedo. That matches what the other variants compute for the
+// static lights at the texel centers only: in between the light is filtered bilinearly, so it is as smooth as the
+// tile is fine and shading that changes within a texel, like the falloff right next to a point light, is lost.
+class LightmapBaker
+{
+private:
+	// world space sample of one texel of a tile
+	struct TileTexel
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		bool covered;
+	};
+
+	// meshes baked at the same tile size share the model space samples of their tile
+	struct SurfaceGroup
+	{
+		std::vector<const Mesh*> meshes;
+		unsigned int tileSize;
+		LightmapCharts charts;
+		std::vector<TileTexel> texels;
+	};
+
+	struct Surface
+	{
+		unsigned int group;
+		glm::mat4 transform;
+		glm::uvec2 origin; //in the atlas
+	};
+
+	StaticLights m_lights;
+	std::vector<SurfaceGroup> m_groups;
+	std::vector<Surface> m_surfaces;
+	unsigned int m_width;
+	unsigned int m_height;
+	std::vector<glm::uint> m_texels; //R11F_G11F_B10F
+	GpuHandle m_texture;
+
+	unsigned int findGroup(const std::vector<const Mesh*>& meshes, const LightmapCharts& charts);
+	unsigned int addSurfaces(const std::vector<const Mesh*>& meshes, const std::vector<glm::mat4>& transforms, const LightmapCharts& charts);
+	void rasterizeGroup(SurfaceGroup& group) const;
+	bool pack(unsigned int maxSize);
+	void bakeRows(const Surface& surface, unsigned int firstRow, unsigned int rowCount);
+	glm::vec3 lightAt(const glm::vec3& position, const glm::vec3& normal) const;
+	unsigned long long cacheKey() const;
+	bool readCache(const std::string& path, unsigned long long key);
+	void writeCache(const std::string& path, unsigned long long key) const;
+	void upload();
+
+	static LightmapCharts unwrap(const std::vector<Mesh*>& meshes, unsigned int tileSize, bool boxFaces);
+
+public:
+	LightmapBaker(const StaticLights& lights);
+	~LightmapBaker();
+
+	// gives the meshes lightmap coords: every connected planar region of a mesh becomes a chart, projected onto its
+	// plane, and the charts are packed into the tile at the same texel density, as high as fits. Vertices on chart
+	// borders are split. boxFaces also reserves blocks for the faces of the bounding box at half the density.
+	// Call before the meshes are added anywhere else and pass the returned layout when adding them here
+	static LightmapCharts unwrap(std::vector<Mesh>& meshes, unsigned int tileSize, bool boxFaces = false);
+	static LightmapCharts unwrap(Mesh& mesh, unsigned int tileSize, bool boxFaces = false);
+
+	// adds one surface per transform, charts is what unwrap gave the meshes. Returns the index of the first one
+	unsigned int add(const std::vector<Mesh>& meshes, const std::vector<glm::mat4>& transforms, const LightmapCharts& charts);
+	unsigned int add(const Mesh& mesh, const std::vector<glm::mat4>& transforms, const LightmapCharts& charts);
+
+	// loads the atlas from cachePath if it was baked from the same geometry and lights, bakes it on all cores and
+	// writes the cache otherwise. Returns false if the surfaces don't fit into one texture
+	bool bake(const std::string& cachePath);
+
+	unsigned int getTexture() const;
+
+	// scale (xy) and offset (zw) that map the lightmap coords of a surface into the atlas
+	glm::vec4 getRect(unsigned int surface) const;
+	std::vector<glm::vec4> getRects(unsigned int first, unsigned int count) const;
+};
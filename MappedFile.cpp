@@ -0,0 +1,138 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile() : m_data(nullptr), m_size(0), m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+{
+}
+#else
+MappedFile::MappedFile() : m_data(nullptr), m_size(0), m_file(-1)
+{
+}
+#endif
+
+MappedFile::MappedFile(const std::string& path) : MappedFile()
+{
+	open(path);
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& path)
+{
+	close();
+	m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size)) {
+		close();
+		return false;
+	}
+	//an empty file can't be mapped, it is open with no data
+	if (size.QuadPart == 0) {
+		return true;
+	}
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping) {
+		m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	if (!m_data) {
+		close();
+		return false;
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data) {
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping) {
+		CloseHandle(m_mapping);
+	}
+	if (m_file != INVALID_HANDLE_VALUE) {
+		CloseHandle(m_file);
+	}
+	m_data = nullptr;
+	m_size = 0;
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = nullptr;
+}
+
+bool MappedFile::isOpen() const
+{
+	return m_file != INVALID_HANDLE_VALUE;
+}
+#else
+bool MappedFile::open(const std::string& path)
+{
+	close();
+	m_file = ::open(path.c_str(), O_RDONLY);
+	if (m_file == -1) {
+		return false;
+	}
+	struct stat status;
+	if (fstat(m_file, &status) != 0) {
+		close();
+		return false;
+	}
+	//an empty file can't be mapped, it is open with no data
+	if (status.st_size == 0) {
+		return true;
+	}
+	void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, m_file, 0);
+	if (data == MAP_FAILED) {
+		close();
+		return false;
+	}
+	m_data = static_cast<const unsigned char*>(data);
+	m_size = static_cast<size_t>(status.st_size);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data) {
+		munmap(const_cast<unsigned char*>(m_data), m_size);
+	}
+	if (m_file != -1) {
+		::close(m_file);
+	}
+	m_data = nullptr;
+	m_size = 0;
+	m_file = -1;
+}
+
+bool MappedFile::isOpen() const
+{
+	return m_file != -1;
+}
+#endif
+
+const unsigned char* MappedFile::data() const
+{
+	return m_data;
+}
+
+size_t MappedFile::size() const
+{
+	return m_size;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// a whole file mapped read-only into memory. The pages are read by the OS when they are first touched and shared
+// with its file cache, so nothing is copied until the contents are used
+class MappedFile
+{
+private:
+	const unsigned char* m_data;
+	size_t m_size;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#else
+	int m_file;
+#endif
+
+public:
+	MappedFile();
+	// maps path, isOpen is false if it doesn't exist or can't be mapped
+	MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// maps path instead of the file mapped so far, false if it can't be mapped
+	bool open(const std::string& path);
+
+	// unmaps the file, so it can be written again on Windows
+	void close();
+
+	bool isOpen() const;
+	const unsigned char* data() const;
+	size_t size() const;
+};
@@ -0,0 +1,149 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include "shader.h"
+#include "TextureManager.h"
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+using namespace std;
+
+// every texture type gets a fixed range of texture units, so a sampler name (texture_diffuse2, texture_normal1, ...)
+// always maps to the same unit no matter which material is bound. That way the sampler uniforms of a shader only
+// have to be set once and binding a material is nothing more than binding its textures.
+#define MAX_TEXTURES_PER_TYPE 4
+
+enum TextureSlot {
+    SLOT_DIFFUSE = 0,
+    SLOT_SPECULAR = 1,
+    SLOT_NORMAL = 2,
+    SLOT_HEIGHT = 3,
+    SLOT_COUNT = 4
+};
+
+// the first unit after the material units, for the lightmap atlas which is bound once and stays bound
+#define LIGHTMAP_TEXTURE_UNIT (SLOT_COUNT * MAX_TEXTURES_PER_TYPE)
+// the baked clips of a skinned model (see AnimationBaker), past the two units of the impostor atlas
+#define ANIMATION_TEXTURE_UNIT (LIGHTMAP_TEXTURE_UNIT + 3)
+
+struct Texture {
+    unsigned int id;
+    string type;
+    string path;
+    TextureHandle handle; // for textures of the TextureManager, id may be out of date once it was evicted
+};
+
+// a texture of a material with the texture unit it is bound to
+struct MaterialTexture {
+    unsigned int id;
+    unsigned int unit;
+    TextureHandle handle;
+
+    // the texture to bind, a texture of the TextureManager is marked as drawn
+    unsigned int use() const
+    {
+        return handle.valid() ? handle.use() : id;
+    }
+};
+
+class Material {
+public:
+    // unique per material, meshes that share a material share the ID so identical state can be skipped
+    unsigned int ID;
+    vector<MaterialTexture> textures;
+
+    Material() : ID(nextID())
+    {
+    }
+
+    // resolves the texture units of the given textures, this is the only place where texture types are compared
+    Material(const vector<Texture>& textures) : ID(nextID())
+    {
+        unsigned int count[SLOT_COUNT] = { 0, 0, 0, 0 };
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            if (textures[i].type == "bone_matrices")
+            {
+                this->textures.push_back(MaterialTexture{ textures[i].id, ANIMATION_TEXTURE_UNIT, textures[i].handle });
+                continue;
+            }
+            int slot = slotFromType(textures[i].type);
+            if (slot == -1 || count[slot] == MAX_TEXTURES_PER_TYPE)
+            {
+                std::cout << "WARNING::MATERIAL:: no texture unit left for " << textures[i].type << " (" << textures[i].path << ")" << std::endl;
+                continue;
+            }
+            MaterialTexture texture;
+            texture.id = textures[i].id;
+            texture.handle = textures[i].handle;
+            texture.unit = slot * MAX_TEXTURES_PER_TYPE + count[slot]++;
+            this->textures.push_back(texture);
+        }
+    }
+
+    // bind all textures of the material to their units
+    void bind() const
+    {
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + textures[i].unit);
+            glBindTexture(GL_TEXTURE_2D, textures[i].use());
+        }
+    }
+
+    // true if any texture of the material is bound to a unit of slot
+    bool hasTexture(TextureSlot slot) const
+    {
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            if (textures[i].unit / MAX_TEXTURES_PER_TYPE == static_cast<unsigned int>(slot))
+                return true;
+        }
+        return false;
+    }
+
+    // points the conventional sampler uniforms (texture_diffuseN, texture_specularN, texture_normalN, texture_heightN,
+    // boneMatrices) of a shader to their fixed texture units. Call once per shader at load time.
+    static void assignSamplerUnits(Shader& shader)
+    {
+        static const char* names[SLOT_COUNT] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+        shader.use();
+        for (unsigned int slot = 0; slot < SLOT_COUNT; slot++)
+        {
+            for (unsigned int n = 0; n < MAX_TEXTURES_PER_TYPE; n++)
+            {
+                GLint location = shader.getUniformLocation(names[slot] + std::to_string(n + 1));
+                if (location != -1)
+                    glUniform1i(location, slot * MAX_TEXTURES_PER_TYPE + n);
+            }
+        }
+        GLint location = shader.getUniformLocation("boneMatrices");
+        if (location != -1)
+            glUniform1i(location, ANIMATION_TEXTURE_UNIT);
+    }
+
+private:
+    static int slotFromType(const string& type)
+    {
+        if (type == "texture_diffuse")
+            return SLOT_DIFFUSE;
+        if (type == "texture_specular")
+            return SLOT_SPECULAR;
+        if (type == "texture_normal")
+            return SLOT_NORMAL;
+        if (type == "texture_height")
+            return SLOT_HEIGHT;
+        return -1;
+    }
+
+    static unsigned int nextID()
+    {
+        static unsigned int next = 1;
+        return next++;
+    }
+};
+#endif
@@ -5,11 +5,17 @@
 
 #include <glm/glm/glm.hpp>
 #include <glm/glm/gtc/matrix_transform.hpp>
+#include <glm/glm/gtc/packing.hpp>
 
 #include "shader.h"
+#include "Material.h"
+#include "RenderQueue.h"
+#include "GpuResources.h"
 
 #include <string>
 #include <vector>
+#include <cmath>
+#include <cstring>
 
 using namespace std;
 
@@ -30,117 +36,378 @@ struct Vertex {
     int m_BoneIDs[MAX_BONE_INFLUENCE];
     //weights from each bone
     float m_Weights[MAX_BONE_INFLUENCE];
+    // second uv set, unique per surface so static lighting can be baked into it (see LightmapBaker)
+    glm::vec2 LightmapCoords;
 };
 
-struct Texture {
-    unsigned int id;
-    string type;
-    string path;
+// texture coords up to this size are stored as half floats, below it their rounding error stays under 2^-11, half a
+// texel of a 1024 texture
+#define HALF_TEXCOORD_LIMIT 2.0f
+
+// octahedral encoding of a unit vector: it is projected onto the octahedron |x| + |y| + |z| = 1 and the lower half
+// is folded over the upper one, which spreads the precision of two components evenly over the sphere. Decoded by
+// octDecode in light_object.vs
+inline glm::vec2 octEncode(const glm::vec3& v)
+{
+    float length = std::fabs(v.x) + std::fabs(v.y) + std::fabs(v.z);
+    if (length == 0.0f)
+        return glm::vec2(0.0f);
+    glm::vec2 p = glm::vec2(v.x, v.y) / length;
+    if (v.z < 0.0f)
+        p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * glm::vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+    return p;
+}
+
+// how the vertices and indices of a mesh are stored on the GPU. It is picked per mesh from its data whenever the
+// geometry is uploaded, the CPU side keeps whole Vertex structs for baking and simplification until releaseGeometry.
+// Positions stay floats, normals are octahedral encoded and everything else is only stored if the mesh needs it:
+//   location 0  position         3 x float
+//   location 1  normal           2 x snorm16, octahedral
+//   location 2  texture coords   2 x half float, 2 x float if they reach HALF_TEXCOORD_LIMIT
+//   location 3  tangent          4 x snorm16, octahedral in xy and the sign of the bitangent in z. Normal maps only
+//   location 5  bone ids         4 x uint8, only if a vertex has bone weights
+//   location 6  bone weights     4 x unorm8, as above
+//   location 8  lightmap coords  2 x unorm16, left out while they are all 0 (a disabled attribute reads 0)
+// the lightmapped buildings take 24 bytes a vertex this way, a Vertex is 96
+struct VertexLayout {
+    bool halfTexCoords = true;
+    bool tangents = false;
+    bool bones = false;
+    bool lightmapCoords = false;
+    bool shortIndices = true; // 16 bit indices, every index is below 65536
+
+    // the smallest layout that keeps what the vertices hold. Indices are relative to the base vertex of their level,
+    // tangents are only stored if asked for
+    static VertexLayout of(const vector<Vertex>& vertices, const vector<unsigned int>& indices, bool tangents)
+    {
+        VertexLayout layout;
+        layout.tangents = tangents;
+        for (unsigned int i = 0; i < vertices.size(); i++)
+        {
+            const Vertex& vertex = vertices[i];
+            if (std::fabs(vertex.TexCoords.x) >= HALF_TEXCOORD_LIMIT || std::fabs(vertex.TexCoords.y) >= HALF_TEXCOORD_LIMIT)
+                layout.halfTexCoords = false;
+            if (vertex.LightmapCoords != glm::vec2(0.0f))
+                layout.lightmapCoords = true;
+            for (unsigned int j = 0; j < MAX_BONE_INFLUENCE; j++)
+            {
+                if (vertex.m_Weights[j] > 0.0f)
+                    layout.bones = true;
+            }
+        }
+        for (unsigned int i = 0; i < indices.size(); i++)
+        {
+            if (indices[i] > 0xFFFF)
+                layout.shortIndices = false;
+        }
+        return layout;
+    }
+
+    unsigned int stride() const
+    {
+        return 12 + 4 + (halfTexCoords ? 4 : 8) + (tangents ? 8 : 0) + (bones ? 8 : 0) + (lightmapCoords ? 4 : 0);
+    }
+
+    GLenum indexType() const
+    {
+        return shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    }
+
+    // appends the vertices in this layout to data
+    void packVertices(const vector<Vertex>& vertices, vector<unsigned char>& data) const
+    {
+        size_t offset = data.size();
+        data.resize(offset + vertices.size() * stride());
+        unsigned char* out = data.data() + offset;
+        for (unsigned int i = 0; i < vertices.size(); i++)
+        {
+            const Vertex& vertex = vertices[i];
+            write(out, vertex.Position);
+            write(out, glm::packSnorm2x16(octEncode(vertex.Normal)));
+            if (halfTexCoords)
+                write(out, glm::packHalf2x16(vertex.TexCoords));
+            else
+                write(out, vertex.TexCoords);
+            if (tangents)
+            {
+                float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+                write(out, glm::packSnorm4x16(glm::vec4(octEncode(vertex.Tangent), handedness, 0.0f)));
+            }
+            if (bones)
+            {
+                unsigned char ids[MAX_BONE_INFLUENCE];
+                for (unsigned int j = 0; j < MAX_BONE_INFLUENCE; j++)
+                    ids[j] = static_cast<unsigned char>(glm::clamp(vertex.m_BoneIDs[j], 0, 255));
+                write(out, ids);
+                write(out, glm::packUnorm4x8(glm::vec4(vertex.m_Weights[0], vertex.m_Weights[1], vertex.m_Weights[2], vertex.m_Weights[3])));
+            }
+            if (lightmapCoords)
+                write(out, glm::packUnorm2x16(vertex.LightmapCoords));
+        }
+    }
+
+    // appends the indices in this layout to data
+    void packIndices(const vector<unsigned int>& indices, vector<unsigned char>& data) const
+    {
+        if (!shortIndices)
+        {
+            const unsigned char* first = reinterpret_cast<const unsigned char*>(indices.data());
+            data.insert(data.end(), first, first + indices.size() * sizeof(unsigned int));
+            return;
+        }
+        size_t offset = data.size();
+        data.resize(offset + indices.size() * sizeof(unsigned short));
+        unsigned char* out = data.data() + offset;
+        for (unsigned int i = 0; i < indices.size(); i++)
+            write(out, static_cast<unsigned short>(indices[i]));
+    }
+
+    // points the attributes of the bound vertex array at the bound GL_ARRAY_BUFFER, locations 7 and 9 are left to
+    // per instance data
+    void setAttributes() const
+    {
+        GLsizei size = stride();
+        size_t offset = 0;
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, size, (void*)offset);
+        offset += 12;
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, size, (void*)offset);
+        offset += 4;
+        glEnableVertexAttribArray(2);
+        if (halfTexCoords)
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, size, (void*)offset);
+        else
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, size, (void*)offset);
+        offset += halfTexCoords ? 4 : 8;
+        if (tangents)
+        {
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 4, GL_SHORT, GL_TRUE, size, (void*)offset);
+            offset += 8;
+        }
+        if (bones)
+        {
+            glEnableVertexAttribArray(5);
+            glVertexAttribIPointer(5, 4, GL_UNSIGNED_BYTE, size, (void*)offset);
+            glEnableVertexAttribArray(6);
+            glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, size, (void*)(offset + 4));
+            offset += 8;
+        }
+        if (lightmapCoords)
+        {
+            glEnableVertexAttribArray(8);
+            glVertexAttribPointer(8, 2, GL_UNSIGNED_SHORT, GL_TRUE, size, (void*)offset);
+        }
+    }
+
+private:
+    template<typename T>
+    static void write(unsigned char*& out, const T& value)
+    {
+        std::memcpy(out, &value, sizeof(T));
+        out += sizeof(T);
+    }
 };
 
+#define MAX_LOD_LEVELS 4
+// a level is only drawn while its error covers at most this many pixels on screen
+#define LOD_PIXEL_ERROR 1.0f
+// a coarser level has to be this much below LOD_PIXEL_ERROR before it is switched to, so instances near the
+// threshold don't flip between two levels every frame
+#define LOD_HYSTERESIS 0.25f
+
+// simplified geometry of a mesh, see MeshSimplifier. error is how far the surface may have moved, in model units
+struct LodGeometry {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;
+    float                error;
+};
+
+// where a level of detail lives in the buffers of its mesh
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int count;
+    int          baseVertex;
+    float        error;
+};
+
+// the camera as far as the level of detail is concerned
+struct LodView {
+    glm::vec3 position;
+    float     pixelsPerUnit; // size in pixels of one unit at distance one, 0 always picks the full detail
+    glm::vec2 impostorFade;  // where instances with an impostor fade into it, 0 never. See Impostor.h
+};
+
+// pixels per unit of a perspective projection with the vertical field of view fovy (radians)
+inline float lodPixelsPerUnit(float fovy, int screenHeight)
+{
+    return screenHeight / (2.0f * tan(fovy * 0.5f));
+}
+
+// the coarsest level whose error stays below LOD_PIXEL_ERROR on screen, starting from the current one. errors
+// grow with the level. Same rule as cull.cs
+inline unsigned int selectLod(const float* errors, unsigned int levelCount, const glm::vec4& worldBounds, const LodView& view, unsigned int current)
+{
+    if (view.pixelsPerUnit <= 0.0f || levelCount <= 1)
+        return 0;
+    // the closest the surface can get, a camera inside the bounds always sees the full detail
+    float distance = glm::length(glm::vec3(worldBounds) - view.position) - worldBounds.w;
+    if (distance <= 0.0f)
+        return 0;
+    float pixelsPerUnit = view.pixelsPerUnit / distance;
+    unsigned int level = glm::min(current, levelCount - 1);
+    while (level > 0 && errors[level] * pixelsPerUnit > LOD_PIXEL_ERROR)
+        level--;
+    while (level + 1 < levelCount && errors[level + 1] * pixelsPerUnit <= LOD_PIXEL_ERROR * (1.0f - LOD_HYSTERESIS))
+        level++;
+    return level;
+}
+
+// sphere (center, radius) around the center of the bounding box, good enough for culling boxy meshes
+inline glm::vec4 boundingSphere(const vector<Vertex>& vertices)
+{
+    if (vertices.empty())
+        return glm::vec4(0.0f);
+    glm::vec3 minimum = vertices[0].Position;
+    glm::vec3 maximum = vertices[0].Position;
+    for (unsigned int i = 1; i < vertices.size(); i++)
+    {
+        minimum = glm::min(minimum, vertices[i].Position);
+        maximum = glm::max(maximum, vertices[i].Position);
+    }
+    glm::vec3 center = (minimum + maximum) * 0.5f;
+    float radius = 0.0f;
+    for (unsigned int i = 0; i < vertices.size(); i++)
+        radius = glm::max(radius, glm::length(vertices[i].Position - center));
+    return glm::vec4(center, radius);
+}
+
 class Mesh {
 public:
     // mesh Data
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
-    vector<Texture>      textures;
-    unsigned int VAO;
+    Material             material;
+    GpuHandle            VAO; // shared by copies of the mesh, deleted with the last one
+    VertexLayout         layout; // how VAO stores the geometry, picked when it is uploaded
+    // lods[0] is the full mesh above, the coarser levels follow it in the same buffers
+    vector<MeshLod>      lods;
+    vector<LodGeometry>  lodGeometry; // levels 1 and up
 
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, Material material)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->material = material;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader& shader)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+        : Mesh(std::move(vertices), std::move(indices), Material(textures))
+    {
+    }
+
+    // render the mesh with the program in use, its sampler uniforms are expected to be set up with
+    // Material::assignSamplerUnits
+    void Draw()
     {
         // bind appropriate textures
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int heightNr = 1;
-        for (unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
-            else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-            else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
+        material.bind();
 
         // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(VAO.id());
+        glDrawElements(GL_TRIANGLES, lods[0].count, layout.indexType(), 0);
         glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // queue the mesh for drawing with the given model matrix, lightmapRect places its lightmap coords in the atlas.
+    // lod is clamped to the levels the mesh has, animation is the clip and time of a skinned mesh (Model::animationOf)
+    void Submit(RenderQueue& queue, Shader& shader, const glm::mat4& model, unsigned int pass = PASS_OPAQUE, const glm::vec4& lightmapRect = glm::vec4(0.0f), unsigned int lod = 0,
+        const glm::vec4& animation = glm::vec4(0.0f))
+    {
+        const MeshLod& level = lods[glm::min(lod, static_cast<unsigned int>(lods.size() - 1))];
+        queue.submit(shader, &material, VAO.id(), level.count, true, model, pass, lightmapRect, level.firstIndex, level.baseVertex, layout.indexType(), animation);
+    }
+
+    // replaces the geometry and uploads it again, the vertex layout is recomputed from the new vertices on upload.
+    // Drops the levels of detail
+    void setGeometry(const vector<Vertex>& vertices, const vector<unsigned int>& indices)
+    {
+        this->vertices = vertices;
+        this->indices = indices;
+        setLods(vector<LodGeometry>());
+    }
+
+    // stores coarser versions of the mesh behind the full one, levels[0] becomes lods[1]
+    void setLods(const vector<LodGeometry>& levels)
+    {
+        lodGeometry = levels;
+        lods.assign(1, MeshLod{ 0, static_cast<unsigned int>(indices.size()), 0, 0.0f });
+        vector<Vertex> allVertices = vertices;
+        vector<unsigned int> allIndices = indices;
+        for (unsigned int i = 0; i < levels.size(); i++)
+        {
+            MeshLod lod;
+            lod.firstIndex = static_cast<unsigned int>(allIndices.size());
+            lod.count = static_cast<unsigned int>(levels[i].indices.size());
+            lod.baseVertex = static_cast<int>(allVertices.size());
+            lod.error = levels[i].error;
+            lods.push_back(lod);
+            allVertices.insert(allVertices.end(), levels[i].vertices.begin(), levels[i].vertices.end());
+            allIndices.insert(allIndices.end(), levels[i].indices.begin(), levels[i].indices.end());
+        }
+        upload(allVertices, allIndices);
+    }
+
+    // frees the CPU copies of the geometry once nothing reads them any more, the buffers are all that is drawn from.
+    // The mesh can't be unwrapped, simplified, baked or batched afterwards
+    void releaseGeometry()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+        vector<LodGeometry>().swap(lodGeometry);
+    }
+
 private:
     // render data 
-    unsigned int VBO, EBO;
+    GpuHandle VBO, EBO;
 
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
+        lods.assign(1, MeshLod{ 0, static_cast<unsigned int>(indices.size()), 0, 0.0f });
+
         // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-        // ids
-        glEnableVertexAttribArray(5);
-        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-        // weights
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+        VAO = GpuResources::instance().create(GPU_VERTEX_ARRAY, GPU_GEOMETRY);
+        VBO = GpuResources::instance().create(GPU_BUFFER, GPU_GEOMETRY);
+        EBO = GpuResources::instance().create(GPU_BUFFER, GPU_GEOMETRY);
+        upload(vertices, indices);
+    }
+
+    // picks the layout for the geometry, levels of detail included, and loads it into the buffers
+    void upload(const vector<Vertex>& allVertices, const vector<unsigned int>& allIndices)
+    {
+        layout = VertexLayout::of(allVertices, allIndices, material.hasTexture(SLOT_NORMAL));
+        vector<unsigned char> vertexData;
+        vector<unsigned char> indexData;
+        layout.packVertices(allVertices, vertexData);
+        layout.packIndices(allIndices, indexData);
+
+        glBindVertexArray(VAO.id());
+        GpuResources::bufferData(GL_ARRAY_BUFFER, VBO, vertexData.size(), vertexData.data(), GL_STATIC_DRAW);
+        GpuResources::bufferData(GL_ELEMENT_ARRAY_BUFFER, EBO, indexData.size(), indexData.data(), GL_STATIC_DRAW);
+
+        // a new layout may leave out attributes the last one had
+        for (GLuint location = 0; location <= 8; location++)
+            glDisableVertexAttribArray(location);
+        layout.setAttributes();
         glBindVertexArray(0);
     }
 };
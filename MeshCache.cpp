@@ -0,0 +1,254 @@
+#include "MeshCache.h"
+#include "AssetArchive.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+//bump when the layout of the file or the processing after the import changes
+const glm::uint MESH_CACHE_VERSION = 3;
+const char MESH_CACHE_MAGIC[4] = { 'M', 'E', 'S', 'H' };
+
+//FNV-1a
+static unsigned long long hashBytes(unsigned long long hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+namespace
+{
+	//reads values from a mapped file, fails once anything would read past its end
+	class Reader
+	{
+	private:
+		const unsigned char* m_position;
+		const unsigned char* m_end;
+
+	public:
+		Reader(const AssetFile& file) : m_position(file.data()), m_end(file.data() + file.size())
+		{
+		}
+
+		bool read(void* destination, size_t size)
+		{
+			if (size > static_cast<size_t>(m_end - m_position)) {
+				m_position = m_end;
+				return false;
+			}
+			if (size > 0) {
+				std::memcpy(destination, m_position, size);
+			}
+			m_position += size;
+			return true;
+		}
+
+		template<typename T>
+		bool read(T& value)
+		{
+			return read(&value, sizeof(T));
+		}
+
+		bool read(std::string& text)
+		{
+			glm::uint length = 0;
+			if (!read(length) || length > static_cast<size_t>(m_end - m_position)) {
+				return false;
+			}
+			text.assign(reinterpret_cast<const char*>(m_position), length);
+			m_position += length;
+			return true;
+		}
+
+		//copies count elements straight out of the mapping
+		template<typename T>
+		bool read(std::vector<T>& values, glm::uint count)
+		{
+			if (count > static_cast<size_t>(m_end - m_position) / sizeof(T)) {
+				return false;
+			}
+			const T* first = reinterpret_cast<const T*>(m_position);
+			values.assign(first, first + count);
+			m_position += count * sizeof(T);
+			return true;
+		}
+	};
+
+	//the material libraries an OBJ file names with mtllib, Assimp reads them from its directory along with it
+	std::vector<std::string> materialLibraries(const MappedFile& source)
+	{
+		std::vector<std::string> names;
+		const char* text = reinterpret_cast<const char*>(source.data());
+		const char* end = text + source.size();
+		const char keyword[] = "mtllib ";
+		const size_t keywordLength = sizeof(keyword) - 1;
+		for (const char* line = text; line < end;) {
+			const char* lineEnd = std::find(line, end, '\n');
+			if (static_cast<size_t>(lineEnd - line) > keywordLength && std::equal(keyword, keyword + keywordLength, line)) {
+				std::string name(line + keywordLength, lineEnd);
+				name.erase(name.find_last_not_of(" \t\r") + 1);
+				names.push_back(name);
+			}
+			line = lineEnd + 1;
+		}
+		return names;
+	}
+
+	void writeString(std::ofstream& file, const std::string& text)
+	{
+		glm::uint length = static_cast<glm::uint>(text.size());
+		file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+		file.write(text.data(), length);
+	}
+}
+
+bool MeshCache::sourceKey(const std::string& sourcePath, unsigned int importFlags, unsigned long long& key)
+{
+	MappedFile source(sourcePath);
+	if (!source.isOpen()) {
+		return false;
+	}
+	//the layout of a vertex is part of the key, a cooked model is its raw bytes
+	glm::uint vertexSize = sizeof(Vertex);
+	key = 14695981039346656037ULL;
+	key = hashBytes(key, source.data(), source.size());
+	key = hashBytes(key, &importFlags, sizeof(importFlags));
+	key = hashBytes(key, &vertexSize, sizeof(vertexSize));
+	//the materials of an OBJ live in files of their own
+	std::string directory = sourcePath.substr(0, sourcePath.find_last_of('/'));
+	for (const std::string& name : materialLibraries(source)) {
+		MappedFile library(directory + '/' + name);
+		key = hashBytes(key, name.data(), name.size());
+		if (library.isOpen()) {
+			key = hashBytes(key, library.data(), library.size());
+		}
+	}
+	return true;
+}
+
+bool MeshCache::read(const std::string& path, unsigned long long key, CookedModel& model)
+{
+	AssetFile file(path);
+	if (!file.isOpen()) {
+		return false;
+	}
+	Reader reader(file);
+	char magic[4];
+	glm::uint version = 0, materialCount = 0, meshCount = 0;
+	unsigned long long fileKey = 0;
+	if (!reader.read(magic) || !reader.read(version) || !reader.read(fileKey)
+		|| !std::equal(magic, magic + 4, MESH_CACHE_MAGIC) || version != MESH_CACHE_VERSION || (fileKey != key && !file.packed())) {
+		return false;
+	}
+
+	CookedModel cooked;
+	if (!reader.read(materialCount)) {
+		return false;
+	}
+	cooked.materials.resize(std::min(materialCount, static_cast<glm::uint>(file.size())));
+	for (std::vector<TextureReference>& material : cooked.materials) {
+		glm::uint textureCount = 0;
+		if (!reader.read(textureCount)) {
+			return false;
+		}
+		for (glm::uint i = 0; i < textureCount; i++) {
+			TextureReference texture;
+			if (!reader.read(texture.type) || !reader.read(texture.path)) {
+				return false;
+			}
+			material.push_back(texture);
+		}
+	}
+
+	if (!reader.read(meshCount)) {
+		return false;
+	}
+	cooked.meshes.resize(std::min(meshCount, static_cast<glm::uint>(file.size())));
+	for (CookedMesh& mesh : cooked.meshes) {
+		glm::uint vertexCount = 0, indexCount = 0;
+		if (!reader.read(mesh.material) || !reader.read(vertexCount) || !reader.read(indexCount)
+			|| !reader.read(mesh.vertices, vertexCount) || !reader.read(mesh.indices, indexCount)) {
+			return false;
+		}
+		//a packed model is taken without its source key, so a broken one must not get past here to index out of bounds
+		if (mesh.material >= cooked.materials.size()) {
+			return false;
+		}
+		for (unsigned int index : mesh.indices) {
+			if (index >= vertexCount) {
+				return false;
+			}
+		}
+	}
+
+	BakedAnimation& animation = cooked.animation;
+	glm::uint clipCount = 0, texelCount = 0;
+	if (!reader.read(animation.boneCount) || !reader.read(clipCount)) {
+		return false;
+	}
+	animation.clips.resize(std::min(clipCount, static_cast<glm::uint>(file.size())));
+	for (AnimationClip& clip : animation.clips) {
+		if (!reader.read(clip.name) || !reader.read(clip.firstFrame) || !reader.read(clip.frameCount) || !reader.read(clip.framesPerSecond)) {
+			return false;
+		}
+	}
+	if (!reader.read(texelCount) || !reader.read(animation.texels, texelCount) || !reader.read(animation.bounds)) {
+		return false;
+	}
+	model = std::move(cooked);
+	return true;
+}
+
+void MeshCache::write(const std::string& path, unsigned long long key, const CookedModel& model)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cout << "WARNING::MESH:: could not write " << path << std::endl;
+		return;
+	}
+	glm::uint materialCount = static_cast<glm::uint>(model.materials.size());
+	glm::uint meshCount = static_cast<glm::uint>(model.meshes.size());
+	file.write(MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	file.write(reinterpret_cast<const char*>(&MESH_CACHE_VERSION), sizeof(MESH_CACHE_VERSION));
+	file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+	file.write(reinterpret_cast<const char*>(&materialCount), sizeof(materialCount));
+	for (const std::vector<TextureReference>& material : model.materials) {
+		glm::uint textureCount = static_cast<glm::uint>(material.size());
+		file.write(reinterpret_cast<const char*>(&textureCount), sizeof(textureCount));
+		for (const TextureReference& texture : material) {
+			writeString(file, texture.type);
+			writeString(file, texture.path);
+		}
+	}
+	file.write(reinterpret_cast<const char*>(&meshCount), sizeof(meshCount));
+	for (const CookedMesh& mesh : model.meshes) {
+		glm::uint vertexCount = static_cast<glm::uint>(mesh.vertices.size());
+		glm::uint indexCount = static_cast<glm::uint>(mesh.indices.size());
+		file.write(reinterpret_cast<const char*>(&mesh.material), sizeof(mesh.material));
+		file.write(reinterpret_cast<const char*>(&vertexCount), sizeof(vertexCount));
+		file.write(reinterpret_cast<const char*>(&indexCount), sizeof(indexCount));
+		file.write(reinterpret_cast<const char*>(mesh.vertices.data()), vertexCount * sizeof(Vertex));
+		file.write(reinterpret_cast<const char*>(mesh.indices.data()), indexCount * sizeof(unsigned int));
+	}
+
+	const BakedAnimation& animation = model.animation;
+	glm::uint clipCount = static_cast<glm::uint>(animation.clips.size());
+	glm::uint texelCount = static_cast<glm::uint>(animation.texels.size());
+	file.write(reinterpret_cast<const char*>(&animation.boneCount), sizeof(animation.boneCount));
+	file.write(reinterpret_cast<const char*>(&clipCount), sizeof(clipCount));
+	for (const AnimationClip& clip : animation.clips) {
+		writeString(file, clip.name);
+		file.write(reinterpret_cast<const char*>(&clip.firstFrame), sizeof(clip.firstFrame));
+		file.write(reinterpret_cast<const char*>(&clip.frameCount), sizeof(clip.frameCount));
+		file.write(reinterpret_cast<const char*>(&clip.framesPerSecond), sizeof(clip.framesPerSecond));
+	}
+	file.write(reinterpret_cast<const char*>(&texelCount), sizeof(texelCount));
+	file.write(reinterpret_cast<const char*>(animation.texels.data()), texelCount * sizeof(glm::vec4));
+	file.write(reinterpret_cast<const char*>(&animation.bounds), sizeof(animation.bounds));
+}
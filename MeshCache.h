@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <string>
+#include <vector>
+
+// a texture of a material as the source file references it, relative to the directory of the model
+struct TextureReference
+{
+	std::string type; //sampler name without the number, texture_diffuse, texture_normal, ...
+	std::string path;
+};
+
+struct CookedMesh
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	unsigned int material;
+};
+
+// a clip of a BakedAnimation, its frames are the rows from firstFrame on
+struct AnimationClip
+{
+	std::string name;
+	glm::uint firstFrame;
+	glm::uint frameCount;
+	float framesPerSecond;
+};
+
+// the clips of a skeleton sampled into skinning matrices the way the vertex shader reads them from a texture: one row
+// per frame, 3 texels per bone holding the top three rows of its matrix. See AnimationBaker
+struct BakedAnimation
+{
+	glm::uint boneCount = 0;
+	std::vector<AnimationClip> clips;
+	std::vector<glm::vec4> texels;
+	glm::vec4 bounds = glm::vec4(0.0f); //bounding sphere of the model over every frame of every clip
+
+	glm::uint width() const
+	{
+		return boneCount * 3;
+	}
+
+	glm::uint height() const
+	{
+		return width() > 0 ? static_cast<glm::uint>(texels.size() / width()) : 0;
+	}
+};
+
+// a model as it comes out of the importer, before any GL object is made
+struct CookedModel
+{
+	std::vector<std::vector<TextureReference>> materials;
+	std::vector<CookedMesh> meshes;
+	BakedAnimation animation; //boneCount 0 for a model without clips
+};
+
+// cooked models, so a warm start maps one file instead of running Assimp: a header, the texture references of every
+// material, the raw vertex and index blobs of every mesh and the baked clips. A file belongs to the source it was
+// cooked from through a key hashed from the bytes of the source, of the material libraries an OBJ names and the import
+// flags, changing any of them cooks it again.
+class MeshCache
+{
+public:
+	// key of the source file imported with importFlags, false if it can't be read
+	static bool sourceKey(const std::string& sourcePath, unsigned int importFlags, unsigned long long& key);
+
+	// maps the cooked model at path, false if there is none or it was cooked for another key. A model packed into the
+	// asset archive was cooked along with it and is taken whatever key it has
+	static bool read(const std::string& path, unsigned long long key, CookedModel& model);
+
+	static void write(const std::string& path, unsigned long long key, const CookedModel& model);
+};
@@ -0,0 +1,256 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cstdint>
+
+float MeshOptimizer::acmr(const std::vector<unsigned int>& indices, unsigned int vertexCount, unsigned int cacheSize)
+{
+	if (indices.size() < 3) {
+		return 0.0f;
+	}
+	//a FIFO by time stamps: a vertex is in the cache while fewer than cacheSize vertices were added after it
+	std::vector<unsigned int> addedAt(vertexCount, 0);
+	unsigned int time = cacheSize + 1;
+	unsigned int misses = 0;
+	for (unsigned int index : indices) {
+		if (time - addedAt[index] > cacheSize) {
+			addedAt[index] = time++;
+			misses++;
+		}
+	}
+	return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount, unsigned int cacheSize)
+{
+	unsigned int triangleCount = static_cast<unsigned int>(indices.size() / 3);
+	if (triangleCount == 0) {
+		return;
+	}
+
+	//the triangles around every vertex, adjacency[firstTriangle[v]] up to adjacency[firstTriangle[v + 1]]
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (unsigned int i = 0; i < triangleCount * 3; i++) {
+		liveTriangles[indices[i]]++;
+	}
+	std::vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+	for (unsigned int v = 0; v < vertexCount; v++) {
+		firstTriangle[v + 1] = firstTriangle[v] + liveTriangles[v];
+	}
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	std::vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (unsigned int i = 0; i < triangleCount * 3; i++) {
+		adjacency[filled[indices[i]]++] = i / 3;
+	}
+
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnds;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> result;
+	result.reserve(triangleCount * 3);
+	unsigned int time = cacheSize + 1;
+	unsigned int cursor = 0;
+
+	//emits all remaining triangles around a fanning vertex, then moves on to one of their vertices
+	int fan = 0;
+	while (fan >= 0) {
+		candidates.clear();
+		for (unsigned int a = firstTriangle[fan]; a < firstTriangle[fan + 1]; a++) {
+			unsigned int triangle = adjacency[a];
+			if (emitted[triangle]) {
+				continue;
+			}
+			emitted[triangle] = true;
+			for (unsigned int c = 0; c < 3; c++) {
+				unsigned int v = indices[triangle * 3 + c];
+				result.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > cacheSize) {
+					cacheTime[v] = time++;
+				}
+			}
+		}
+
+		//the oldest candidate that is still in the cache once its remaining triangles are emitted, else any with
+		//triangles left
+		int next = -1;
+		int bestPriority = -1;
+		for (unsigned int v : candidates) {
+			if (liveTriangles[v] == 0) {
+				continue;
+			}
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+				priority = static_cast<int>(time - cacheTime[v]);
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = static_cast<int>(v);
+			}
+		}
+
+		//dead end: the most recently used vertex with triangles left, the next one in input order after that
+		while (next == -1 && !deadEnds.empty()) {
+			unsigned int v = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[v] > 0) {
+				next = static_cast<int>(v);
+			}
+		}
+		while (next == -1 && cursor < vertexCount) {
+			if (liveTriangles[cursor] > 0) {
+				next = static_cast<int>(cursor);
+			}
+			cursor++;
+		}
+		fan = next;
+	}
+	indices.swap(result);
+}
+
+std::vector<unsigned int> MeshOptimizer::overdrawClusters(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, float threshold)
+{
+	unsigned int triangleCount = static_cast<unsigned int>(indices.size() / 3);
+	std::vector<unsigned int> addedAt(vertices.size(), 0);
+	unsigned int time = VERTEX_CACHE_SIZE + 1;
+	auto misses = [&addedAt, &time, &indices](unsigned int triangle) {
+		unsigned int count = 0;
+		for (unsigned int c = 0; c < 3; c++) {
+			unsigned int v = indices[triangle * 3 + c];
+			if (time - addedAt[v] > VERTEX_CACHE_SIZE) {
+				addedAt[v] = time++;
+				count++;
+			}
+		}
+		return count;
+	};
+	//forgets the cache, the first triangle of a cluster starts from nothing wherever the cluster ends up
+	auto flush = [&time]() {
+		time += VERTEX_CACHE_SIZE + 1;
+	};
+
+	//hard boundaries, where the vertex cache order had to jump and all three vertices miss
+	std::vector<unsigned int> hard;
+	for (unsigned int t = 0; t < triangleCount; t++) {
+		if (misses(t) == 3) {
+			hard.push_back(t);
+		}
+	}
+	if (hard.empty() || hard[0] != 0) {
+		hard.insert(hard.begin(), 0);
+	}
+	hard.push_back(triangleCount);
+
+	//soft boundaries inside them, wherever the part so far is about as good for the cache as the whole
+	std::vector<unsigned int> clusters;
+	for (unsigned int h = 0; h + 1 < hard.size(); h++) {
+		unsigned int first = hard[h], end = hard[h + 1];
+		flush();
+		unsigned int total = 0;
+		for (unsigned int t = first; t < end; t++) {
+			total += misses(t);
+		}
+		float limit = static_cast<float>(total) / (end - first) * threshold;
+
+		flush();
+		clusters.push_back(first);
+		unsigned int clusterMisses = 0, clusterTriangles = 0;
+		for (unsigned int t = first; t < end; t++) {
+			clusterMisses += misses(t);
+			clusterTriangles++;
+			if (t + 1 < end && static_cast<float>(clusterMisses) / clusterTriangles <= limit) {
+				clusters.push_back(t + 1);
+				clusterMisses = 0;
+				clusterTriangles = 0;
+				flush();
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+	return clusters;
+}
+
+void MeshOptimizer::optimizeOverdraw(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, float threshold)
+{
+	unsigned int triangleCount = static_cast<unsigned int>(indices.size() / 3);
+	if (triangleCount == 0) {
+		return;
+	}
+	std::vector<unsigned int> clusters = overdrawClusters(vertices, indices, threshold);
+	unsigned int clusterCount = static_cast<unsigned int>(clusters.size() - 1);
+
+	//area weighted centroid and normal of every cluster and of the whole mesh
+	std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+	std::vector<float> areas(clusterCount, 0.0f);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (unsigned int c = 0; c < clusterCount; c++) {
+		for (unsigned int t = clusters[c]; t < clusters[c + 1]; t++) {
+			const glm::vec3& a = vertices[indices[t * 3]].Position;
+			const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+			const glm::vec3& p = vertices[indices[t * 3 + 2]].Position;
+			glm::vec3 normal = glm::cross(b - a, p - a);
+			float area = glm::length(normal);
+			centroids[c] += (a + b + p) / 3.0f * area;
+			normals[c] += normal;
+			areas[c] += area;
+		}
+		meshCentroid += centroids[c];
+		meshArea += areas[c];
+		if (areas[c] > 0.0f) {
+			centroids[c] /= areas[c];
+		}
+	}
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+
+	//clusters further out along their normal are in front of the others from most directions
+	std::vector<float> keys(clusterCount);
+	for (unsigned int c = 0; c < clusterCount; c++) {
+		float length = glm::length(normals[c]);
+		keys[c] = length > 0.0f ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0f;
+	}
+	std::vector<unsigned int> order(clusterCount);
+	for (unsigned int c = 0; c < clusterCount; c++) {
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&keys](unsigned int a, unsigned int b) {
+		return keys[a] > keys[b];
+	});
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (unsigned int c : order) {
+		result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	}
+	indices.swap(result);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	std::vector<unsigned int> remap(vertices.size(), UINT32_MAX);
+	std::vector<Vertex> result;
+	result.reserve(vertices.size());
+	for (unsigned int& index : indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = static_cast<unsigned int>(result.size());
+			result.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(result);
+}
+
+void MeshOptimizer::optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, float overdrawThreshold)
+{
+	optimizeVertexCache(indices, static_cast<unsigned int>(vertices.size()));
+	if (overdrawThreshold >= 1.0f) {
+		optimizeOverdraw(vertices, indices, overdrawThreshold);
+	}
+	optimizeVertexFetch(vertices, indices);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <vector>
+
+// post-transform cache the orders are tuned for and ACMR is measured with, a FIFO of this many vertices
+#define VERTEX_CACHE_SIZE 16
+// clusters of triangles may be this much worse for the vertex cache than the order they were cut from, in exchange
+// for drawing the outward facing ones first
+#define OVERDRAW_THRESHOLD 1.05f
+
+// reorders the triangles and vertices of meshes for the GPU, without changing what is drawn. Triangles are ordered
+// for the post-transform vertex cache with Tipsify (Sander, Nehab, Barczak: Fast Triangle Reordering for Vertex
+// Locality and Reduced Overdraw), optionally cut into clusters that are sorted so the ones facing outwards come
+// first and hide the ones behind them. Vertices are then stored in the order the triangles first use them.
+class MeshOptimizer
+{
+private:
+	static std::vector<unsigned int> overdrawClusters(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, float threshold);
+
+public:
+	// average number of vertices transformed per triangle by a FIFO cache of cacheSize vertices, between 0.5 for
+	// the best case of a large regular grid and 3 when no vertex is ever reused
+	static float acmr(const std::vector<unsigned int>& indices, unsigned int vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+	// reorders the triangles for a vertex cache of cacheSize vertices
+	static void optimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+	// sorts clusters of the triangles, cut where the vertex cache allows it, front to back as seen from outside.
+	// Call after optimizeVertexCache, threshold is how much worse the ACMR of a cluster may get
+	static void optimizeOverdraw(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, float threshold = OVERDRAW_THRESHOLD);
+
+	// stores the vertices in the order the triangles use them, unused ones are dropped
+	static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	// all of the above, overdraw only for a threshold of at least 1
+	static void optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, float overdrawThreshold = OVERDRAW_THRESHOLD);
+};
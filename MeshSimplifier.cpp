@@ -0,0 +1,644 @@
+#include "MeshSimplifier.h"
+#include "JobSystem.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <queue>
+#include <unordered_map>
+
+//bump when the simplification gives different results for the same input
+const glm::uint LOD_CACHE_VERSION = 3;
+const char LOD_CACHE_MAGIC[4] = { 'M', 'L', 'O', 'D' };
+//border edges of the mesh and its uv charts are protected by planes perpendicular to the surface with these weights
+const double LOD_BORDER_WEIGHT = 10.0;
+const double LOD_SEAM_WEIGHT = 1.0;
+//a level that doesn't get rid of at least this part of the triangles of the level before ends the chain
+const float LOD_MIN_REDUCTION = 0.1f;
+
+//FNV-1a
+static unsigned long long hashBytes(unsigned long long hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+namespace
+{
+	//symmetric 4x4 matrix, the sum of squared distances to a set of planes
+	struct Quadric
+	{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+		Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0)
+		{
+		}
+
+		//plane through point with the unit normal
+		Quadric(const glm::dvec3& normal, const glm::dvec3& point, double weight)
+		{
+			double a = normal.x, b = normal.y, c = normal.z, d = -glm::dot(normal, point);
+			a2 = weight * a * a; ab = weight * a * b; ac = weight * a * c; ad = weight * a * d;
+			b2 = weight * b * b; bc = weight * b * c; bd = weight * b * d;
+			c2 = weight * c * c; cd = weight * c * d;
+			d2 = weight * d * d;
+		}
+
+		Quadric& operator+=(const Quadric& q)
+		{
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+			b2 += q.b2; bc += q.bc; bd += q.bd;
+			c2 += q.c2; cd += q.cd;
+			d2 += q.d2;
+			return *this;
+		}
+
+		double error(const glm::dvec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+				+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+				+ c2 * z * z + 2 * cd * z
+				+ d2;
+			return std::max(e, 0.0);
+		}
+	};
+
+	//distance of p from the triangle abc, by the closest point of the triangle (Ericson, Real-Time Collision Detection)
+	double triangleDistance(const glm::dvec3& p, const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c)
+	{
+		glm::dvec3 ab = b - a, ac = c - a, ap = p - a;
+		double d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0 && d2 <= 0.0) {
+			return glm::length(ap);
+		}
+		glm::dvec3 bp = p - b;
+		double d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0 && d4 <= d3) {
+			return glm::length(bp);
+		}
+		double vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+			return glm::length(ap - ab * (d1 / (d1 - d3)));
+		}
+		glm::dvec3 cp = p - c;
+		double d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0 && d5 <= d6) {
+			return glm::length(cp);
+		}
+		double vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+			return glm::length(ap - ac * (d2 / (d2 - d6)));
+		}
+		double va = d3 * d6 - d5 * d4;
+		if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0) {
+			return glm::length(bp - (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))));
+		}
+		double denominator = 1.0 / (va + vb + vc);
+		return glm::length(ap - ab * (vb * denominator) - ac * (vc * denominator));
+	}
+
+	//largest distance of any of the points from the surface of the triangles
+	double surfaceDistance(const std::vector<glm::dvec3>& points, const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+	{
+		//a triangle whose bounding sphere is farther away than the closest triangle so far can't be any closer
+		std::vector<glm::dvec4> spheres;
+		for (unsigned int i = 0; i + 2 < indices.size(); i += 3) {
+			glm::dvec3 a(vertices[indices[i]].Position), b(vertices[indices[i + 1]].Position), c(vertices[indices[i + 2]].Position);
+			glm::dvec3 center = (a + b + c) / 3.0;
+			spheres.push_back(glm::dvec4(center, std::max(std::max(glm::length(a - center), glm::length(b - center)), glm::length(c - center))));
+		}
+		double largest = 0.0;
+		for (const glm::dvec3& p : points) {
+			double closest = DBL_MAX;
+			for (unsigned int t = 0; t < spheres.size() && closest > largest; t++) {
+				if (glm::length(p - glm::dvec3(spheres[t])) - spheres[t].w >= closest) {
+					continue;
+				}
+				closest = std::min(closest, triangleDistance(p, glm::dvec3(vertices[indices[t * 3]].Position),
+					glm::dvec3(vertices[indices[t * 3 + 1]].Position), glm::dvec3(vertices[indices[t * 3 + 2]].Position)));
+			}
+			largest = std::max(largest, closest);
+		}
+		return spheres.empty() ? 0.0 : largest;
+	}
+
+	//moving the vertices at position "from" onto position "to"
+	struct Collapse
+	{
+		double cost;
+		unsigned int from;
+		unsigned int to;
+		unsigned int fromVersion;
+		unsigned int toVersion;
+
+		bool operator>(const Collapse& other) const
+		{
+			return cost > other.cost;
+		}
+	};
+
+	struct Triangle
+	{
+		unsigned int v[3];
+		bool alive;
+	};
+
+	//state of one simplification. Vertices with the same position share a "point", the collapses work on points so
+	//the vertices split at uv seams and hard edges move together
+	class Simplification
+	{
+	private:
+		std::vector<Vertex> m_vertices;
+		std::vector<unsigned int> m_pointOf; //vertex -> point
+		std::vector<glm::dvec3> m_points;
+		std::vector<Quadric> m_quadrics;
+		std::vector<unsigned int> m_versions; //bumped whenever the triangles around a point change
+		std::vector<bool> m_pointAlive;
+		std::vector<std::vector<unsigned int>> m_trianglesOf; //point -> triangles, dead ones included
+		std::vector<Triangle> m_triangles;
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_heap;
+		unsigned int m_aliveTriangles;
+
+		glm::dvec3 position(unsigned int vertex) const
+		{
+			return m_points[m_pointOf[vertex]];
+		}
+
+		static unsigned long long edgeKey(unsigned int a, unsigned int b)
+		{
+			return a < b ? (static_cast<unsigned long long>(a) << 32) | b : (static_cast<unsigned long long>(b) << 32) | a;
+		}
+
+		void weld(const std::vector<Vertex>& vertices)
+		{
+			std::unordered_map<unsigned long long, unsigned int> pointOfPosition;
+			m_pointOf.resize(vertices.size());
+			for (unsigned int i = 0; i < vertices.size(); i++) {
+				glm::uvec3 bits;
+				std::memcpy(&bits, &vertices[i].Position, sizeof(bits));
+				unsigned long long key = hashBytes(14695981039346656037ULL, &bits, sizeof(bits));
+				auto it = pointOfPosition.find(key);
+				//a hash collision between different positions only costs a missed weld
+				if (it != pointOfPosition.end() && m_points[it->second] == glm::dvec3(vertices[i].Position)) {
+					m_pointOf[i] = it->second;
+					continue;
+				}
+				m_pointOf[i] = static_cast<unsigned int>(m_points.size());
+				pointOfPosition[key] = m_pointOf[i];
+				m_points.push_back(glm::dvec3(vertices[i].Position));
+			}
+		}
+
+		void addQuadrics()
+		{
+			m_quadrics.assign(m_points.size(), Quadric());
+			//first triangle and its two vertices of every edge between points, and whether the edge is shared
+			struct Edge
+			{
+				unsigned int triangle;
+				unsigned int a, b; //vertices of the triangle at the lower and the higher point
+				unsigned int uses;
+				bool seam;
+			};
+			std::unordered_map<unsigned long long, Edge> edges;
+			for (unsigned int t = 0; t < m_triangles.size(); t++) {
+				const Triangle& triangle = m_triangles[t];
+				glm::dvec3 p0 = position(triangle.v[0]), p1 = position(triangle.v[1]), p2 = position(triangle.v[2]);
+				glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+				double length = glm::length(normal);
+				if (length > 0.0) {
+					Quadric plane(normal / length, p0, 1.0);
+					for (int c = 0; c < 3; c++) {
+						m_quadrics[m_pointOf[triangle.v[c]]] += plane;
+					}
+				}
+				for (int c = 0; c < 3; c++) {
+					unsigned int v0 = triangle.v[c], v1 = triangle.v[(c + 1) % 3];
+					unsigned int p0 = m_pointOf[v0], p1 = m_pointOf[v1];
+					if (p0 > p1) {
+						std::swap(v0, v1);
+						std::swap(p0, p1);
+					}
+					auto it = edges.find(edgeKey(p0, p1));
+					if (it == edges.end()) {
+						edges[edgeKey(p0, p1)] = Edge{ t, v0, v1, 1, false };
+					}
+					else {
+						it->second.uses++;
+						it->second.seam = it->second.seam || it->second.a != v0 || it->second.b != v1;
+					}
+				}
+			}
+
+			//borders and seams get a plane through the edge, perpendicular to the triangle
+			for (auto it = edges.begin(); it != edges.end(); ++it) {
+				const Edge& edge = it->second;
+				if (edge.uses > 1 && !edge.seam) {
+					continue;
+				}
+				const Triangle& triangle = m_triangles[edge.triangle];
+				glm::dvec3 p0 = position(triangle.v[0]), p1 = position(triangle.v[1]), p2 = position(triangle.v[2]);
+				glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+				glm::dvec3 a = position(edge.a), b = position(edge.b);
+				glm::dvec3 perpendicular = glm::cross(b - a, normal);
+				double length = glm::length(perpendicular);
+				if (length <= 0.0) {
+					continue;
+				}
+				Quadric plane(perpendicular / length, a, edge.uses == 1 ? LOD_BORDER_WEIGHT : LOD_SEAM_WEIGHT);
+				m_quadrics[m_pointOf[edge.a]] += plane;
+				m_quadrics[m_pointOf[edge.b]] += plane;
+			}
+		}
+
+		//queues the cheaper direction of the edge between two points
+		void pushEdge(unsigned int a, unsigned int b)
+		{
+			Quadric sum = m_quadrics[a];
+			sum += m_quadrics[b];
+			double toB = sum.error(m_points[b]);
+			double toA = sum.error(m_points[a]);
+			if (toB <= toA) {
+				m_heap.push(Collapse{ toB, a, b, m_versions[a], m_versions[b] });
+			}
+			else {
+				m_heap.push(Collapse{ toA, b, a, m_versions[b], m_versions[a] });
+			}
+		}
+
+		void pushEdgesOf(unsigned int point)
+		{
+			std::vector<unsigned int> neighbours;
+			for (unsigned int t : m_trianglesOf[point]) {
+				const Triangle& triangle = m_triangles[t];
+				if (!triangle.alive) {
+					continue;
+				}
+				for (int c = 0; c < 3; c++) {
+					unsigned int other = m_pointOf[triangle.v[c]];
+					if (other != point) {
+						neighbours.push_back(other);
+					}
+				}
+			}
+			std::sort(neighbours.begin(), neighbours.end());
+			neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+			for (unsigned int other : neighbours) {
+				pushEdge(point, other);
+			}
+		}
+
+		bool contains(const Triangle& triangle, unsigned int point) const
+		{
+			return m_pointOf[triangle.v[0]] == point || m_pointOf[triangle.v[1]] == point || m_pointOf[triangle.v[2]] == point;
+		}
+
+		//false if the collapse would fold a triangle over or pinch the surface into a non manifold one
+		bool allowed(unsigned int from, unsigned int to) const
+		{
+			std::vector<unsigned int> fromNeighbours, toNeighbours;
+			for (unsigned int t : m_trianglesOf[from]) {
+				const Triangle& triangle = m_triangles[t];
+				if (!triangle.alive) {
+					continue;
+				}
+				for (int c = 0; c < 3; c++) {
+					fromNeighbours.push_back(m_pointOf[triangle.v[c]]);
+				}
+				if (contains(triangle, to)) {
+					continue;
+				}
+				glm::dvec3 p[3], moved[3];
+				for (int c = 0; c < 3; c++) {
+					p[c] = position(triangle.v[c]);
+					moved[c] = m_pointOf[triangle.v[c]] == from ? m_points[to] : p[c];
+				}
+				glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::dvec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+				double afterLength = glm::length(after);
+				if (afterLength <= 1e-12 * glm::length(before) || glm::dot(before, after) <= 0.2 * glm::length(before) * afterLength) {
+					return false;
+				}
+			}
+			for (unsigned int t : m_trianglesOf[to]) {
+				const Triangle& triangle = m_triangles[t];
+				if (triangle.alive) {
+					for (int c = 0; c < 3; c++) {
+						toNeighbours.push_back(m_pointOf[triangle.v[c]]);
+					}
+				}
+			}
+			//link condition: the two points may only share the (at most two) points opposite of their edge
+			std::sort(fromNeighbours.begin(), fromNeighbours.end());
+			fromNeighbours.erase(std::unique(fromNeighbours.begin(), fromNeighbours.end()), fromNeighbours.end());
+			std::sort(toNeighbours.begin(), toNeighbours.end());
+			toNeighbours.erase(std::unique(toNeighbours.begin(), toNeighbours.end()), toNeighbours.end());
+			std::vector<unsigned int> shared;
+			std::set_intersection(fromNeighbours.begin(), fromNeighbours.end(), toNeighbours.begin(), toNeighbours.end(), std::back_inserter(shared));
+			//shared includes from and to themselves
+			return shared.size() <= 4;
+		}
+
+		void collapse(unsigned int from, unsigned int to)
+		{
+			//vertices of "from" that sit on a removed triangle become that triangle's vertex of "to", which keeps
+			//their uv side. The others are moved copies of themselves
+			std::unordered_map<unsigned int, unsigned int> replacement;
+			for (unsigned int t : m_trianglesOf[from]) {
+				Triangle& triangle = m_triangles[t];
+				if (!triangle.alive || !contains(triangle, to)) {
+					continue;
+				}
+				unsigned int fromVertex = 0, toVertex = 0;
+				for (int c = 0; c < 3; c++) {
+					if (m_pointOf[triangle.v[c]] == from) {
+						fromVertex = triangle.v[c];
+					}
+					else if (m_pointOf[triangle.v[c]] == to) {
+						toVertex = triangle.v[c];
+					}
+				}
+				replacement[fromVertex] = toVertex;
+				triangle.alive = false;
+				m_aliveTriangles--;
+			}
+			for (unsigned int t : m_trianglesOf[from]) {
+				Triangle& triangle = m_triangles[t];
+				if (!triangle.alive) {
+					continue;
+				}
+				for (int c = 0; c < 3; c++) {
+					unsigned int vertex = triangle.v[c];
+					if (m_pointOf[vertex] != from) {
+						continue;
+					}
+					auto it = replacement.find(vertex);
+					if (it == replacement.end()) {
+						Vertex moved = m_vertices[vertex];
+						moved.Position = glm::vec3(m_points[to]);
+						m_vertices.push_back(moved);
+						m_pointOf.push_back(to);
+						it = replacement.emplace(vertex, static_cast<unsigned int>(m_vertices.size() - 1)).first;
+					}
+					triangle.v[c] = it->second;
+				}
+				m_trianglesOf[to].push_back(t);
+			}
+			m_trianglesOf[from].clear();
+			m_pointAlive[from] = false;
+			m_quadrics[to] += m_quadrics[from];
+			m_versions[to]++;
+			m_versions[from]++;
+			pushEdgesOf(to);
+		}
+
+	public:
+		Simplification(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+			: m_vertices(vertices), m_aliveTriangles(0)
+		{
+			weld(vertices);
+			m_trianglesOf.resize(m_points.size());
+			for (unsigned int i = 0; i + 2 < indices.size(); i += 3) {
+				Triangle triangle = { { indices[i], indices[i + 1], indices[i + 2] }, true };
+				unsigned int p0 = m_pointOf[triangle.v[0]], p1 = m_pointOf[triangle.v[1]], p2 = m_pointOf[triangle.v[2]];
+				//already degenerate, nothing to draw
+				if (p0 == p1 || p1 == p2 || p0 == p2) {
+					continue;
+				}
+				unsigned int t = static_cast<unsigned int>(m_triangles.size());
+				m_triangles.push_back(triangle);
+				m_trianglesOf[p0].push_back(t);
+				m_trianglesOf[p1].push_back(t);
+				m_trianglesOf[p2].push_back(t);
+			}
+			m_aliveTriangles = static_cast<unsigned int>(m_triangles.size());
+			m_versions.assign(m_points.size(), 0);
+			m_pointAlive.assign(m_points.size(), true);
+			addQuadrics();
+			for (unsigned int p = 0; p < m_points.size(); p++) {
+				pushEdgesOf(p);
+			}
+		}
+
+		void run(unsigned int targetTriangles)
+		{
+			while (m_aliveTriangles > targetTriangles && !m_heap.empty()) {
+				Collapse next = m_heap.top();
+				m_heap.pop();
+				//outdated, the neighbourhood of one of the points changed since it was queued
+				if (!m_pointAlive[next.from] || !m_pointAlive[next.to] || m_versions[next.from] != next.fromVersion || m_versions[next.to] != next.toVersion) {
+					continue;
+				}
+				if (!allowed(next.from, next.to)) {
+					continue;
+				}
+				collapse(next.from, next.to);
+			}
+		}
+
+		LodGeometry result() const
+		{
+			LodGeometry lod;
+			std::vector<unsigned int> remap(m_vertices.size(), UINT32_MAX);
+			for (const Triangle& triangle : m_triangles) {
+				if (!triangle.alive) {
+					continue;
+				}
+				for (int c = 0; c < 3; c++) {
+					unsigned int& index = remap[triangle.v[c]];
+					if (index == UINT32_MAX) {
+						index = static_cast<unsigned int>(lod.vertices.size());
+						lod.vertices.push_back(m_vertices[triangle.v[c]]);
+					}
+					lod.indices.push_back(index);
+				}
+			}
+			//the points that are left lie on the result, the removed ones tell how far the surface moved
+			std::vector<glm::dvec3> removed;
+			for (unsigned int p = 0; p < m_points.size(); p++) {
+				if (!m_pointAlive[p]) {
+					removed.push_back(m_points[p]);
+				}
+			}
+			lod.error = static_cast<float>(surfaceDistance(removed, lod.vertices, lod.indices));
+			return lod;
+		}
+	};
+}
+
+LodGeometry MeshSimplifier::simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, unsigned int targetIndexCount)
+{
+	Simplification simplification(vertices, indices);
+	simplification.run(targetIndexCount / 3);
+	return simplification.result();
+}
+
+unsigned long long MeshSimplifier::cacheKey(const Mesh& mesh, unsigned int levelCount)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	hash = hashBytes(hash, &LOD_CACHE_VERSION, sizeof(LOD_CACHE_VERSION));
+	hash = hashBytes(hash, &levelCount, sizeof(levelCount));
+	for (const Vertex& vertex : mesh.vertices) {
+		hash = hashBytes(hash, &vertex.Position, sizeof(vertex.Position));
+		hash = hashBytes(hash, &vertex.Normal, sizeof(vertex.Normal));
+		hash = hashBytes(hash, &vertex.TexCoords, sizeof(vertex.TexCoords));
+		hash = hashBytes(hash, &vertex.LightmapCoords, sizeof(vertex.LightmapCoords));
+	}
+	hash = hashBytes(hash, mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+	return hash;
+}
+
+bool MeshSimplifier::readCache(const std::string& path, std::vector<Mesh>& meshes, const std::vector<unsigned long long>& keys)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		return false;
+	}
+	//counts read from the file are checked against what is left of it, a truncated cache must not allocate more
+	std::streamoff fileSize = file.tellg();
+	file.seekg(0);
+	char magic[4];
+	glm::uint version = 0, meshCount = 0;
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char*>(&version), sizeof(version));
+	file.read(reinterpret_cast<char*>(&meshCount), sizeof(meshCount));
+	if (!file || !std::equal(magic, magic + 4, LOD_CACHE_MAGIC) || version != LOD_CACHE_VERSION || meshCount != meshes.size()) {
+		return false;
+	}
+	std::vector<std::vector<LodGeometry>> levels(meshes.size());
+	for (unsigned int m = 0; m < meshes.size(); m++) {
+		unsigned long long key = 0;
+		glm::uint levelCount = 0;
+		file.read(reinterpret_cast<char*>(&key), sizeof(key));
+		file.read(reinterpret_cast<char*>(&levelCount), sizeof(levelCount));
+		if (!file || key != keys[m] || levelCount >= MAX_LOD_LEVELS) {
+			return false;
+		}
+		levels[m].resize(levelCount);
+		for (LodGeometry& level : levels[m]) {
+			glm::uint vertexCount = 0, indexCount = 0;
+			file.read(reinterpret_cast<char*>(&level.error), sizeof(level.error));
+			file.read(reinterpret_cast<char*>(&vertexCount), sizeof(vertexCount));
+			file.read(reinterpret_cast<char*>(&indexCount), sizeof(indexCount));
+			if (!file || indexCount % 3 != 0
+				|| static_cast<unsigned long long>(vertexCount) * sizeof(Vertex) + static_cast<unsigned long long>(indexCount) * sizeof(unsigned int)
+				> static_cast<unsigned long long>(fileSize - file.tellg())) {
+				return false;
+			}
+			level.vertices.resize(vertexCount);
+			level.indices.resize(indexCount);
+			file.read(reinterpret_cast<char*>(level.vertices.data()), vertexCount * sizeof(Vertex));
+			file.read(reinterpret_cast<char*>(level.indices.data()), indexCount * sizeof(unsigned int));
+			//an index past the vertices would make the level read past its vertex buffer on the GPU
+			for (unsigned int index : level.indices) {
+				if (index >= vertexCount) {
+					return false;
+				}
+			}
+		}
+	}
+	if (!file) {
+		return false;
+	}
+	for (unsigned int m = 0; m < meshes.size(); m++) {
+		meshes[m].setLods(levels[m]);
+	}
+	return true;
+}
+
+void MeshSimplifier::writeCache(const std::string& path, const std::vector<Mesh>& meshes, const std::vector<unsigned long long>& keys)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cout << "WARNING::LOD:: could not write " << path << std::endl;
+		return;
+	}
+	glm::uint meshCount = static_cast<glm::uint>(meshes.size());
+	file.write(LOD_CACHE_MAGIC, sizeof(LOD_CACHE_MAGIC));
+	file.write(reinterpret_cast<const char*>(&LOD_CACHE_VERSION), sizeof(LOD_CACHE_VERSION));
+	file.write(reinterpret_cast<const char*>(&meshCount), sizeof(meshCount));
+	for (unsigned int m = 0; m < meshes.size(); m++) {
+		glm::uint levelCount = static_cast<glm::uint>(meshes[m].lodGeometry.size());
+		file.write(reinterpret_cast<const char*>(&keys[m]), sizeof(keys[m]));
+		file.write(reinterpret_cast<const char*>(&levelCount), sizeof(levelCount));
+		for (const LodGeometry& level : meshes[m].lodGeometry) {
+			glm::uint vertexCount = static_cast<glm::uint>(level.vertices.size());
+			glm::uint indexCount = static_cast<glm::uint>(level.indices.size());
+			file.write(reinterpret_cast<const char*>(&level.error), sizeof(level.error));
+			file.write(reinterpret_cast<const char*>(&vertexCount), sizeof(vertexCount));
+			file.write(reinterpret_cast<const char*>(&indexCount), sizeof(indexCount));
+			file.write(reinterpret_cast<const char*>(level.vertices.data()), vertexCount * sizeof(Vertex));
+			file.write(reinterpret_cast<const char*>(level.indices.data()), indexCount * sizeof(unsigned int));
+		}
+	}
+}
+
+void MeshSimplifier::buildLods(std::vector<Mesh>& meshes, const std::string& cachePath, unsigned int levelCount)
+{
+	levelCount = std::min(std::max(levelCount, 1u), static_cast<unsigned int>(MAX_LOD_LEVELS));
+	std::vector<unsigned long long> keys;
+	for (const Mesh& mesh : meshes) {
+		keys.push_back(cacheKey(mesh, levelCount));
+	}
+	if (readCache(cachePath, meshes, keys)) {
+		std::cout << "LOD:: loaded the levels of " << meshes.size() << " meshes from " << cachePath << std::endl;
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	//every level is simplified from the one before, the meshes are independent of each other
+	std::vector<std::vector<LodGeometry>> levels(meshes.size());
+	JobSystem::instance().parallelFor(static_cast<unsigned int>(meshes.size()), [&meshes, &levels, levelCount](unsigned int m) {
+		const std::vector<Vertex>* vertices = &meshes[m].vertices;
+		const std::vector<unsigned int>* indices = &meshes[m].indices;
+		float error = 0.0f;
+		std::vector<glm::dvec3> fullPoints;
+		for (const Vertex& vertex : meshes[m].vertices) {
+			fullPoints.push_back(glm::dvec3(vertex.Position));
+		}
+		for (unsigned int level = 1; level < levelCount; level++) {
+			unsigned int target = static_cast<unsigned int>(indices->size() / 6 * 3);
+			LodGeometry lod = simplify(*vertices, *indices, target);
+			if (lod.indices.empty() || lod.indices.size() > indices->size() * (1.0f - LOD_MIN_REDUCTION)) {
+				break;
+			}
+			//simplify measures against the level before, the error of a level is how far it is from the full mesh
+			if (level > 1) {
+				lod.error = static_cast<float>(surfaceDistance(fullPoints, lod.vertices, lod.indices));
+			}
+			//selectLod expects the errors to grow with the level
+			error = std::max(error, lod.error);
+			lod.error = error;
+			//far instances are the most numerous, their levels get the same ordering as the full meshes
+			MeshOptimizer::optimize(lod.vertices, lod.indices);
+			levels[m].push_back(std::move(lod));
+			vertices = &levels[m].back().vertices;
+			indices = &levels[m].back().indices;
+		}
+	});
+
+	unsigned int triangles = 0, lodTriangles = 0;
+	for (unsigned int m = 0; m < meshes.size(); m++) {
+		meshes[m].setLods(levels[m]);
+		triangles += static_cast<unsigned int>(meshes[m].indices.size() / 3);
+		for (const LodGeometry& level : levels[m]) {
+			lodTriangles += static_cast<unsigned int>(level.indices.size() / 3);
+		}
+	}
+	float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "LOD:: simplified " << meshes.size() << " meshes (" << triangles << " triangles) into " << lodTriangles
+		<< " triangles of coarser levels in " << milliseconds << " ms" << std::endl;
+	writeCache(cachePath, meshes, keys);
+}
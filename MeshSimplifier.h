@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <string>
+#include <vector>
+
+// builds the levels of detail of meshes by collapsing edges in the order of their quadric error (Garland-Heckbert).
+// A vertex always collapses onto one of its neighbours, so every vertex of a level is an original vertex, only
+// moved. Triangles keep their texture and lightmap coords. Borders of the mesh and of its uv charts are weighted so
+// they keep their shape.
+class MeshSimplifier
+{
+private:
+	static unsigned long long cacheKey(const Mesh& mesh, unsigned int levelCount);
+	static bool readCache(const std::string& path, std::vector<Mesh>& meshes, const std::vector<unsigned long long>& keys);
+	static void writeCache(const std::string& path, const std::vector<Mesh>& meshes, const std::vector<unsigned long long>& keys);
+
+public:
+	// collapses edges until at most targetIndexCount indices are left or nothing can be collapsed without folding
+	// a triangle over. error of the result is the largest distance of a vertex of the input from its surface
+	static LodGeometry simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, unsigned int targetIndexCount);
+
+	// gives every mesh up to levelCount levels (the full mesh included), each with about half the triangles of the
+	// one before. Levels come from cachePath if it was written for the same geometry, they are built on all cores
+	// and written there otherwise. Call after LightmapBaker::unwrap, the levels keep the lightmap coords
+	static void buildLods(std::vector<Mesh>& meshes, const std::string& cachePath, unsigned int levelCount = MAX_LOD_LEVELS);
+};
@@ -19,87 +19,294 @@
 //own includes
 #include "shader.h"
 #include "Mesh.h"
+#include "MeshSimplifier.h"
+#include "MeshCache.h"
+#include "AnimationBaker.h"
+#include "AssetArchive.h"
+#include "MeshOptimizer.h"
+#include "JobSystem.h"
+#include "TextureManager.h"
 
 //cpp includes
 #include <string>
 #include <vector>
 #include <iostream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
 using namespace std;
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
-
 class Model
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<TextureHandle> textureHandles;	// keeps the textures of the materials alive, they are shared through the TextureManager
+    vector<Material> materials;	// one per material in the file, resolved once so meshes sharing a material share its ID
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    // the largest error of every level of detail over all meshes, an instance draws all its meshes at the same level
+    vector<float> lodErrors;
+    glm::vec4 bounds = glm::vec4(0.0f); // bounding sphere of all meshes in model space, over all frames of the clips
+    // the clips baked into animationTexture, which every material of the model samples as boneMatrices. Empty for a
+    // model without a skeleton
+    vector<AnimationClip> clips;
+    GpuHandle animationTexture;
 
     // constructor, expects a filepath to a 3D model.
     Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
     {
-        loadModel(path);
+        CookedModel cooked;
+        cook(path, cooked, cout);
+        upload(path, cooked);
+    }
+
+    // loads the models at paths at once: the files are cooked side by side on the job system, each spreading its
+    // meshes over the workers too. Only the uploads, and with them every GL call, run on this thread in order of paths
+    static vector<Model> loadAll(const vector<string>& paths, bool gamma = false)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        vector<CookedModel> cooked(paths.size());
+        // printed in order afterwards, instead of interleaved by the workers
+        vector<string> logs(paths.size());
+        JobSystem::instance().parallelFor(static_cast<unsigned int>(paths.size()), [&paths, &cooked, &logs](unsigned int i) {
+            std::ostringstream log;
+            cook(paths[i], cooked[i], log);
+            logs[i] = log.str();
+        });
+        double cookMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        vector<Model> models;
+        models.reserve(paths.size());
+        for (unsigned int i = 0; i < paths.size(); i++)
+        {
+            cout << logs[i];
+            models.push_back(Model());
+            models.back().gammaCorrection = gamma;
+            models.back().upload(paths[i], cooked[i]);
+            // the CPU copy moved into the meshes, what is left is only the empty shell
+            cooked[i] = CookedModel();
+        }
+        double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        cout << "MESH:: loaded " << paths.size() << " models in " << totalMs << " ms, " << cookMs << " ms of it cooking on "
+            << JobSystem::instance().getThreadCount() + 1 << " threads" << endl;
+        return models;
+    }
+
+    // true if the model has clips to play, draw it with a SHADER_SKINNED variant then
+    bool animated() const
+    {
+        return !clips.empty();
+    }
+
+    // index of the clip called name, -1 if there is none
+    int findClip(const string& name) const
+    {
+        for (unsigned int i = 0; i < clips.size(); i++)
+        {
+            if (clips[i].name == name)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // what an instance passes to Submit or StaticBatch::add to play clip, looping. speed scales the time and
+    // timeOffset (in seconds) shifts it, so instances of the same clip don't move in lockstep. The time itself is the
+    // "animationTime" uniform of the shader, the same for all instances. Returns the bind pose for a clip that doesn't exist
+    glm::vec4 animationOf(unsigned int clip, float speed = 1.0f, float timeOffset = 0.0f) const
+    {
+        if (clip >= clips.size())
+            return glm::vec4(0.0f);
+        return glm::vec4(static_cast<float>(clips[clip].firstFrame), static_cast<float>(clips[clip].frameCount), clips[clip].framesPerSecond * speed, timeOffset);
+    }
+
+    // waits for the textures of the model to stream in completely, see TextureManager::finish
+    void finishTextures()
+    {
+        for (unsigned int i = 0; i < textureHandles.size(); i++)
+            TextureManager::instance().finish(textureHandles[i]);
+    }
+
+    // frees the CPU copies of the geometry of all meshes, see Mesh::releaseGeometry
+    void releaseGeometry()
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].releaseGeometry();
+    }
+
+    // draws the model, and thus all its meshes, with the program in use
+    void Draw()
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].Draw();
+    }
+
+    // queues all meshes of the model for drawing, at level of detail lod (see selectLod) and posed by animation (see
+    // animationOf)
+    void Submit(RenderQueue& queue, Shader& shader, const glm::mat4& model, unsigned int pass = PASS_OPAQUE, const glm::vec4& lightmapRect = glm::vec4(0.0f), unsigned int lod = 0,
+        const glm::vec4& animation = glm::vec4(0.0f))
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].Submit(queue, shader, model, pass, lightmapRect, lod, animation);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader& shader)
+    // simplifies the meshes into levels of detail, or loads them from cachePath. Call after LightmapBaker::unwrap
+    void buildLods(const string& cachePath)
     {
+        MeshSimplifier::buildLods(meshes, cachePath);
+        lodErrors.assign(1, 0.0f);
         for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        {
+            for (unsigned int level = 1; level < meshes[i].lods.size(); level++)
+            {
+                if (level >= lodErrors.size())
+                    lodErrors.push_back(0.0f);
+                lodErrors[level] = std::max(lodErrors[level], meshes[i].lods[level].error);
+            }
+        }
+        // a mesh with fewer levels draws its coarsest one, whose error is below the model's
+        for (unsigned int level = 1; level < lodErrors.size(); level++)
+            lodErrors[level] = std::max(lodErrors[level], lodErrors[level - 1]);
+    }
+
+    // level of detail of an instance at transform model, current is the level it was drawn with last time
+    unsigned int selectLod(const glm::mat4& model, const LodView& view, unsigned int current) const
+    {
+        if (lodErrors.size() <= 1)
+            return 0;
+        float scale = std::max(std::max(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1]))), glm::length(glm::vec3(model[2])));
+        glm::vec4 worldBounds(glm::vec3(model * glm::vec4(glm::vec3(bounds), 1.0f)), bounds.w * scale);
+        // the errors are in model units
+        LodView scaled = view;
+        scaled.pixelsPerUnit *= scale;
+        return ::selectLod(lodErrors.data(), static_cast<unsigned int>(lodErrors.size()), worldBounds, scaled, current);
     }
 
 private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const& path)
+    Model() : gammaCorrection(false)
     {
-        // read file via ASSIMP
+    }
+
+    // reads a model with supported ASSIMP extensions from file into cooked, without touching any GL state, so models
+    // can be cooked on any thread. The import is cooked into a .mesh file next to it, later runs map that instead as
+    // long as the source is unchanged. Skeletal clips are baked into the cooked model as well, see AnimationBaker
+    static void cook(string const& path, CookedModel& cooked, std::ostream& log)
+    {
+        const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+        string cachePath = path.substr(0, path.find_last_of('.')) + ".mesh";
+
+        // a packed model doesn't need its source, which isn't even read then
+        unsigned long long key = 0;
+        bool packed = AssetArchive::instance().contains(cachePath);
+        bool hasKey = !packed && MeshCache::sourceKey(path, importFlags, key);
+        if ((packed || hasKey) && MeshCache::read(cachePath, key, cooked))
+        {
+            log << "MESH:: loaded " << cooked.meshes.size() << " meshes of " << path << " from " << cachePath << endl;
+            return;
+        }
+        cooked = CookedModel();
+        // read file via ASSIMP, one importer per model so models import side by side
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, importFlags);
         // check for errors
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            log << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
+        for (unsigned int i = 0; i < scene->mNumMaterials; i++)
+            cooked.materials.push_back(cookMaterial(scene->mMaterials[i]));
+        // collect ASSIMP's meshes from the root node recursively, then convert them in parallel
+        AnimationBaker skeleton(scene);
+        if (skeleton.boneCount() > MAX_BONES)
+            log << "WARNING::MESH:: " << path << " has " << skeleton.boneCount() << " bones, only the first " << MAX_BONES << " are animated" << endl;
+        vector<const aiMesh*> sceneMeshes;
+        processNode(scene->mRootNode, scene, sceneMeshes);
+        cooked.meshes.resize(sceneMeshes.size());
+        JobSystem::instance().parallelFor(static_cast<unsigned int>(sceneMeshes.size()), [&sceneMeshes, &cooked, &skeleton](unsigned int m) {
+            cooked.meshes[m] = processMesh(sceneMeshes[m], skeleton);
+        });
+        optimizeMeshes(path, cooked, log);
+        // sampled from the optimized vertices, which the bounds of the clips are taken from
+        cooked.animation = skeleton.bake(cooked.meshes);
+        if (!cooked.animation.clips.empty())
+            log << "MESH:: baked " << cooked.animation.clips.size() << " clips of " << cooked.animation.boneCount << " bones of " << path << " into "
+                << cooked.animation.width() << "x" << cooked.animation.height() << " texels" << endl;
+        if (hasKey)
+            MeshCache::write(cachePath, key, cooked);
+    }
+
+    // turns cooked into the materials and meshes of the model, which uploads them. GL context thread only
+    void upload(string const& path, CookedModel& cooked)
+    {
         // retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
+        // the materials bind the baked clips along with their textures, so it has to exist before them
+        clips = cooked.animation.clips;
+        if (animated())
+            uploadAnimation(cooked.animation);
+        // resolve all materials up front
+        for (unsigned int i = 0; i < cooked.materials.size(); i++)
+            materials.push_back(loadMaterial(cooked.materials[i]));
+        for (unsigned int i = 0; i < cooked.meshes.size(); i++)
+            meshes.push_back(Mesh(std::move(cooked.meshes[i].vertices), std::move(cooked.meshes[i].indices), materials[cooked.meshes[i].material]));
+        vector<Vertex> vertices;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            vertices.insert(vertices.end(), meshes[i].vertices.begin(), meshes[i].vertices.end());
+        bounds = animated() ? cooked.animation.bounds : boundingSphere(vertices);
+    }
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+    // one texel per row of the skinning matrix of every bone, one line per frame. Fetched unfiltered, the vertex
+    // shader blends the frames itself
+    void uploadAnimation(const BakedAnimation& animation)
+    {
+        GLint maxSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        if (static_cast<GLint>(animation.height()) > maxSize)
+            cout << "WARNING::MESH:: the " << animation.height() << " frames of the clips of " << directory << " exceed the texture size of " << maxSize << endl;
+        animationTexture = GpuResources::instance().create(GPU_TEXTURE, GPU_TEXTURES);
+        glBindTexture(GL_TEXTURE_2D, animationTexture.id());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, animation.width(), animation.height(), 0, GL_RGBA, GL_FLOAT, animation.texels.data());
+        animationTexture.setBytes(animation.texels.size() * sizeof(glm::vec4));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene)
+    // processes a node in a recursive fashion. Collects each individual mesh located at the node and repeats this process on its children nodes (if any).
+    static void processNode(const aiNode* node, const aiScene* scene, vector<const aiMesh*>& sceneMeshes)
     {
         // process each mesh located at the current node
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
+        // after we've collected all of the meshes (if any) we then recursively process each of the children nodes
         for (unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, sceneMeshes);
         }
 
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    // converts one of ASSIMP's meshes with the weights of its bones in skeleton, only reads the scene so meshes can be
+    // converted side by side
+    static CookedMesh processMesh(const aiMesh* mesh, const AnimationBaker& skeleton)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
-
+        CookedMesh cooked;
+        vector<Vertex>& vertices = cooked.vertices;
+        vector<unsigned int>& indices = cooked.indices;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
         // walk through each of the mesh's vertices
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex vertex;
+            Vertex vertex = {};
             glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
             // positions
             vector.x = mesh->mVertices[i].x;
@@ -136,114 +343,105 @@ private:
             }
             else
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            // only filled in for lightmapped models
+            vertex.LightmapCoords = glm::vec2(0.0f, 0.0f);
 
             vertices.push_back(vertex);
         }
+        skeleton.addWeights(mesh, vertices);
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
         for (unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
+            const aiFace& face = mesh->mFaces[i];
             // retrieve all indices of the face and store them in the indices vector
             for (unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
-        // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
-        // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
-        // Same applies to other texture as the following list summarizes:
-        // diffuse: texture_diffuseN
-        // specular: texture_specularN
-        // normal: texture_normalN
+        cooked.material = mesh->mMaterialIndex;
+        return cooked;
+    }
 
+    // reorders the triangles and vertices of every mesh for the GPU, see MeshOptimizer
+    static void optimizeMeshes(string const& path, CookedModel& cooked, std::ostream& log)
+    {
+        float missesBefore = 0.0f, missesAfter = 0.0f;
+        unsigned int triangles = 0;
+        vector<float> acmrBefore(cooked.meshes.size()), acmrAfter(cooked.meshes.size());
+        JobSystem::instance().parallelFor(static_cast<unsigned int>(cooked.meshes.size()), [&cooked, &acmrBefore, &acmrAfter](unsigned int m) {
+            CookedMesh& mesh = cooked.meshes[m];
+            acmrBefore[m] = MeshOptimizer::acmr(mesh.indices, static_cast<unsigned int>(mesh.vertices.size()));
+            MeshOptimizer::optimize(mesh.vertices, mesh.indices);
+            acmrAfter[m] = MeshOptimizer::acmr(mesh.indices, static_cast<unsigned int>(mesh.vertices.size()));
+        });
+        for (unsigned int m = 0; m < cooked.meshes.size(); m++)
+        {
+            unsigned int count = static_cast<unsigned int>(cooked.meshes[m].indices.size() / 3);
+            missesBefore += acmrBefore[m] * count;
+            missesAfter += acmrAfter[m] * count;
+            triangles += count;
+        }
+        if (triangles > 0)
+            log << "MESH:: optimized " << cooked.meshes.size() << " meshes of " << path << " (" << triangles << " triangles), ACMR "
+                << missesBefore / triangles << " -> " << missesAfter / triangles << endl;
+    }
+
+    // the textures a material references, by the sampler names of the shaders. Each diffuse texture should be named
+    // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_TEXTURES_PER_TYPE. 
+    // Same applies to other texture as the following list summarizes:
+    // diffuse: texture_diffuseN
+    // specular: texture_specularN
+    // normal: texture_normalN
+    static vector<TextureReference> cookMaterial(const aiMaterial* material)
+    {
+        vector<TextureReference> textures;
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        cookMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        cookMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        cookMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        cookMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", textures);
+        return textures;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+    static void cookMaterialTextures(const aiMaterial* mat, aiTextureType type, string typeName, vector<TextureReference>& textures)
     {
-        vector<Texture> textures;
         for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if (!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
-            }
+            textures.push_back(TextureReference{ typeName, str.C_Str() });
         }
-        return textures;
     }
-};
 
-
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
-{
-    string filename = string(path);
-    filename = directory + '/' + filename;
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    // takes the textures of a material from the TextureManager and assigns their texture units. Colour textures are
+    // sRGB for a gamma corrected model, normal maps are cooked as such. The clips of an animated model come along
+    Material loadMaterial(const vector<TextureReference>& references)
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        vector<Texture> textures;
+        for (unsigned int i = 0; i < references.size(); i++)
+        {
+            bool srgb = gammaCorrection && references[i].type == "texture_diffuse";
+            bool normalMap = references[i].type == "texture_normal";
+            TextureHandle handle = TextureManager::instance().load(directory + '/' + references[i].path, srgb, normalMap);
+            Texture texture;
+            texture.id = handle.id();
+            texture.type = references[i].type;
+            texture.path = references[i].path;
+            texture.handle = handle;
+            textures.push_back(texture);
+            textureHandles.push_back(handle);
+        }
+        if (animated())
+        {
+            Texture texture;
+            texture.id = animationTexture.id();
+            texture.type = "bone_matrices";
+            texture.path = directory;
+            textures.push_back(texture);
+        }
+        return Material(textures);
     }
-
-    return textureID;
-}
+};
 #endif
\ No newline at end of file
@@ -0,0 +1,505 @@
+#include "RegionProxies.h"
+#include "JobSystem.h"
+
+#include <glad/glad.h>
+#include <glm/glm/gtc/matrix_transform.hpp>
+#include <glm/glm/gtc/type_precision.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+//bump when the proxies come out different for the same input
+const glm::uint HLOD_CACHE_VERSION = 2;
+const char HLOD_CACHE_MAGIC[4] = { 'H', 'L', 'O', 'D' };
+//the face texture has a tile per face of the bounding box, in a grid of 3 by 2
+const unsigned int HLOD_FACE_COLUMNS = 3;
+const unsigned int HLOD_FACE_ROWS = 2;
+//a face closer than this to a plane or an edge of another box counts as lying on it, in world units
+const float HLOD_EPSILON = 1e-3f;
+
+//FNV-1a
+static unsigned long long hashBytes(unsigned long long hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static float maxScale(const glm::mat4& transform)
+{
+	return std::max(std::max(glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1]))), glm::length(glm::vec3(transform[2])));
+}
+
+//world space box of an instance, the transforms only translate and scale
+static void instanceBox(const glm::mat4& transform, const glm::vec3& boxMinimum, const glm::vec3& boxMaximum, glm::vec3& minimum, glm::vec3& maximum)
+{
+	glm::vec3 a = glm::vec3(transform * glm::vec4(boxMinimum, 1.0f));
+	glm::vec3 b = glm::vec3(transform * glm::vec4(boxMaximum, 1.0f));
+	minimum = glm::min(a, b);
+	maximum = glm::max(a, b);
+}
+
+RegionProxies::RegionProxies(const std::vector<glm::mat4>& transforms, const glm::vec2& regionSize)
+	: m_boxMinimum(0.0f), m_boxMaximum(0.0f), m_texelSize(0.0f)
+{
+	if (transforms.empty()) {
+		return;
+	}
+	glm::vec2 minimum(transforms[0][3].x, transforms[0][3].z);
+	for (const glm::mat4& transform : transforms) {
+		minimum = glm::min(minimum, glm::vec2(transform[3].x, transform[3].z));
+	}
+	//regions are numbered in the order their first instance comes up
+	std::map<std::pair<int, int>, unsigned int> regionOfCell;
+	m_regionOf.resize(transforms.size());
+	for (unsigned int i = 0; i < transforms.size(); i++) {
+		glm::vec2 cell = glm::floor((glm::vec2(transforms[i][3].x, transforms[i][3].z) - minimum) / regionSize);
+		std::pair<int, int> key(static_cast<int>(cell.x), static_cast<int>(cell.y));
+		auto it = regionOfCell.find(key);
+		if (it == regionOfCell.end()) {
+			it = regionOfCell.insert(std::make_pair(key, static_cast<unsigned int>(m_regions.size()))).first;
+			m_regions.push_back(Region{ std::vector<unsigned int>(), glm::vec4(0.0f), nullptr, 0 });
+		}
+		m_regionOf[i] = it->second;
+		m_regions[it->second].instances.push_back(i);
+	}
+}
+
+RegionProxies::~RegionProxies()
+{
+}
+
+void RegionProxies::capture(std::vector<Mesh>& meshes, Shader& captureShader)
+{
+	const int width = HLOD_FACE_COLUMNS * HLOD_FACE_TILE_SIZE;
+	const int height = HLOD_FACE_ROWS * HLOD_FACE_TILE_SIZE;
+	m_texture = GpuResources::instance().create(GPU_TEXTURE, GPU_RENDER_TARGETS);
+	glBindTexture(GL_TEXTURE_2D, m_texture.id());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	m_texture.setBytes(static_cast<size_t>(width) * height * 4 * 4 / 3); //with the mip chain
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	//down to one texel per face, tiles are a power of two and start on multiples of their size
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<int>(std::log2(static_cast<float>(HLOD_FACE_TILE_SIZE))));
+
+	//both only live through the capture, they are deleted with their handles at the end
+	GpuHandle framebuffer = GpuResources::instance().create(GPU_FRAMEBUFFER, GPU_RENDER_TARGETS);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id());
+	GpuHandle depthBuffer = GpuResources::instance().create(GPU_RENDERBUFFER, GPU_RENDER_TARGETS);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer.id());
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	depthBuffer.setBytes(static_cast<size_t>(width) * height * 4);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture.id(), 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer.id());
+	//the GBUFFER variant writes light, albedo and normal, only the albedo is kept
+	GLenum attachments[] = { GL_NONE, GL_COLOR_ATTACHMENT0 };
+	glDrawBuffers(2, attachments);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "ERROR::HLOD:: capture framebuffer is not complete" << std::endl;
+	}
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLboolean blend = glIsEnabled(GL_BLEND);
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+	const float empty[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	glClearBufferfv(GL_COLOR, 1, empty);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	captureShader.use();
+	captureShader.setMat4("model", glm::mat4(1.0f));
+	captureShader.setMat4("view", glm::mat4(1.0f));
+	captureShader.setVec4("lightmapRect", glm::vec4(0.0f));
+	glm::vec3 extent = glm::max(m_boxMaximum - m_boxMinimum, glm::vec3(1e-6f));
+	for (int chart = 0; chart < 6; chart++) {
+		//looks at the face from outside the box, u and v of the face become x and y of the tile, the depth runs
+		//from the face inwards
+		int axis = chart / 2;
+		int uAxis = axis == 0 ? 2 : 0;
+		int vAxis = axis == 1 ? 2 : 1;
+		bool negative = (chart & 1) != 0;
+		glm::mat4 projection(0.0f);
+		projection[uAxis][0] = 2.0f / extent[uAxis];
+		projection[3][0] = -2.0f * m_boxMinimum[uAxis] / extent[uAxis] - 1.0f;
+		projection[vAxis][1] = 2.0f / extent[vAxis];
+		projection[3][1] = -2.0f * m_boxMinimum[vAxis] / extent[vAxis] - 1.0f;
+		//a little inside the near and far plane so the surfaces on the box itself are not clipped
+		projection[axis][2] = (negative ? 1.9f : -1.9f) / extent[axis];
+		projection[3][2] = (negative ? -m_boxMinimum[axis] : m_boxMaximum[axis]) * 1.9f / extent[axis] - 0.95f;
+		projection[3][3] = 1.0f;
+		captureShader.setMat4("projection", projection);
+		glViewport((chart % HLOD_FACE_COLUMNS) * HLOD_FACE_TILE_SIZE, (chart / HLOD_FACE_COLUMNS) * HLOD_FACE_TILE_SIZE, HLOD_FACE_TILE_SIZE, HLOD_FACE_TILE_SIZE);
+		for (Mesh& mesh : meshes) {
+			mesh.Draw();
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	if (blend) {
+		glEnable(GL_BLEND);
+	}
+
+	//the box shows through where the model leaves gaps, those texels get the color of the nearest covered ones
+	std::vector<glm::u8vec4> texels(width * height);
+	glBindTexture(GL_TEXTURE_2D, m_texture.id());
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+	for (bool filled = true; filled;) {
+		filled = false;
+		std::vector<glm::u8vec4> source = texels;
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				if (source[y * width + x].a != 0) {
+					continue;
+				}
+				glm::uvec4 sum(0);
+				unsigned int count = 0;
+				for (int dy = -1; dy <= 1; dy++) {
+					for (int dx = -1; dx <= 1; dx++) {
+						int nx = x + dx, ny = y + dy;
+						//never across the border of a tile
+						if (nx < 0 || ny < 0 || nx >= width || ny >= height || nx / HLOD_FACE_TILE_SIZE != x / HLOD_FACE_TILE_SIZE || ny / HLOD_FACE_TILE_SIZE != y / HLOD_FACE_TILE_SIZE) {
+							continue;
+						}
+						const glm::u8vec4& neighbour = source[ny * width + nx];
+						if (neighbour.a != 0) {
+							sum += glm::uvec4(neighbour);
+							count++;
+						}
+					}
+				}
+				if (count > 0) {
+					texels[y * width + x] = glm::u8vec4(sum / count);
+					filled = true;
+				}
+			}
+		}
+	}
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+//neighbours are the instances whose boxes may touch the boxes of the region's own, see build
+LodGeometry RegionProxies::buildProxy(const Region& region, const std::vector<unsigned int>& neighbours, const std::vector<glm::mat4>& transforms,
+	const std::vector<glm::vec4>& lightmapRects, const LightmapCharts& charts) const
+{
+	const glm::vec2 atlasSize(HLOD_FACE_COLUMNS * HLOD_FACE_TILE_SIZE, HLOD_FACE_ROWS * HLOD_FACE_TILE_SIZE);
+	glm::vec3 extent = glm::max(m_boxMaximum - m_boxMinimum, glm::vec3(1e-6f));
+	glm::vec3 center(region.bounds);
+	LodGeometry proxy;
+	proxy.error = 0.0f;
+	for (unsigned int instance : region.instances) {
+		glm::vec3 minimum, maximum;
+		instanceBox(transforms[instance], m_boxMinimum, m_boxMaximum, minimum, maximum);
+		glm::mat4 toModel = glm::inverse(transforms[instance]);
+		glm::vec4 rect = lightmapRects.empty() ? glm::vec4(1.0f, 1.0f, 0.0f, 0.0f) : lightmapRects[instance];
+		for (int chart = 0; chart < 6; chart++) {
+			//nothing ever looks at the bottom, and a face without a cell in the lightmap has no light to show
+			if (chart == 3 || (!lightmapRects.empty() && !charts.hasFace(chart))) {
+				continue;
+			}
+			int axis = chart / 2;
+			int uAxis = axis == 0 ? 2 : 0;
+			int vAxis = axis == 1 ? 2 : 1;
+			bool negative = (chart & 1) != 0;
+			float plane = negative ? minimum[axis] : maximum[axis];
+
+			//the part of the face that is not inside another box. Boxes that overlap it from one side take it
+			//up to the middle of the overlap, so two overlapping faces meet instead of fighting over the same pixels
+			float u0 = minimum[uAxis], u1 = maximum[uAxis];
+			for (unsigned int other : neighbours) {
+				if (u0 >= u1) {
+					break;
+				}
+				if (other == instance) {
+					continue;
+				}
+				glm::vec3 otherMinimum, otherMaximum;
+				instanceBox(transforms[other], m_boxMinimum, m_boxMaximum, otherMinimum, otherMaximum);
+				if (plane < otherMinimum[axis] - HLOD_EPSILON || plane > otherMaximum[axis] + HLOD_EPSILON ||
+					otherMinimum[vAxis] > minimum[vAxis] + HLOD_EPSILON || otherMaximum[vAxis] < maximum[vAxis] - HLOD_EPSILON) {
+					continue;
+				}
+				if (otherMinimum[uAxis] <= u0 + HLOD_EPSILON && otherMaximum[uAxis] >= u1 - HLOD_EPSILON) {
+					u1 = u0;
+				}
+				else if (otherMinimum[uAxis] > u0 && otherMinimum[uAxis] < u1 && otherMaximum[uAxis] >= u1 - HLOD_EPSILON) {
+					u1 = std::min(u1, (otherMinimum[uAxis] + maximum[uAxis]) * 0.5f);
+				}
+				else if (otherMaximum[uAxis] > u0 && otherMaximum[uAxis] < u1 && otherMinimum[uAxis] <= u0 + HLOD_EPSILON) {
+					u0 = std::max(u0, (minimum[uAxis] + otherMaximum[uAxis]) * 0.5f);
+				}
+			}
+			if (u1 - u0 <= HLOD_EPSILON) {
+				continue;
+			}
+
+			glm::vec3 normal(0.0f), uDirection(0.0f), vDirection(0.0f);
+			normal[axis] = negative ? -1.0f : 1.0f;
+			uDirection[uAxis] = 1.0f;
+			vDirection[vAxis] = 1.0f;
+			const float corners[4][2] = { { u0, minimum[vAxis] }, { u1, minimum[vAxis] }, { u1, maximum[vAxis] }, { u0, maximum[vAxis] } };
+			unsigned int baseVertex = static_cast<unsigned int>(proxy.vertices.size());
+			for (int c = 0; c < 4; c++) {
+				glm::vec3 position;
+				position[axis] = plane;
+				position[uAxis] = corners[c][0];
+				position[vAxis] = corners[c][1];
+				glm::vec3 modelPosition = glm::vec3(toModel * glm::vec4(position, 1.0f));
+				glm::vec2 local((modelPosition[uAxis] - m_boxMinimum[uAxis]) / extent[uAxis], (modelPosition[vAxis] - m_boxMinimum[vAxis]) / extent[vAxis]);
+				glm::vec2 tile(chart % HLOD_FACE_COLUMNS, chart / HLOD_FACE_COLUMNS);
+				Vertex vertex = {};
+				vertex.Position = position - center;
+				vertex.Normal = normal;
+				//from the center of the first texel of the tile to the center of the last one
+				vertex.TexCoords = (tile * static_cast<float>(HLOD_FACE_TILE_SIZE) + 0.5f + local * (HLOD_FACE_TILE_SIZE - 1.0f)) / atlasSize;
+				vertex.Tangent = uDirection;
+				vertex.Bitangent = vDirection;
+				if (!lightmapRects.empty()) {
+					vertex.LightmapCoords = charts.coords(modelPosition, chart) * glm::vec2(rect) + glm::vec2(rect.z, rect.w);
+				}
+				proxy.vertices.push_back(vertex);
+			}
+			bool counterClockwise = glm::dot(glm::cross(uDirection, vDirection), normal) > 0.0f;
+			const unsigned int quad[2][6] = { { 0, 1, 2, 0, 2, 3 }, { 0, 2, 1, 0, 3, 2 } };
+			for (unsigned int index : quad[counterClockwise ? 0 : 1]) {
+				proxy.indices.push_back(baseVertex + index);
+			}
+		}
+	}
+	return proxy;
+}
+
+unsigned long long RegionProxies::cacheKey(const std::vector<glm::mat4>& transforms, const std::vector<glm::vec4>& lightmapRects, const LightmapCharts& charts) const
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	hash = hashBytes(hash, &HLOD_CACHE_VERSION, sizeof(HLOD_CACHE_VERSION));
+	unsigned int tileSize = HLOD_FACE_TILE_SIZE;
+	hash = hashBytes(hash, &tileSize, sizeof(tileSize));
+	hash = hashBytes(hash, &m_boxMinimum, sizeof(m_boxMinimum));
+	hash = hashBytes(hash, &m_boxMaximum, sizeof(m_boxMaximum));
+	hash = hashBytes(hash, transforms.data(), transforms.size() * sizeof(glm::mat4));
+	hash = hashBytes(hash, lightmapRects.data(), lightmapRects.size() * sizeof(glm::vec4));
+	if (!lightmapRects.empty()) {
+		hash = hashBytes(hash, &charts.tileSize, sizeof(charts.tileSize));
+		hash = hashBytes(hash, &charts.minimum, sizeof(charts.minimum));
+		hash = hashBytes(hash, &charts.extent, sizeof(charts.extent));
+		for (int face = 0; face < 6; face++) {
+			glm::uvec4 block = charts.hasFace(face) ? charts.blocks[charts.blockOfFace[face]] : glm::uvec4(0);
+			hash = hashBytes(hash, &block, sizeof(block));
+		}
+	}
+	for (const Region& region : m_regions) {
+		hash = hashBytes(hash, region.instances.data(), region.instances.size() * sizeof(unsigned int));
+	}
+	return hash;
+}
+
+bool RegionProxies::readCache(const std::string& path, unsigned long long key, std::vector<LodGeometry>& proxies) const
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		return false;
+	}
+	//counts read from the file are checked against what is left of it, a truncated cache must not allocate more
+	std::streamoff fileSize = file.tellg();
+	file.seekg(0);
+	char magic[4];
+	glm::uint version = 0, proxyCount = 0;
+	unsigned long long fileKey = 0;
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char*>(&version), sizeof(version));
+	file.read(reinterpret_cast<char*>(&fileKey), sizeof(fileKey));
+	file.read(reinterpret_cast<char*>(&proxyCount), sizeof(proxyCount));
+	if (!file || !std::equal(magic, magic + 4, HLOD_CACHE_MAGIC) || version != HLOD_CACHE_VERSION || fileKey != key || proxyCount != m_regions.size()) {
+		return false;
+	}
+	proxies.resize(proxyCount);
+	for (LodGeometry& proxy : proxies) {
+		glm::uint vertexCount = 0, indexCount = 0;
+		file.read(reinterpret_cast<char*>(&vertexCount), sizeof(vertexCount));
+		file.read(reinterpret_cast<char*>(&indexCount), sizeof(indexCount));
+		if (!file || indexCount % 3 != 0
+			|| static_cast<unsigned long long>(vertexCount) * sizeof(Vertex) + static_cast<unsigned long long>(indexCount) * sizeof(unsigned int)
+			> static_cast<unsigned long long>(fileSize - file.tellg())) {
+			return false;
+		}
+		proxy.error = 0.0f;
+		proxy.vertices.resize(vertexCount);
+		proxy.indices.resize(indexCount);
+		file.read(reinterpret_cast<char*>(proxy.vertices.data()), vertexCount * sizeof(Vertex));
+		file.read(reinterpret_cast<char*>(proxy.indices.data()), indexCount * sizeof(unsigned int));
+		//an index past the vertices would make the proxy read past its vertex buffer on the GPU
+		for (unsigned int index : proxy.indices) {
+			if (index >= vertexCount) {
+				return false;
+			}
+		}
+	}
+	return static_cast<bool>(file);
+}
+
+void RegionProxies::writeCache(const std::string& path, unsigned long long key, const std::vector<LodGeometry>& proxies) const
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cout << "WARNING::HLOD:: could not write " << path << std::endl;
+		return;
+	}
+	glm::uint proxyCount = static_cast<glm::uint>(proxies.size());
+	file.write(HLOD_CACHE_MAGIC, sizeof(HLOD_CACHE_MAGIC));
+	file.write(reinterpret_cast<const char*>(&HLOD_CACHE_VERSION), sizeof(HLOD_CACHE_VERSION));
+	file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+	file.write(reinterpret_cast<const char*>(&proxyCount), sizeof(proxyCount));
+	for (const LodGeometry& proxy : proxies) {
+		glm::uint vertexCount = static_cast<glm::uint>(proxy.vertices.size());
+		glm::uint indexCount = static_cast<glm::uint>(proxy.indices.size());
+		file.write(reinterpret_cast<const char*>(&vertexCount), sizeof(vertexCount));
+		file.write(reinterpret_cast<const char*>(&indexCount), sizeof(indexCount));
+		file.write(reinterpret_cast<const char*>(proxy.vertices.data()), vertexCount * sizeof(Vertex));
+		file.write(reinterpret_cast<const char*>(proxy.indices.data()), indexCount * sizeof(unsigned int));
+	}
+}
+
+void RegionProxies::build(std::vector<Mesh>& meshes, const std::vector<glm::mat4>& transforms, const std::vector<glm::vec4>& lightmapRects, const LightmapCharts& lightmapCharts,
+	Shader& captureShader, const std::string& cachePath)
+{
+	if (m_regions.empty() || meshes.empty()) {
+		return;
+	}
+	//the box every instance is reduced to, in model space
+	m_boxMinimum = glm::vec3(FLT_MAX);
+	m_boxMaximum = glm::vec3(-FLT_MAX);
+	for (const Mesh& mesh : meshes) {
+		for (const Vertex& vertex : mesh.vertices) {
+			m_boxMinimum = glm::min(m_boxMinimum, vertex.Position);
+			m_boxMaximum = glm::max(m_boxMaximum, vertex.Position);
+		}
+	}
+	float boxSize = std::max(std::max(m_boxMaximum.x - m_boxMinimum.x, m_boxMaximum.y - m_boxMinimum.y), m_boxMaximum.z - m_boxMinimum.z);
+
+	//each region gets a sphere around the boxes of its instances
+	m_texelSize = 0.0f;
+	std::vector<glm::vec3> regionMinimum(m_regions.size(), glm::vec3(FLT_MAX)), regionMaximum(m_regions.size(), glm::vec3(-FLT_MAX));
+	for (unsigned int r = 0; r < m_regions.size(); r++) {
+		for (unsigned int instance : m_regions[r].instances) {
+			glm::vec3 instanceMinimum, instanceMaximum;
+			instanceBox(transforms[instance], m_boxMinimum, m_boxMaximum, instanceMinimum, instanceMaximum);
+			regionMinimum[r] = glm::min(regionMinimum[r], instanceMinimum);
+			regionMaximum[r] = glm::max(regionMaximum[r], instanceMaximum);
+			m_texelSize = std::max(m_texelSize, boxSize / HLOD_FACE_TILE_SIZE * maxScale(transforms[instance]));
+		}
+		m_regions[r].bounds = glm::vec4((regionMinimum[r] + regionMaximum[r]) * 0.5f, glm::length(regionMaximum[r] - regionMinimum[r]) * 0.5f);
+	}
+
+	//only a box that touches a face can hide part of it, and such a box belongs to a region whose box touches the
+	//region of the face. Bucketing the instances this way once keeps buildProxy from testing every pair of instances
+	std::vector<std::vector<unsigned int>> neighbours(m_regions.size());
+	for (unsigned int r = 0; r < m_regions.size(); r++) {
+		for (unsigned int other = 0; other < m_regions.size(); other++) {
+			if (glm::all(glm::lessThanEqual(regionMinimum[other], regionMaximum[r] + HLOD_EPSILON))
+				&& glm::all(glm::greaterThanEqual(regionMaximum[other], regionMinimum[r] - HLOD_EPSILON))) {
+				neighbours[r].insert(neighbours[r].end(), m_regions[other].instances.begin(), m_regions[other].instances.end());
+			}
+		}
+		std::sort(neighbours[r].begin(), neighbours[r].end()); //faces are trimmed by the boxes in the order of the instances
+	}
+
+	capture(meshes, captureShader);
+	Texture texture;
+	texture.id = m_texture.id();
+	texture.type = "texture_diffuse";
+	texture.path = "";
+	texture.handle = TextureHandle(); //owned through m_texture, not by the TextureManager
+	m_material = Material(std::vector<Texture>{ texture });
+
+	unsigned long long key = cacheKey(transforms, lightmapRects, lightmapCharts);
+	std::vector<LodGeometry> proxies;
+	if (readCache(cachePath, key, proxies)) {
+		std::cout << "HLOD:: loaded the proxies of " << m_regions.size() << " regions from " << cachePath << std::endl;
+	}
+	else {
+		auto start = std::chrono::steady_clock::now();
+		proxies.assign(m_regions.size(), LodGeometry());
+		JobSystem::instance().parallelFor(static_cast<unsigned int>(m_regions.size()), [&](unsigned int r) {
+			proxies[r] = buildProxy(m_regions[r], neighbours[r], transforms, lightmapRects, lightmapCharts);
+		});
+		float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "HLOD:: built " << m_regions.size() << " region proxies in " << milliseconds << " ms on "
+			<< JobSystem::instance().getThreadCount() + 1 << " threads" << std::endl;
+		writeCache(cachePath, key, proxies);
+	}
+
+	unsigned int triangles = 0;
+	for (unsigned int r = 0; r < m_regions.size(); r++) {
+		if (proxies[r].indices.empty()) {
+			continue;
+		}
+		m_regions[r].proxy.reset(new Mesh(proxies[r].vertices, proxies[r].indices, m_material));
+		triangles += static_cast<unsigned int>(proxies[r].indices.size() / 3);
+	}
+	std::cout << "HLOD:: " << m_regions.size() << " regions, " << triangles << " proxy triangles" << std::endl;
+}
+
+void RegionProxies::select(const LodView& view)
+{
+	for (Region& region : m_regions) {
+		float errors[2] = { 0.0f, m_texelSize };
+		region.level = region.proxy == nullptr ? 0 : selectLod(errors, 2, region.bounds, view, region.level);
+	}
+}
+
+bool RegionProxies::isProxy(unsigned int instance) const
+{
+	return m_regions[m_regionOf[instance]].level != 0;
+}
+
+unsigned int RegionProxies::submit(RenderQueue& queue, Shader& shader, unsigned int pass) const
+{
+	unsigned int count = 0;
+	for (const Region& region : m_regions) {
+		if (region.level == 0) {
+			continue;
+		}
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(region.bounds));
+		region.proxy->Submit(queue, shader, model, pass, glm::vec4(1.0f, 1.0f, 0.0f, 0.0f));
+		count++;
+	}
+	return count;
+}
+
+unsigned int RegionProxies::regionCount() const
+{
+	return static_cast<unsigned int>(m_regions.size());
+}
+
+const std::vector<unsigned int>& RegionProxies::getRegionOfInstances() const
+{
+	return m_regionOf;
+}
+
+std::vector<unsigned int> RegionProxies::getProxyRegions() const
+{
+	std::vector<unsigned int> proxyRegions(m_regions.size());
+	for (unsigned int r = 0; r < m_regions.size(); r++) {
+		proxyRegions[r] = m_regions[r].level;
+	}
+	return proxyRegions;
+}
+
+unsigned int RegionProxies::getTexture() const
+{
+	return m_texture.id();
+}
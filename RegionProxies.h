@@ -0,0 +1,86 @@
+#pragma once
+
+#include <glm/glm/glm.hpp>
+
+#include "shader.h"
+#include "Material.h"
+#include "Mesh.h"
+#include "RenderQueue.h"
+#include "LightmapBaker.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// texels of every face of the box in the texture of the proxies
+#define HLOD_FACE_TILE_SIZE 256
+
+// hierarchical level of detail of the maze. The instances of a model, the buildings that make up its walls, are
+// grouped into square regions of cells and every region gets one merged proxy: the bounding boxes of its instances
+// without the faces that are inside a neighbour or point at the ground. A region far enough away is drawn as its
+// proxy, one draw with a few triangles per building instead of one draw per building.
+//
+// all proxies share one texture, the albedo of the model captured orthographically onto every face of its bounding
+// box. Their lightmap coords point into the tiles the instances got in the lightmap, where LightmapBaker::unwrap
+// reserved blocks for the faces of the same box, so a proxy is lit by what was baked around its buildings. Like an impostor a
+// proxy takes over where its texture has full resolution on screen: the relief of the facades flattens into the box,
+// their texture and light stay. Instances may only be translated and scaled.
+class RegionProxies
+{
+private:
+	struct Region
+	{
+		std::vector<unsigned int> instances;
+		glm::vec4 bounds; //world space sphere around the boxes of all instances
+		std::unique_ptr<Mesh> proxy; //in region space, relative to the center of bounds. Null if every face is hidden
+		unsigned int level; //0 while the instances are drawn, 1 while the proxy is
+	};
+
+	std::vector<Region> m_regions;
+	std::vector<unsigned int> m_regionOf; //instance -> region
+	glm::vec3 m_boxMinimum;
+	glm::vec3 m_boxMaximum;
+	float m_texelSize; //largest world space size of a texel of the face texture
+	GpuHandle m_texture;
+	Material m_material;
+
+	void capture(std::vector<Mesh>& meshes, Shader& captureShader);
+	LodGeometry buildProxy(const Region& region, const std::vector<unsigned int>& neighbours, const std::vector<glm::mat4>& transforms,
+		const std::vector<glm::vec4>& lightmapRects, const LightmapCharts& charts) const;
+	unsigned long long cacheKey(const std::vector<glm::mat4>& transforms, const std::vector<glm::vec4>& lightmapRects, const LightmapCharts& charts) const;
+	bool readCache(const std::string& path, unsigned long long key, std::vector<LodGeometry>& proxies) const;
+	void writeCache(const std::string& path, unsigned long long key, const std::vector<LodGeometry>& proxies) const;
+
+public:
+	// groups the instances by the translation of their transforms into regions of regionSize (x and z) world units
+	RegionProxies(const std::vector<glm::mat4>& transforms, const glm::vec2& regionSize);
+	~RegionProxies();
+
+	RegionProxies(const RegionProxies&) = delete;
+	RegionProxies& operator=(const RegionProxies&) = delete;
+
+	// captures the face texture with captureShader, the GBUFFER variant of light_object, and builds the proxy of every
+	// region on all cores, or loads them from cachePath if they were built for the same instances. transforms are the
+	// ones given to the constructor. lightmapRects holds the rect of every instance in the lightmap, whose tiles have
+	// the layout lightmapCharts that LightmapBaker::unwrap gave the meshes with boxFaces, or is empty. Call after the lightmap is baked
+	void build(std::vector<Mesh>& meshes, const std::vector<glm::mat4>& transforms, const std::vector<glm::vec4>& lightmapRects, const LightmapCharts& lightmapCharts,
+		Shader& captureShader, const std::string& cachePath);
+
+	// picks the regions drawn as their proxy, by the rule of selectLod with the size of a texel of the face texture as
+	// the error of the proxy. A view without pixelsPerUnit draws every region instance by instance
+	void select(const LodView& view);
+
+	// true if the instance's region is drawn as its proxy since the last select
+	bool isProxy(unsigned int instance) const;
+
+	// queues the proxy of every region that was selected with the lightmap rect (1, 1, 0, 0), returns the number of
+	// regions
+	unsigned int submit(RenderQueue& queue, Shader& shader, unsigned int pass = PASS_OPAQUE) const;
+
+	unsigned int regionCount() const;
+	// region of every instance
+	const std::vector<unsigned int>& getRegionOfInstances() const;
+	// 1 for every region drawn as its proxy since the last select, 0 otherwise
+	std::vector<unsigned int> getProxyRegions() const;
+	unsigned int getTexture() const;
+};
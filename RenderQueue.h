@@ -0,0 +1,301 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm/glm/glm.hpp>
+
+#include "shader.h"
+#include "Material.h"
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdint>
+
+using namespace std;
+
+#define MAX_CACHED_TEXTURE_UNITS 32
+
+// bytes of an index of type GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+inline size_t indexSize(GLenum type)
+{
+    return type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+}
+
+// remembers which program, vertex array and textures are bound, so binding the same thing twice costs nothing.
+// anything that changes this state behind the cache's back has to be followed by invalidate().
+class GLStateCache {
+public:
+    // number of GL calls that were actually made and that were skipped because the state was already set
+    unsigned int issuedCalls = 0;
+    unsigned int skippedCalls = 0;
+
+    GLStateCache()
+    {
+        invalidate();
+    }
+
+    // forget everything, the next bind of each kind always reaches the driver
+    void invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        material = UNKNOWN;
+        for (unsigned int i = 0; i < MAX_CACHED_TEXTURE_UNITS; i++)
+            textures[i] = UNKNOWN;
+    }
+
+    // returns true if the program actually changed
+    bool useProgram(unsigned int id)
+    {
+        if (program == id)
+        {
+            skippedCalls++;
+            return false;
+        }
+        glUseProgram(id);
+        program = id;
+        issuedCalls++;
+        return true;
+    }
+
+    void bindVertexArray(unsigned int id)
+    {
+        if (vertexArray == id)
+        {
+            skippedCalls++;
+            return;
+        }
+        glBindVertexArray(id);
+        vertexArray = id;
+        issuedCalls++;
+    }
+
+    void bindTexture(unsigned int unit, GLenum target, unsigned int id)
+    {
+        if (unit < MAX_CACHED_TEXTURE_UNITS && textures[unit] == id)
+        {
+            skippedCalls++;
+            return;
+        }
+        if (activeUnit != unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = unit;
+            issuedCalls++;
+        }
+        glBindTexture(target, id);
+        if (unit < MAX_CACHED_TEXTURE_UNITS)
+            textures[unit] = id;
+        issuedCalls++;
+    }
+
+    // binds all textures of a material, nothing at all happens if it is the material that was bound last
+    void bindMaterial(const Material& m)
+    {
+        if (material == m.ID)
+        {
+            skippedCalls++;
+            return;
+        }
+        for (unsigned int i = 0; i < m.textures.size(); i++)
+            bindTexture(m.textures[i].unit, GL_TEXTURE_2D, m.textures[i].use());
+        material = m.ID;
+    }
+
+private:
+    static const unsigned int UNKNOWN = 0xFFFFFFFF;
+
+    unsigned int program;
+    unsigned int vertexArray;
+    unsigned int activeUnit;
+    unsigned int material;
+    unsigned int textures[MAX_CACHED_TEXTURE_UNITS];
+};
+
+enum RenderPass {
+    PASS_OPAQUE = 0,
+    PASS_TRANSPARENT = 1
+};
+
+struct DrawCommand {
+    uint64_t key;
+    Shader* shader;
+    const Material* material; // may be null for untextured draws
+    unsigned int VAO;
+    unsigned int count;       // number of indices, or vertices for non indexed draws
+    bool indexed;
+    unsigned int firstIndex;  // where an indexed draw starts in the element buffer, e.g. a level of detail
+    int baseVertex;
+    GLenum indexType;         // GL_UNSIGNED_INT or GL_UNSIGNED_SHORT
+    glm::mat4 model;
+    glm::vec4 lightmapRect;   // scale and offset of the draw's lightmap coords in the atlas
+    glm::vec4 animation;      // clip and time of a skinned draw, see Model::animationOf. 0 for the bind pose
+};
+
+// collects the draws of a frame, sorts them by a 64 bit key and executes them through a GLStateCache.
+// key layout, most significant first: pass (4 bits) | shader (12) | material (16) | mesh (16) | depth (16)
+class RenderQueue {
+public:
+    GLStateCache state;
+
+    // starts a new frame, depth is measured from viewPosition and clamped to maxDistance
+    void begin(const glm::vec3& viewPosition, float maxDistance)
+    {
+        commands.clear();
+        this->viewPosition = viewPosition;
+        this->maxDistance = maxDistance;
+    }
+
+    void submit(Shader& shader, const Material* material, unsigned int VAO, unsigned int count, bool indexed, const glm::mat4& model, unsigned int pass = PASS_OPAQUE, const glm::vec4& lightmapRect = glm::vec4(0.0f),
+        unsigned int firstIndex = 0, int baseVertex = 0, GLenum indexType = GL_UNSIGNED_INT, const glm::vec4& animation = glm::vec4(0.0f))
+    {
+        DrawCommand command;
+        float distance = glm::length(glm::vec3(model[3]) - viewPosition);
+        command.key = makeKey(pass, shader.ID, material ? material->ID : 0, VAO, distance / maxDistance);
+        command.shader = &shader;
+        command.material = material;
+        command.VAO = VAO;
+        command.count = count;
+        command.indexed = indexed;
+        command.firstIndex = firstIndex;
+        command.baseVertex = baseVertex;
+        command.indexType = indexType;
+        command.model = model;
+        command.lightmapRect = lightmapRect;
+        command.animation = animation;
+        commands.push_back(command);
+    }
+
+    // opaque draws with shader go into the depth pre-pass, drawn with depthShader. depthShader has to compute exactly
+    // the same depth, i.e. share the vertex shader (with an invariant gl_Position)
+    void setDepthShader(Shader& shader, Shader& depthShader)
+    {
+        depthShaders[shader.ID] = &depthShader;
+    }
+
+    // draws the opaque commands that have a depth shader into the depth buffer only, front to back. Call before
+    // execute with the depth test set to GL_LEQUAL, then the expensive shaders only run for visible fragments.
+    // Per frame uniforms have to be set on the depth shaders beforehand
+    void executeDepthPrePass()
+    {
+        depthOrder.clear();
+        for (unsigned int i = 0; i < commands.size(); i++)
+        {
+            if ((commands[i].key >> 60) == PASS_OPAQUE && depthShaders.count(commands[i].shader->ID))
+                depthOrder.push_back(std::make_pair(commands[i].key & 0xFFFF, i));
+        }
+        std::sort(depthOrder.begin(), depthOrder.end());
+
+        state.invalidate();
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        DrawUniforms uniforms;
+        for (unsigned int i = 0; i < depthOrder.size(); i++)
+        {
+            const DrawCommand& command = commands[depthOrder[i].second];
+            Shader& depthShader = *depthShaders[command.shader->ID];
+            if (state.useProgram(depthShader.ID))
+                uniforms = drawUniformsOf(depthShader);
+            state.bindVertexArray(command.VAO);
+            depthShader.set(uniforms.model, command.model);
+            if (uniforms.animation.valid())
+                depthShader.set(uniforms.animation, command.animation);
+
+            if (command.indexed)
+                glDrawElementsBaseVertex(GL_TRIANGLES, command.count, command.indexType, (void*)(command.firstIndex * indexSize(command.indexType)), command.baseVertex);
+            else
+                glDrawArrays(GL_TRIANGLES, 0, command.count);
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glBindVertexArray(0);
+        state.invalidate();
+    }
+
+    // sorts and draws everything submitted since begin(). Per frame uniforms (view, projection, lights) have
+    // to be set on the shaders beforehand, the queue only sets each draw's "model" matrix, "lightmapRect" and "animation".
+    void execute()
+    {
+        order.resize(commands.size());
+        for (unsigned int i = 0; i < commands.size(); i++)
+            order[i] = std::make_pair(commands[i].key, i);
+        std::sort(order.begin(), order.end());
+
+        // whatever happened outside the queue since the last frame is unknown
+        state.invalidate();
+        DrawUniforms uniforms;
+        for (unsigned int i = 0; i < order.size(); i++)
+        {
+            const DrawCommand& command = commands[order[i].second];
+            if (state.useProgram(command.shader->ID))
+                uniforms = drawUniformsOf(*command.shader);
+            if (command.material)
+                state.bindMaterial(*command.material);
+            state.bindVertexArray(command.VAO);
+            command.shader->set(uniforms.model, command.model);
+            if (uniforms.lightmapRect.valid())
+                command.shader->set(uniforms.lightmapRect, command.lightmapRect);
+            if (uniforms.animation.valid())
+                command.shader->set(uniforms.animation, command.animation);
+
+            if (command.indexed)
+                glDrawElementsBaseVertex(GL_TRIANGLES, command.count, command.indexType, (void*)(command.firstIndex * indexSize(command.indexType)), command.baseVertex);
+            else
+                glDrawArrays(GL_TRIANGLES, 0, command.count);
+        }
+
+        // leave the defaults behind for code that draws outside the queue
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        state.invalidate();
+    }
+
+    unsigned int size() const
+    {
+        return static_cast<unsigned int>(commands.size());
+    }
+
+    static uint64_t makeKey(unsigned int pass, unsigned int shader, unsigned int material, unsigned int mesh, float depth)
+    {
+        uint64_t quantizedDepth = static_cast<uint64_t>(glm::clamp(depth, 0.0f, 1.0f) * 0xFFFF);
+        // transparent geometry has to be drawn back to front
+        if (pass == PASS_TRANSPARENT)
+            quantizedDepth = 0xFFFF - quantizedDepth;
+        return (static_cast<uint64_t>(pass & 0xF) << 60)
+            | (static_cast<uint64_t>(shader & 0xFFF) << 48)
+            | (static_cast<uint64_t>(material & 0xFFFF) << 32)
+            | (static_cast<uint64_t>(mesh & 0xFFFF) << 16)
+            | quantizedDepth;
+    }
+
+private:
+    // the uniforms the queue sets per draw
+    struct DrawUniforms {
+        Uniform<glm::mat4> model;
+        Uniform<glm::vec4> lightmapRect;
+        Uniform<glm::vec4> animation;
+    };
+
+    vector<DrawCommand> commands;
+    vector<pair<uint64_t, unsigned int>> order;
+    vector<pair<uint64_t, unsigned int>> depthOrder;
+    unordered_map<unsigned int, Shader*> depthShaders; // program ID -> its depth pre-pass shader
+    unordered_map<unsigned int, DrawUniforms> drawUniforms; // program ID -> per draw uniforms
+    glm::vec3 viewPosition = glm::vec3(0.0f);
+    float maxDistance = 1.0f;
+
+    DrawUniforms drawUniformsOf(Shader& shader)
+    {
+        auto it = drawUniforms.find(shader.ID);
+        if (it != drawUniforms.end())
+            return it->second;
+        DrawUniforms handles;
+        handles.model = shader.uniform<glm::mat4>("model");
+        handles.lightmapRect = shader.uniform<glm::vec4>("lightmapRect");
+        handles.animation = shader.uniform<glm::vec4>("animation");
+        drawUniforms[shader.ID] = handles;
+        return handles;
+    }
+};
+#endif
@@ -0,0 +1,174 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+// linked program binaries of earlier runs, so a program is only compiled the first time its sources are seen.
+// Everything lives in one file in the working directory. Binaries only load on the driver that wrote them, so
+// vendor, renderer and version are part of the file header and a driver update just starts an empty cache.
+// Only usable when glExtensions().programBinary is set.
+class ShaderCache
+{
+public:
+    static ShaderCache& instance()
+    {
+        static ShaderCache cache;
+        return cache;
+    }
+
+    // key of a program, a hash over the sources of all of its stages (with the defines already injected)
+    static unsigned long long keyOf(const std::vector<std::string>& sources)
+    {
+        unsigned long long hash = 14695981039346656037ULL; // FNV-1a
+        for (unsigned int i = 0; i < sources.size(); i++)
+        {
+            for (unsigned char c : sources[i])
+                hash = (hash ^ c) * 1099511628211ULL;
+            hash = (hash ^ 0xFF) * 1099511628211ULL; // stage separator
+        }
+        return hash;
+    }
+
+    // links program from the cached binary, false if there is none or the driver rejected it
+    bool load(GLuint program, unsigned long long key)
+    {
+        readFile();
+        auto it = entries.find(key);
+        if (it == entries.end())
+            return false;
+        const Entry& entry = it->second;
+        glProgramBinary(program, entry.format, entry.binary.data(), (GLsizei)entry.binary.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            entries.erase(it);
+            dirty = true;
+            return false;
+        }
+        hits++;
+        return true;
+    }
+
+    // remembers the binary of a freshly linked program, see flush
+    void store(GLuint program, unsigned long long key)
+    {
+        readFile();
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        Entry entry;
+        entry.binary.resize(length);
+        glGetProgramBinary(program, length, nullptr, &entry.format, entry.binary.data());
+        entries[key] = std::move(entry);
+        dirty = true;
+    }
+
+    // writes the file if anything was stored since the last flush
+    void flush()
+    {
+        if (!dirty)
+            return;
+        dirty = false;
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER_CACHE::CANNOT_WRITE " << path << std::endl;
+            return;
+        }
+        unsigned int version = VERSION;
+        unsigned int count = (unsigned int)entries.size();
+        unsigned int driverLength = (unsigned int)driver.size();
+        file.write(MAGIC, 4);
+        file.write((const char*)&version, sizeof(version));
+        file.write((const char*)&driverLength, sizeof(driverLength));
+        file.write(driver.data(), driverLength);
+        file.write((const char*)&count, sizeof(count));
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            unsigned int size = (unsigned int)it->second.binary.size();
+            file.write((const char*)&it->first, sizeof(it->first));
+            file.write((const char*)&it->second.format, sizeof(it->second.format));
+            file.write((const char*)&size, sizeof(size));
+            file.write(it->second.binary.data(), size);
+        }
+    }
+
+    // programs that were loaded instead of compiled so far
+    unsigned int hitCount() const
+    {
+        return hits;
+    }
+
+private:
+    struct Entry
+    {
+        GLenum format = 0;
+        std::vector<char> binary;
+    };
+
+    static constexpr const char* MAGIC = "SHDR";
+    static const unsigned int VERSION = 1;
+
+    std::string path = "shaders.cache";
+    std::string driver;
+    std::unordered_map<unsigned long long, Entry> entries;
+    bool read = false;
+    bool dirty = false;
+    unsigned int hits = 0;
+
+    ShaderCache() {}
+
+    // reads the cache once, on first use when a context is current
+    void readFile()
+    {
+        if (read)
+            return;
+        read = true;
+        driver = std::string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" + (const char*)glGetString(GL_VERSION);
+
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return;
+        // sizes read from the file are checked against what is left of it, a truncated cache must not allocate more
+        std::streamoff fileSize = file.tellg();
+        file.seekg(0);
+        char magic[4];
+        unsigned int version = 0, driverLength = 0, count = 0;
+        file.read(magic, 4);
+        file.read((char*)&version, sizeof(version));
+        file.read((char*)&driverLength, sizeof(driverLength));
+        if (!file || std::string(magic, 4) != MAGIC || version != VERSION || driverLength != driver.size())
+            return;
+        std::string fileDriver(driverLength, '\0');
+        file.read(&fileDriver[0], driverLength);
+        if (fileDriver != driver)
+            return; // written by another driver, its binaries would be rejected anyway
+        file.read((char*)&count, sizeof(count));
+        for (unsigned int i = 0; i < count && file; i++)
+        {
+            unsigned long long key = 0;
+            unsigned int size = 0;
+            Entry entry;
+            file.read((char*)&key, sizeof(key));
+            file.read((char*)&entry.format, sizeof(entry.format));
+            file.read((char*)&size, sizeof(size));
+            if (!file || size > fileSize - file.tellg())
+                break;
+            entry.binary.resize(size);
+            file.read(entry.binary.data(), size);
+            if (file)
+                entries[key] = std::move(entry);
+        }
+    }
+};
+#endif
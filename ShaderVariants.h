@@ -0,0 +1,112 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+
+#include <string>
+#include <map>
+#include <memory>
+#include <functional>
+
+// features a shader can be specialized for, each one becomes a #define of the same name
+enum ShaderFeature {
+    SHADER_FLASHLIGHT = 1 << 0, // evaluate the spot light of the flashlight
+    SHADER_SPECULAR   = 1 << 1, // add specular highlights
+    SHADER_INSTANCED  = 1 << 2, // transforms come from the static batch instead of the model uniform, needs OpenGL 4.3
+    SHADER_LIGHTMAP   = 1 << 3, // the static lights are read from the lightmap instead of computed
+    SHADER_GBUFFER    = 1 << 4, // write the G-buffer of the DeferredRenderer instead of a lit color
+    SHADER_CROSSFADE  = 1 << 5, // dither the model out while it fades into its impostor, see Impostor.h
+    SHADER_IMPOSTOR   = 1 << 6, // draw the camera facing quads of an ImpostorAtlas instead of meshes
+    SHADER_SKINNED    = 1 << 7  // blend the vertices by the bones of the model's baked animation, see AnimationBaker
+};
+
+// compiles one program per combination of features out of the same sources and keeps them around, so every draw
+// can use the variant that does exactly the work it needs. Variants are compiled on first use. Call prepare at load
+// time, inside Shader::beginParallelCompile/finishParallelCompile, for the ones needed every frame to keep compiles
+// out of the render loop.
+class ShaderVariants
+{
+public:
+    // setup runs once on every freshly compiled variant, for the uniforms that never change
+    ShaderVariants(const char* vertexPath, const char* fragmentPath, std::function<void(Shader&)> setup = nullptr)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), setup(setup)
+    {
+    }
+
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    // a value every variant is compiled with, e.g. the number of point lights. Only affects variants compiled afterwards
+    void define(const std::string& name, int value)
+    {
+        constants[name] = value;
+    }
+
+    // starts compiling a variant without waiting for it
+    void prepare(unsigned int features)
+    {
+        if (variants.find(features) == variants.end())
+            variants[features] = Variant{ std::unique_ptr<Shader>(new Shader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, definesOf(features))), false };
+    }
+
+    // the program for a combination of ShaderFeature flags, compiled and set up
+    Shader& get(unsigned int features)
+    {
+        prepare(features);
+        Variant& variant = variants[features];
+        if (!variant.ready)
+        {
+            variant.shader->finish();
+            if (setup)
+                setup(*variant.shader);
+            variant.ready = true;
+        }
+        return *variant.shader;
+    }
+
+    unsigned int variantCount() const
+    {
+        return static_cast<unsigned int>(variants.size());
+    }
+
+private:
+    struct Variant
+    {
+        std::unique_ptr<Shader> shader;
+        bool ready; // setup has run
+    };
+
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::function<void(Shader&)> setup;
+    std::map<std::string, int> constants;
+    std::map<unsigned int, Variant> variants;
+
+    std::string definesOf(unsigned int features) const
+    {
+        // instancing reads the static batch's storage buffers, which need GLSL 4.30
+        std::string defines = (features & SHADER_INSTANCED) ? "#version 430 core\n" : "";
+        for (auto it = constants.begin(); it != constants.end(); ++it)
+            defines += "#define " + it->first + " " + std::to_string(it->second) + "\n";
+        if (features & SHADER_FLASHLIGHT)
+            defines += "#define FLASHLIGHT\n";
+        if (features & SHADER_SPECULAR)
+            defines += "#define SPECULAR\n";
+        if (features & SHADER_INSTANCED)
+            defines += "#define INSTANCED\n";
+        if (features & SHADER_LIGHTMAP)
+            defines += "#define LIGHTMAP\n";
+        if (features & SHADER_GBUFFER)
+            defines += "#define GBUFFER\n";
+        if (features & SHADER_CROSSFADE)
+            defines += "#define CROSSFADE\n";
+        if (features & SHADER_IMPOSTOR)
+            defines += "#define IMPOSTOR\n";
+        if (features & SHADER_SKINNED)
+            defines += "#define SKINNED\n";
+        return defines;
+    }
+};
+#endif
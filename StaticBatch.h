@@ -0,0 +1,366 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm/glm/glm.hpp>
+
+#include "GLExtensions.h"
+#include "shader.h"
+#include "Material.h"
+#include "Mesh.h"
+#include "Model.h"
+#include "RenderQueue.h"
+#include "GpuResources.h"
+
+#include <vector>
+#include <map>
+#include <algorithm>
+
+using namespace std;
+
+// layout of GL_DRAW_INDIRECT_BUFFER entries as defined by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+// all draws of one shader and material, issued with a single glMultiDrawElementsIndirect call
+struct BatchBucket {
+    Shader* shader;
+    const Material* material;
+    unsigned int firstCommand;
+    unsigned int commandCount;
+};
+
+// packs the geometry of static meshes into one vertex and index buffer and draws every instance of them with one
+// glMultiDrawElementsIndirect call per shader/material pair. Needs OpenGL 4.3, check glExtensions().multiDrawIndirect.
+//
+// every instance owns a transform in a shader storage buffer (binding 0). Per instance vertex attribute 7 holds the
+// index of that transform, which makes baseInstance select the right transforms without ARB_shader_draw_parameters.
+// The lightmap rect of every instance lives in a second buffer at binding 5, indexed the same way, and so does the
+// animation of a skinned instance at binding 10 (see Model::animationOf).
+//
+// every level of detail of a mesh gets its own command right behind the one of the full mesh, with its own range of
+// instances. Only the full mesh's command draws anything until a GpuCuller moves instances to the coarser ones.
+class StaticBatch {
+public:
+    // adds every mesh of the model, drawn with shader at each of the transforms. lightmapRects and animations are
+    // either empty or hold one entry per transform. Returns the index of the first transform so instances can be
+    // hidden later on
+    unsigned int add(const Model& model, Shader& shader, const vector<glm::mat4>& transforms, const vector<glm::vec4>& lightmapRects = vector<glm::vec4>(),
+        const vector<glm::vec4>& animations = vector<glm::vec4>())
+    {
+        unsigned int first = addTransforms(transforms, lightmapRects, animations);
+        // a bone can move a vertex anywhere within the model's bounds over its clips
+        glm::vec4 bounds = model.animated() ? model.bounds : glm::vec4(0.0f);
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+            addDraw(model.meshes[i], shader, first, static_cast<unsigned int>(transforms.size()), model.lodErrors, bounds);
+        return first;
+    }
+
+    unsigned int add(const Mesh& mesh, Shader& shader, const vector<glm::mat4>& transforms, const vector<glm::vec4>& lightmapRects = vector<glm::vec4>())
+    {
+        unsigned int first = addTransforms(transforms, lightmapRects, vector<glm::vec4>());
+        vector<float> lodErrors;
+        for (unsigned int i = 0; i < mesh.lods.size(); i++)
+            lodErrors.push_back(mesh.lods[i].error);
+        addDraw(mesh, shader, first, static_cast<unsigned int>(transforms.size()), lodErrors);
+        return first;
+    }
+
+    // uploads everything that was added, call once after the last add
+    void build()
+    {
+        // commands of the same shader and material have to be next to each other
+        std::stable_sort(draws.begin(), draws.end(), [](const BatchDraw& a, const BatchDraw& b) {
+            if (a.shader->ID != b.shader->ID)
+                return a.shader->ID < b.shader->ID;
+            return a.material->ID < b.material->ID;
+        });
+
+        for (unsigned int i = 0; i < draws.size(); i++)
+        {
+            const BatchDraw& draw = draws[i];
+            const GeometryRange& range = geometry[draw.geometry];
+            // errors of levels the draw doesn't have are negative
+            glm::vec4 lodErrors(-1.0f);
+            for (unsigned int level = 0; level < draw.levelCount; level++)
+                lodErrors[level] = draw.lodErrors[level];
+            for (unsigned int level = 0; level < draw.levelCount; level++)
+            {
+                // a mesh with fewer levels than its model repeats its coarsest one
+                const GeometryRange& lod = geometry[draw.geometry + glm::min(level, range.levelCount - 1)];
+                DrawElementsIndirectCommand command;
+                command.count = lod.count;
+                command.instanceCount = level == 0 ? draw.transformCount : 0;
+                command.firstIndex = lod.firstIndex;
+                command.baseVertex = lod.baseVertex;
+                command.baseInstance = static_cast<GLuint>(instanceTransforms.size());
+                commands.push_back(command);
+                commandBounds.push_back(draw.bounds);
+                commandLodErrors.push_back(lodErrors);
+                for (unsigned int t = 0; t < draw.transformCount; t++)
+                    instanceTransforms.push_back(draw.firstTransform + t);
+            }
+
+            if (buckets.empty() || buckets.back().shader != draw.shader || buckets.back().material->ID != draw.material->ID)
+            {
+                BatchBucket bucket;
+                bucket.shader = draw.shader;
+                bucket.material = draw.material;
+                bucket.firstCommand = static_cast<unsigned int>(commands.size()) - draw.levelCount;
+                bucket.commandCount = 0;
+                buckets.push_back(bucket);
+            }
+            buckets.back().commandCount += draw.levelCount;
+        }
+        GpuResources& resources = GpuResources::instance();
+        VAO = resources.create(GPU_VERTEX_ARRAY, GPU_GEOMETRY);
+        VBO = resources.create(GPU_BUFFER, GPU_GEOMETRY);
+        EBO = resources.create(GPU_BUFFER, GPU_GEOMETRY);
+        instanceVBO = resources.create(GPU_BUFFER, GPU_GEOMETRY);
+        indirectBuffer = resources.create(GPU_BUFFER, GPU_GEOMETRY);
+        transformBuffer = resources.create(GPU_BUFFER, GPU_GEOMETRY);
+        lightmapRectBuffer = resources.create(GPU_BUFFER, GPU_GEOMETRY);
+        animationBuffer = resources.create(GPU_BUFFER, GPU_GEOMETRY);
+
+        // one layout for all meshes, wide enough for each of them. Indices stay relative to the base vertex of their
+        // range, so 16 bit ones still work for a batch of far more vertices. The shaders don't normal map
+        layout = VertexLayout::of(vertices, indices, false);
+        vector<unsigned char> vertexData;
+        vector<unsigned char> indexData;
+        layout.packVertices(vertices, vertexData);
+        layout.packIndices(indices, indexData);
+
+        glBindVertexArray(VAO.id());
+        GpuResources::bufferData(GL_ARRAY_BUFFER, VBO, vertexData.size(), vertexData.data(), GL_STATIC_DRAW);
+        GpuResources::bufferData(GL_ELEMENT_ARRAY_BUFFER, EBO, indexData.size(), indexData.data(), GL_STATIC_DRAW);
+        layout.setAttributes();
+        // transform index, advanced once per instance and offset by baseInstance
+        GpuResources::bufferData(GL_ARRAY_BUFFER, instanceVBO, instanceTransforms.size() * sizeof(GLuint), instanceTransforms.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(7);
+        glVertexAttribIPointer(7, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+        glVertexAttribDivisor(7, 1);
+        glBindVertexArray(0);
+
+        GpuResources::bufferData(GL_DRAW_INDIRECT_BUFFER, indirectBuffer, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        GpuResources::bufferData(GL_SHADER_STORAGE_BUFFER, transformBuffer, transforms.size() * sizeof(glm::mat4), transforms.data(), GL_STATIC_DRAW);
+        GpuResources::bufferData(GL_SHADER_STORAGE_BUFFER, lightmapRectBuffer, lightmapRects.size() * sizeof(glm::vec4), lightmapRects.data(), GL_STATIC_DRAW);
+        GpuResources::bufferData(GL_SHADER_STORAGE_BUFFER, animationBuffer, animations.size() * sizeof(glm::vec4), animations.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        // the geometry lives on the GPU now
+        vertices.clear();
+        vertices.shrink_to_fit();
+        indices.clear();
+        indices.shrink_to_fit();
+    }
+
+    // hides an instance by collapsing its transform, all its triangles become degenerate
+    void hide(unsigned int transform)
+    {
+        glm::mat4 collapsed = glm::mat4(0.0f);
+        transforms[transform] = collapsed;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, transformBuffer.id());
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, transform * sizeof(glm::mat4), sizeof(glm::mat4), &collapsed);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // draws everything that was added with current using replacement instead, e.g. another variant of the same
+    // shader (see ShaderVariants.h). Only swaps pointers, the buffers stay as they are
+    void replaceShader(Shader& current, Shader& replacement)
+    {
+        for (unsigned int i = 0; i < draws.size(); i++)
+        {
+            if (draws[i].shader == &current)
+                draws[i].shader = &replacement;
+        }
+        for (unsigned int i = 0; i < buckets.size(); i++)
+        {
+            if (buckets[i].shader == &current)
+                buckets[i].shader = &replacement;
+        }
+    }
+
+    // depth pre-pass: draws everything that uses shader with depthShader instead, into the depth buffer only.
+    // See RenderQueue::executeDepthPrePass
+    void drawDepth(GLStateCache& state, const Shader& shader, Shader& depthShader)
+    {
+        state.invalidate();
+        state.bindVertexArray(VAO.id());
+        state.useProgram(depthShader.ID);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer.id());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, transformBuffer.id());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, lightmapRectBuffer.id());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, animationBuffer.id());
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        // materials don't matter for depth, neighbouring buckets of the shader are drawn with one call
+        for (unsigned int i = 0; i < buckets.size(); i++)
+        {
+            if (buckets[i].shader != &shader)
+                continue;
+            unsigned int firstCommand = buckets[i].firstCommand;
+            unsigned int commandCount = buckets[i].commandCount;
+            while (i + 1 < buckets.size() && buckets[i + 1].shader == &shader && buckets[i + 1].firstCommand == firstCommand + commandCount)
+                commandCount += buckets[++i].commandCount;
+            glMultiDrawElementsIndirect(GL_TRIANGLES, layout.indexType(), (void*)(firstCommand * sizeof(DrawElementsIndirectCommand)), commandCount, 0);
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+        state.invalidate();
+    }
+
+    // draws the whole batch. Per frame uniforms have to be set on the shaders beforehand, like with the RenderQueue
+    void draw(GLStateCache& state)
+    {
+        state.invalidate();
+        state.bindVertexArray(VAO.id());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer.id());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, transformBuffer.id());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, lightmapRectBuffer.id());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, animationBuffer.id());
+        for (unsigned int i = 0; i < buckets.size(); i++)
+        {
+            const BatchBucket& bucket = buckets[i];
+            state.useProgram(bucket.shader->ID);
+            state.bindMaterial(*bucket.material);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, layout.indexType(), (void*)(bucket.firstCommand * sizeof(DrawElementsIndirectCommand)), bucket.commandCount, 0);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        state.invalidate();
+    }
+
+    unsigned int drawCalls() const
+    {
+        return static_cast<unsigned int>(buckets.size());
+    }
+
+    // buffers and their initial contents, for passes that rewrite the indirect commands on the GPU (see GpuCulling.h)
+    unsigned int indirectBufferID() const { return indirectBuffer.id(); }
+    unsigned int instanceBufferID() const { return instanceVBO.id(); }
+    unsigned int transformBufferID() const { return transformBuffer.id(); }
+    // commands with every instance visible
+    const vector<DrawElementsIndirectCommand>& getCommands() const { return commands; }
+    // local bounding sphere (center, radius) of each command's mesh
+    const vector<glm::vec4>& getCommandBounds() const { return commandBounds; }
+    // error of every level of detail of a command's draw, negative past its last level. The command of level l
+    // follows the one of level 0 at offset l
+    const vector<glm::vec4>& getCommandLodErrors() const { return commandLodErrors; }
+    // transform index of every instance, commands[i].baseInstance is the offset of command i
+    const vector<GLuint>& getInstanceTransforms() const { return instanceTransforms; }
+    const vector<glm::mat4>& getTransforms() const { return transforms; }
+
+private:
+    // where a mesh ended up in the shared buffers
+    struct GeometryRange {
+        GLuint firstIndex;
+        GLuint count;
+        GLint baseVertex;
+        glm::vec4 bounds; // bounding sphere in model space
+        unsigned int levelCount; // levels of detail, they follow this range in geometry
+    };
+
+    // one mesh drawn with one shader at a contiguous range of transforms
+    struct BatchDraw {
+        Shader* shader;
+        const Material* material;
+        unsigned int geometry;
+        unsigned int firstTransform;
+        unsigned int transformCount;
+        unsigned int levelCount;
+        float lodErrors[MAX_LOD_LEVELS];
+        glm::vec4 bounds; // bounding sphere in model space, over all poses of a skinned mesh
+    };
+
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    VertexLayout layout;
+    vector<GeometryRange> geometry;
+    map<const Mesh*, unsigned int> geometryOfMesh;
+    vector<BatchDraw> draws;
+    vector<BatchBucket> buckets;
+    vector<glm::mat4> transforms;
+    vector<glm::vec4> lightmapRects;
+    vector<glm::vec4> animations;
+    vector<DrawElementsIndirectCommand> commands;
+    vector<glm::vec4> commandBounds;
+    vector<glm::vec4> commandLodErrors;
+    vector<GLuint> instanceTransforms;
+
+    GpuHandle VAO, VBO, EBO, instanceVBO;
+    GpuHandle indirectBuffer, transformBuffer, lightmapRectBuffer, animationBuffer;
+
+    unsigned int addTransforms(const vector<glm::mat4>& transforms, const vector<glm::vec4>& lightmapRects, const vector<glm::vec4>& animations)
+    {
+        unsigned int first = static_cast<unsigned int>(this->transforms.size());
+        this->transforms.insert(this->transforms.end(), transforms.begin(), transforms.end());
+        if (lightmapRects.size() == transforms.size())
+            this->lightmapRects.insert(this->lightmapRects.end(), lightmapRects.begin(), lightmapRects.end());
+        else
+            this->lightmapRects.resize(this->transforms.size(), glm::vec4(0.0f));
+        // unanimated instances stay in the bind pose
+        if (animations.size() == transforms.size())
+            this->animations.insert(this->animations.end(), animations.begin(), animations.end());
+        else
+            this->animations.resize(this->transforms.size(), glm::vec4(0.0f));
+        return first;
+    }
+
+    // copies the geometry of a mesh and its levels of detail into the shared buffers, only the first time the mesh
+    // is seen
+    unsigned int geometryOf(const Mesh& mesh)
+    {
+        auto it = geometryOfMesh.find(&mesh);
+        if (it != geometryOfMesh.end())
+            return it->second;
+
+        unsigned int index = static_cast<unsigned int>(geometry.size());
+        glm::vec4 bounds = boundingSphere(mesh.vertices);
+        unsigned int levelCount = static_cast<unsigned int>(mesh.lods.size());
+        for (unsigned int level = 0; level < levelCount; level++)
+        {
+            const vector<Vertex>& levelVertices = level == 0 ? mesh.vertices : mesh.lodGeometry[level - 1].vertices;
+            const vector<unsigned int>& levelIndices = level == 0 ? mesh.indices : mesh.lodGeometry[level - 1].indices;
+            GeometryRange range;
+            range.firstIndex = static_cast<GLuint>(indices.size());
+            range.count = static_cast<GLuint>(levelIndices.size());
+            range.baseVertex = static_cast<GLint>(vertices.size());
+            range.bounds = bounds;
+            range.levelCount = levelCount;
+            vertices.insert(vertices.end(), levelVertices.begin(), levelVertices.end());
+            indices.insert(indices.end(), levelIndices.begin(), levelIndices.end());
+            geometry.push_back(range);
+        }
+
+        geometryOfMesh[&mesh] = index;
+        return index;
+    }
+
+    // lodErrors are the errors the levels are picked by, the draw has as many levels as there are errors. bounds
+    // replaces the ones of the mesh unless its radius is 0
+    void addDraw(const Mesh& mesh, Shader& shader, unsigned int firstTransform, unsigned int transformCount, const vector<float>& lodErrors,
+        const glm::vec4& bounds = glm::vec4(0.0f))
+    {
+        BatchDraw draw;
+        draw.shader = &shader;
+        draw.material = &mesh.material;
+        draw.geometry = geometryOf(mesh);
+        draw.firstTransform = firstTransform;
+        draw.transformCount = transformCount;
+        draw.levelCount = glm::clamp(static_cast<unsigned int>(lodErrors.size()), 1u, static_cast<unsigned int>(MAX_LOD_LEVELS));
+        for (unsigned int level = 0; level < MAX_LOD_LEVELS; level++)
+            draw.lodErrors[level] = level < lodErrors.size() ? lodErrors[level] : 0.0f;
+        draw.bounds = bounds.w > 0.0f ? bounds : geometry[draw.geometry].bounds;
+        draws.push_back(draw);
+    }
+};
+#endif
@@ -0,0 +1,380 @@
+#ifndef TEXT_RENDERER_H
+#define TEXT_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm/glm.hpp>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_MODULE_H
+
+#include "shader.h"
+#include "GpuResources.h"
+#include "RenderQueue.h"
+#include "AssetArchive.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+// glyphs of the first 128 characters, the ASCII set
+#define TEXT_GLYPH_COUNT 128
+// width of the glyph atlas, its height is whatever the glyphs need
+#define TEXT_ATLAS_WIDTH 1024
+// empty texels around every glyph so bilinear filtering never picks up a neighbour
+#define TEXT_GLYPH_PADDING 1
+// pixels a distance field reaches beyond the outline of a glyph, FreeType adds them around every glyph
+#define TEXT_SDF_SPREAD 8
+
+// where a glyph is in the atlas and how it is placed on the line, in pixels of the loaded size
+struct Glyph {
+    glm::vec2 size;
+    glm::vec2 bearing;  // offset from the pen on the baseline to the left/top of the glyph
+    float     advance;  // offset to the pen of the next glyph
+    glm::vec4 texRect;  // atlas coords of the top left (xy) and bottom right (zw) corner
+};
+
+struct TextVertex {
+    glm::vec2 position;
+    glm::vec2 texCoords;
+    glm::vec3 color;
+};
+
+// the quads of a string at scale with the pen at the origin, built once for strings that never change
+struct TextLayout {
+    std::vector<TextVertex> vertices;
+};
+
+// draws text from one glyph atlas. Strings are added to a batch during the frame and all of them go out in one
+// draw call, from a vertex buffer that is orphaned every frame. Use with text.vs / text.fs and a projection in pixels.
+//
+// the atlas either holds the coverage of the glyphs at the size they are loaded with (load), or their signed
+// distance fields (loadDistanceField), which text.fs turns into sharp edges at any scale. Distance fields are
+// cached next to the font, so FreeType only runs the first time.
+class TextRenderer {
+public:
+    TextRenderer()
+    {
+        VAO = GpuResources::instance().create(GPU_VERTEX_ARRAY, GPU_GEOMETRY);
+        VBO = GpuResources::instance().create(GPU_BUFFER, GPU_GEOMETRY);
+        glBindVertexArray(VAO.id());
+        glBindBuffer(GL_ARRAY_BUFFER, VBO.id());
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, color));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    TextRenderer(const TextRenderer&) = delete;
+    TextRenderer& operator=(const TextRenderer&) = delete;
+
+    // renders the coverage of the glyphs of the font at pixelSize into the atlas, false if FreeType can't load the
+    // font. Text looks best at scales up to 1
+    bool load(const std::string& fontPath, unsigned int pixelSize)
+    {
+        std::vector<unsigned char> texels;
+        int height = 0;
+        if (!rasterize(fontPath, pixelSize, false, texels, height))
+            return false;
+        upload(texels, height, false);
+        return true;
+    }
+
+    // the atlas holds the distance fields of the glyphs rendered at pixelSize, loaded from cachePath if they were
+    // written for the same font and size. False if there is no cache and FreeType can't render them
+    bool loadDistanceField(const std::string& fontPath, unsigned int pixelSize, const std::string& cachePath)
+    {
+        std::vector<unsigned char> texels;
+        int height = 0;
+        unsigned long long key = cacheKey(fontPath, pixelSize);
+        if (key == 0)
+        {
+            std::cout << "ERROR::FREETYPE: Failed to load font " << fontPath << std::endl;
+            return false;
+        }
+        if (!readCache(cachePath, key, texels, height))
+        {
+            if (!rasterize(fontPath, pixelSize, true, texels, height))
+                return false;
+            writeCache(cachePath, key, texels, height);
+        }
+        upload(texels, height, true);
+        return true;
+    }
+
+    // true if the atlas holds distance fields, text.fs has to know through its distanceField uniform
+    bool isDistanceField() const { return distanceField; }
+
+    // lays out one line of text. Centered text is shifted left by half the width of its glyphs, every line is shifted
+    // down by half the height of its tallest glyph
+    TextLayout layout(const std::string& text, float scale, bool centerAlignment) const
+    {
+        glm::vec2 indent(0.0f);
+        for (unsigned char c : text)
+        {
+            // the size of the outline, without the spread of a distance field
+            glm::vec2 size = glm::max(glyphOf(c).size - 2.0f * glyphPadding, glm::vec2(0.0f));
+            if (centerAlignment)
+                indent.x += size.x * scale;
+            indent.y = std::max(indent.y, size.y * scale);
+        }
+        indent *= 0.5f;
+
+        TextLayout result;
+        result.vertices.reserve(text.size() * 6);
+        float x = 0.0f;
+        for (unsigned char c : text)
+        {
+            const Glyph& glyph = glyphOf(c);
+            float xpos = x + glyph.bearing.x * scale - indent.x;
+            float ypos = -(glyph.size.y - glyph.bearing.y) * scale - indent.y;
+            float w = glyph.size.x * scale;
+            float h = glyph.size.y * scale;
+            x += glyph.advance * scale;
+            if (w == 0.0f || h == 0.0f)
+                continue;
+            const glm::vec4& r = glyph.texRect;
+            TextVertex quad[6] = {
+                { glm::vec2(xpos,     ypos + h), glm::vec2(r.x, r.y), glm::vec3(1.0f) },
+                { glm::vec2(xpos,     ypos),     glm::vec2(r.x, r.w), glm::vec3(1.0f) },
+                { glm::vec2(xpos + w, ypos),     glm::vec2(r.z, r.w), glm::vec3(1.0f) },
+
+                { glm::vec2(xpos,     ypos + h), glm::vec2(r.x, r.y), glm::vec3(1.0f) },
+                { glm::vec2(xpos + w, ypos),     glm::vec2(r.z, r.w), glm::vec3(1.0f) },
+                { glm::vec2(xpos + w, ypos + h), glm::vec2(r.z, r.y), glm::vec3(1.0f) }
+            };
+            result.vertices.insert(result.vertices.end(), quad, quad + 6);
+        }
+        return result;
+    }
+
+    // forgets the text of the last frame
+    void begin()
+    {
+        vertices.clear();
+    }
+
+    // adds a laid out string with its pen at (x, y)
+    void add(const TextLayout& text, float x, float y, const glm::vec3& color)
+    {
+        for (TextVertex vertex : text.vertices)
+        {
+            vertex.position += glm::vec2(x, y);
+            vertex.color = color;
+            vertices.push_back(vertex);
+        }
+    }
+
+    // lays out and adds a string that changes from frame to frame
+    void add(const std::string& text, float x, float y, float scale, const glm::vec3& color, bool centerAlignment)
+    {
+        add(layout(text, scale, centerAlignment), x, y, color);
+    }
+
+    // draws everything added since begin in one call
+    void draw(GLStateCache& state, Shader& shader)
+    {
+        if (vertices.empty())
+            return;
+        // orphaned every frame, the driver hands out fresh memory instead of waiting for last frame's draw
+        GpuResources::bufferData(GL_ARRAY_BUFFER, VBO, vertices.size() * sizeof(TextVertex), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(TextVertex), vertices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        state.invalidate();
+        state.useProgram(shader.ID);
+        state.bindTexture(0, GL_TEXTURE_2D, atlasTexture.id());
+        state.bindVertexArray(VAO.id());
+        glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size()));
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        state.invalidate();
+    }
+
+    unsigned int getAtlasTexture() const { return atlasTexture.id(); }
+
+private:
+    static constexpr const char* CACHE_MAGIC = "SDFA";
+    static const unsigned int CACHE_VERSION = 1;
+
+    Glyph glyphs[TEXT_GLYPH_COUNT];
+    float glyphPadding = 0.0f; // pixels around the outline of every glyph, the spread of a distance field
+    bool distanceField = false;
+    GpuHandle atlasTexture;
+    GpuHandle VAO, VBO;
+    std::vector<TextVertex> vertices;
+
+    const Glyph& glyphOf(unsigned char c) const
+    {
+        return glyphs[c < TEXT_GLYPH_COUNT ? c : '?'];
+    }
+
+    // shelves of glyphs from left to right, a new shelf starts below the tallest glyph of the last one. Fills
+    // glyphs and returns the texels of an atlas TEXT_ATLAS_WIDTH wide and height high
+    bool rasterize(const std::string& fontPath, unsigned int pixelSize, bool sdf, std::vector<unsigned char>& texels, int& height)
+    {
+        FT_Library ft;
+        // All functions return a value different than 0 whenever an error occurred
+        if (FT_Init_FreeType(&ft))
+        {
+            std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
+            return false;
+        }
+        // FreeType reads the font straight out of the mapping, which has to stay until the face is done
+        AssetFile font(fontPath);
+        FT_Face face;
+        if (!font.isOpen() || FT_New_Memory_Face(ft, font.data(), static_cast<FT_Long>(font.size()), 0, &face))
+        {
+            std::cout << "ERROR::FREETYPE: Failed to load font " << fontPath << std::endl;
+            FT_Done_FreeType(ft);
+            return false;
+        }
+        FT_Set_Pixel_Sizes(face, 0, pixelSize);
+        if (sdf)
+        {
+            FT_Int spread = TEXT_SDF_SPREAD;
+            FT_Property_Set(ft, "sdf", "spread", &spread);
+        }
+
+        std::vector<std::vector<unsigned char>> bitmaps(TEXT_GLYPH_COUNT);
+        std::vector<glm::ivec2> origins(TEXT_GLYPH_COUNT);
+        glm::ivec2 pen(TEXT_GLYPH_PADDING);
+        int shelfHeight = 0;
+        bool rendered = true;
+        for (unsigned int c = 0; c < TEXT_GLYPH_COUNT; c++)
+        {
+            glyphs[c] = Glyph{ glm::vec2(0.0f), glm::vec2(0.0f), 0.0f, glm::vec4(0.0f) };
+            if (FT_Load_Char(face, c, sdf ? FT_LOAD_DEFAULT : FT_LOAD_RENDER))
+            {
+                std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
+                continue;
+            }
+            FT_GlyphSlot slot = face->glyph;
+            // FreeType before 2.11 has no distance field renderer
+            if (sdf && FT_Render_Glyph(slot, FT_RENDER_MODE_SDF))
+            {
+                rendered = false;
+                break;
+            }
+            int width = static_cast<int>(slot->bitmap.width);
+            int rows = static_cast<int>(slot->bitmap.rows);
+            if (pen.x + width + TEXT_GLYPH_PADDING > TEXT_ATLAS_WIDTH)
+            {
+                pen = glm::ivec2(TEXT_GLYPH_PADDING, pen.y + shelfHeight + TEXT_GLYPH_PADDING);
+                shelfHeight = 0;
+            }
+            origins[c] = pen;
+            // rows can be padded, the pitch is the real distance between them
+            bitmaps[c].resize(width * rows);
+            for (int y = 0; y < rows; y++)
+                std::copy_n(slot->bitmap.buffer + y * slot->bitmap.pitch, width, bitmaps[c].begin() + y * width);
+            glyphs[c].size = glm::vec2(width, rows);
+            glyphs[c].bearing = glm::vec2(slot->bitmap_left, slot->bitmap_top);
+            glyphs[c].advance = static_cast<float>(slot->advance.x >> 6); // advance is in 1/64 pixels
+            pen.x += width + TEXT_GLYPH_PADDING;
+            shelfHeight = std::max(shelfHeight, rows);
+        }
+        FT_Done_Face(face);
+        FT_Done_FreeType(ft);
+        if (!rendered)
+        {
+            std::cout << "ERROR::FREETYPE: Failed to render distance fields of " << fontPath << std::endl;
+            return false;
+        }
+
+        height = 1;
+        while (height < pen.y + shelfHeight + TEXT_GLYPH_PADDING)
+            height *= 2;
+        texels.assign(TEXT_ATLAS_WIDTH * height, 0);
+        glm::vec2 atlasSize(TEXT_ATLAS_WIDTH, height);
+        for (unsigned int c = 0; c < TEXT_GLYPH_COUNT; c++)
+        {
+            int width = static_cast<int>(glyphs[c].size.x);
+            int rows = static_cast<int>(glyphs[c].size.y);
+            for (int y = 0; y < rows; y++)
+                std::copy_n(bitmaps[c].begin() + y * width, width, texels.begin() + (origins[c].y + y) * TEXT_ATLAS_WIDTH + origins[c].x);
+            glyphs[c].texRect = glm::vec4(glm::vec2(origins[c]) / atlasSize, (glm::vec2(origins[c]) + glyphs[c].size) / atlasSize);
+        }
+        return true;
+    }
+
+    void upload(const std::vector<unsigned char>& texels, int height, bool sdf)
+    {
+        distanceField = sdf;
+        glyphPadding = sdf ? static_cast<float>(TEXT_SDF_SPREAD) : 0.0f;
+        atlasTexture = GpuResources::instance().create(GPU_TEXTURE, GPU_RENDER_TARGETS);
+        glBindTexture(GL_TEXTURE_2D, atlasTexture.id());
+        // disable byte-alignment restriction
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, TEXT_ATLAS_WIDTH, height, 0, GL_RED, GL_UNSIGNED_BYTE, texels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        atlasTexture.setBytes(texels.size());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // FNV-1a over the font file and everything else that shapes the distance fields, 0 if the font can't be read
+    static unsigned long long cacheKey(const std::string& fontPath, unsigned int pixelSize)
+    {
+        AssetFile font(fontPath);
+        if (!font.isOpen())
+            return 0;
+        unsigned long long hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < font.size(); i++)
+            hash = (hash ^ font.data()[i]) * 1099511628211ULL;
+        const unsigned int settings[] = { pixelSize, TEXT_SDF_SPREAD, TEXT_ATLAS_WIDTH, TEXT_GLYPH_PADDING, TEXT_GLYPH_COUNT };
+        for (unsigned int value : settings)
+            hash = (hash ^ value) * 1099511628211ULL;
+        return hash;
+    }
+
+    bool readCache(const std::string& path, unsigned long long key, std::vector<unsigned char>& texels, int& height)
+    {
+        AssetFile file(path);
+        const size_t headerSize = 4 + sizeof(unsigned int) + sizeof(unsigned long long) + sizeof(int);
+        if (!file.isOpen() || file.size() < headerSize)
+            return false;
+        const unsigned char* position = file.data();
+        unsigned int version = 0;
+        unsigned long long fileKey = 0;
+        std::memcpy(&version, position + 4, sizeof(version));
+        std::memcpy(&fileKey, position + 4 + sizeof(version), sizeof(fileKey));
+        std::memcpy(&height, position + 4 + sizeof(version) + sizeof(fileKey), sizeof(height));
+        if (std::string(reinterpret_cast<const char*>(position), 4) != CACHE_MAGIC || version != CACHE_VERSION || fileKey != key || height <= 0
+            || file.size() < headerSize + sizeof(glyphs) || (file.size() - headerSize - sizeof(glyphs)) / TEXT_ATLAS_WIDTH < static_cast<size_t>(height))
+            return false;
+        position += headerSize;
+        std::memcpy(glyphs, position, sizeof(glyphs));
+        texels.assign(position + sizeof(glyphs), position + sizeof(glyphs) + TEXT_ATLAS_WIDTH * height);
+        return true;
+    }
+
+    void writeCache(const std::string& path, unsigned long long key, const std::vector<unsigned char>& texels, int height) const
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::TEXT::CANNOT_WRITE " << path << std::endl;
+            return;
+        }
+        unsigned int version = CACHE_VERSION;
+        file.write(CACHE_MAGIC, 4);
+        file.write((const char*)&version, sizeof(version));
+        file.write((const char*)&key, sizeof(key));
+        file.write((const char*)&height, sizeof(height));
+        file.write((const char*)glyphs, sizeof(glyphs));
+        file.write((const char*)texels.data(), texels.size());
+    }
+};
+#endif
@@ -0,0 +1,568 @@
+#include "TextureCooker.h"
+#include "JobSystem.h"
+#include "stb_image.h"
+
+#include <glm/glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+//bump when the encoders or the layout of the file change
+const unsigned int TEXTURE_COOK_VERSION = 1;
+const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+const unsigned int KTX_ENDIANNESS = 0x04030201;
+//the key/value pair that ties a file to its images
+const char KTX_SOURCE_KEY[] = "cgSourceKey";
+
+//FNV-1a
+static unsigned long long hashBytes(unsigned long long hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+namespace
+{
+	struct KtxHeader
+	{
+		unsigned char identifier[12];
+		unsigned int endianness;
+		unsigned int glType;
+		unsigned int glTypeSize;
+		unsigned int glFormat;
+		unsigned int glInternalFormat;
+		unsigned int glBaseInternalFormat;
+		unsigned int pixelWidth;
+		unsigned int pixelHeight;
+		unsigned int pixelDepth;
+		unsigned int numberOfArrayElements;
+		unsigned int numberOfFaces;
+		unsigned int numberOfMipmapLevels;
+		unsigned int bytesOfKeyValueData;
+	};
+
+	size_t padded(size_t size)
+	{
+		return (size + 3) & ~static_cast<size_t>(3);
+	}
+
+	unsigned int mipLevels(int width, int height)
+	{
+		unsigned int levels = 1;
+		while ((width | height) >> levels) {
+			levels++;
+		}
+		return levels;
+	}
+
+	bool isCookedFormat(GLenum format)
+	{
+		return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+			|| format == GL_COMPRESSED_RG_RGTC2 || format == GL_RGBA8;
+	}
+
+	GLenum baseFormatOf(GLenum format)
+	{
+		if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) {
+			return GL_RGB;
+		}
+		if (format == GL_COMPRESSED_RG_RGTC2) {
+			return GL_RG;
+		}
+		return GL_RGBA;
+	}
+
+	const char* nameOf(GLenum format)
+	{
+		switch (format) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return "BC1";
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return "BC3";
+		case GL_COMPRESSED_RG_RGTC2: return "BC5";
+		default: return "RGBA8";
+		}
+	}
+
+	unsigned short pack565(const glm::vec3& color)
+	{
+		int r = std::min(std::max(static_cast<int>(color.r * 31.0f / 255.0f + 0.5f), 0), 31);
+		int g = std::min(std::max(static_cast<int>(color.g * 63.0f / 255.0f + 0.5f), 0), 63);
+		int b = std::min(std::max(static_cast<int>(color.b * 31.0f / 255.0f + 0.5f), 0), 31);
+		return static_cast<unsigned short>((r << 11) | (g << 5) | b);
+	}
+
+	glm::vec3 unpack565(unsigned short color)
+	{
+		int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+		return glm::vec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+	}
+
+	//the nearest of the four colours between the endpoints for every texel, c0 > c1 for the four colour mode.
+	//Returns the squared error
+	float fitIndices(const glm::vec3 colors[16], unsigned short& c0, unsigned short& c1, unsigned int& indices)
+	{
+		if (c0 < c1) {
+			std::swap(c0, c1);
+		}
+		glm::vec3 palette[4];
+		palette[0] = unpack565(c0);
+		palette[1] = unpack565(c1);
+		palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+		palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+		unsigned int colorCount = c0 == c1 ? 1 : 4;
+
+		float error = 0.0f;
+		indices = 0;
+		for (unsigned int i = 0; i < 16; i++) {
+			unsigned int best = 0;
+			float bestDistance = FLT_MAX;
+			for (unsigned int p = 0; p < colorCount; p++) {
+				glm::vec3 difference = colors[i] - palette[p];
+				float distance = glm::dot(difference, difference);
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= best << (2 * i);
+			error += bestDistance;
+		}
+		return error;
+	}
+
+	//BC1 block of 16 RGBA texels: endpoints along the principal axis of the colours, then refined by least squares
+	//for the indices they got
+	void encodeColorBlock(const unsigned char* texels, unsigned char* block)
+	{
+		glm::vec3 colors[16];
+		glm::vec3 mean(0.0f);
+		for (unsigned int i = 0; i < 16; i++) {
+			colors[i] = glm::vec3(texels[i * 4], texels[i * 4 + 1], texels[i * 4 + 2]);
+			mean += colors[i] / 16.0f;
+		}
+		float covariance[6] = {};
+		for (unsigned int i = 0; i < 16; i++) {
+			glm::vec3 d = colors[i] - mean;
+			covariance[0] += d.r * d.r;
+			covariance[1] += d.r * d.g;
+			covariance[2] += d.r * d.b;
+			covariance[3] += d.g * d.g;
+			covariance[4] += d.g * d.b;
+			covariance[5] += d.b * d.b;
+		}
+		//power iteration for the principal axis
+		glm::vec3 axis(1.0f);
+		for (unsigned int iteration = 0; iteration < 8; iteration++) {
+			axis = glm::vec3(covariance[0] * axis.r + covariance[1] * axis.g + covariance[2] * axis.b,
+				covariance[1] * axis.r + covariance[3] * axis.g + covariance[4] * axis.b,
+				covariance[2] * axis.r + covariance[4] * axis.g + covariance[5] * axis.b);
+			float largest = std::max(std::max(std::abs(axis.r), std::abs(axis.g)), std::abs(axis.b));
+			if (largest == 0.0f) {
+				axis = glm::vec3(1.0f);
+				break;
+			}
+			axis /= largest;
+		}
+		axis = glm::normalize(axis);
+
+		float low = FLT_MAX, high = -FLT_MAX;
+		for (unsigned int i = 0; i < 16; i++) {
+			float t = glm::dot(colors[i] - mean, axis);
+			low = std::min(low, t);
+			high = std::max(high, t);
+		}
+		//the extremes are rarely hit exactly once quantised, pulling the endpoints in a little spreads the error
+		float inset = (high - low) / 16.0f;
+		unsigned short c0 = pack565(mean + axis * (high - inset));
+		unsigned short c1 = pack565(mean + axis * (low + inset));
+		unsigned int indices;
+		float error = fitIndices(colors, c0, c1, indices);
+
+		float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		glm::vec3 ax(0.0f), bx(0.0f);
+		for (unsigned int i = 0; i < 16; i++) {
+			float w = weights[(indices >> (2 * i)) & 3];
+			aa += w * w;
+			ab += w * (1.0f - w);
+			bb += (1.0f - w) * (1.0f - w);
+			ax += w * colors[i];
+			bx += (1.0f - w) * colors[i];
+		}
+		float determinant = aa * bb - ab * ab;
+		if (std::abs(determinant) > 1e-6f) {
+			unsigned short r0 = pack565((ax * bb - bx * ab) / determinant);
+			unsigned short r1 = pack565((bx * aa - ax * ab) / determinant);
+			unsigned int refinedIndices;
+			float refinedError = fitIndices(colors, r0, r1, refinedIndices);
+			if (refinedError < error) {
+				c0 = r0;
+				c1 = r1;
+				indices = refinedIndices;
+			}
+		}
+
+		block[0] = static_cast<unsigned char>(c0 & 0xFF);
+		block[1] = static_cast<unsigned char>(c0 >> 8);
+		block[2] = static_cast<unsigned char>(c1 & 0xFF);
+		block[3] = static_cast<unsigned char>(c1 >> 8);
+		for (unsigned int i = 0; i < 4; i++) {
+			block[4 + i] = static_cast<unsigned char>((indices >> (8 * i)) & 0xFF);
+		}
+	}
+
+	//BC4 block of one channel of 16 RGBA texels, the eight value mode between its smallest and largest value. BC3
+	//stores alpha and BC5 both of its channels like this
+	void encodeChannelBlock(const unsigned char* texels, unsigned int channel, unsigned char* block)
+	{
+		unsigned char low = 255, high = 0;
+		for (unsigned int i = 0; i < 16; i++) {
+			low = std::min(low, texels[i * 4 + channel]);
+			high = std::max(high, texels[i * 4 + channel]);
+		}
+		block[0] = high;
+		block[1] = low;
+		int palette[8] = { high, low };
+		for (int i = 2; i < 8; i++) {
+			palette[i] = ((8 - i) * high + (i - 1) * low + 3) / 7;
+		}
+
+		unsigned long long indices = 0;
+		if (high != low) {
+			for (unsigned int i = 0; i < 16; i++) {
+				int value = texels[i * 4 + channel];
+				unsigned long long best = 0;
+				int bestDistance = 256;
+				for (unsigned int p = 0; p < 8; p++) {
+					int distance = std::abs(value - palette[p]);
+					if (distance < bestDistance) {
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= best << (3 * i);
+			}
+		}
+		for (unsigned int i = 0; i < 6; i++) {
+			block[2 + i] = static_cast<unsigned char>((indices >> (8 * i)) & 0xFF);
+		}
+	}
+
+	//encodes an RGBA8 image into format, the rows of blocks in parallel. Blocks over the edge repeat the last texels
+	void encodeImage(const std::vector<unsigned char>& rgba, int width, int height, GLenum format, unsigned char* target)
+	{
+		if (format == GL_RGBA8) {
+			std::memcpy(target, rgba.data(), rgba.size());
+			return;
+		}
+		unsigned int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+		size_t blockSize = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+		JobSystem::instance().parallelFor(blocksY, [&](unsigned int by) {
+			unsigned char texels[64];
+			for (unsigned int bx = 0; bx < blocksX; bx++) {
+				for (int y = 0; y < 4; y++) {
+					for (int x = 0; x < 4; x++) {
+						int sx = std::min(static_cast<int>(bx) * 4 + x, width - 1);
+						int sy = std::min(static_cast<int>(by) * 4 + y, height - 1);
+						std::memcpy(texels + (y * 4 + x) * 4, &rgba[(static_cast<size_t>(sy) * width + sx) * 4], 4);
+					}
+				}
+				unsigned char* block = target + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+				if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) {
+					encodeColorBlock(texels, block);
+				}
+				else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+					encodeChannelBlock(texels, 3, block);
+					encodeColorBlock(texels, block + 8);
+				}
+				else {
+					encodeChannelBlock(texels, 0, block);
+					encodeChannelBlock(texels, 1, block + 8);
+				}
+			}
+		}, 4);
+	}
+
+	//the next level of a mip chain, every texel the average of the 2x2 texels under it. Normals are averaged as
+	//vectors and normalised again
+	void downsample(const std::vector<unsigned char>& source, int width, int height, bool normals, std::vector<unsigned char>& target)
+	{
+		int targetWidth = std::max(width / 2, 1), targetHeight = std::max(height / 2, 1);
+		target.assign(static_cast<size_t>(targetWidth) * targetHeight * 4, 0);
+		for (int y = 0; y < targetHeight; y++) {
+			for (int x = 0; x < targetWidth; x++) {
+				const unsigned char* texels[4];
+				for (int i = 0; i < 4; i++) {
+					int sx = std::min(x * 2 + (i & 1), width - 1);
+					int sy = std::min(y * 2 + (i >> 1), height - 1);
+					texels[i] = &source[(static_cast<size_t>(sy) * width + sx) * 4];
+				}
+				unsigned char* texel = &target[(static_cast<size_t>(y) * targetWidth + x) * 4];
+				for (int c = 0; c < 4; c++) {
+					texel[c] = static_cast<unsigned char>((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+				}
+				if (normals) {
+					glm::vec3 normal(0.0f);
+					for (int i = 0; i < 4; i++) {
+						normal += glm::vec3(texels[i][0], texels[i][1], texels[i][2]) / 127.5f - 1.0f;
+					}
+					if (glm::dot(normal, normal) > 0.0f) {
+						normal = (glm::normalize(normal) + 1.0f) * 127.5f;
+						for (int c = 0; c < 3; c++) {
+							texel[c] = static_cast<unsigned char>(std::min(std::max(normal[c] + 0.5f, 0.0f), 255.0f));
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+std::string TextureCooker::cachePath(const std::string& sourcePath, const std::string& extension)
+{
+	size_t dot = sourcePath.find_last_of('.');
+	size_t slash = sourcePath.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return sourcePath + extension;
+	}
+	return sourcePath.substr(0, dot) + extension;
+}
+
+size_t TextureCooker::imageSize(GLenum format, int width, int height)
+{
+	if (format == GL_RGBA8) {
+		return static_cast<size_t>(width) * height * 4;
+	}
+	size_t blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+	return blocks * (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16);
+}
+
+bool TextureCooker::load(const std::vector<std::string>& sourcePaths, TextureUsage usage, bool compress, bool mipmaps, const std::string& cachePath, CookedTexture& texture)
+{
+	//how the images are cooked is part of the key, the same image cooked for another GPU is a different file
+	unsigned int settings[4] = { TEXTURE_COOK_VERSION, static_cast<unsigned int>(usage), compress ? 1u : 0u, mipmaps ? 1u : 0u };
+	unsigned long long key = hashBytes(14695981039346656037ULL, settings, sizeof(settings));
+	//a packed texture was cooked along with the archive and its images aren't even read, as long as the GPU takes
+	//its format
+	if (AssetArchive::instance().contains(cachePath) && read(cachePath, key, true, texture)) {
+		if (compress || texture.format == GL_RGBA8 || texture.format == GL_COMPRESSED_RG_RGTC2) {
+			return true;
+		}
+		texture.file.close();
+	}
+	for (const std::string& sourcePath : sourcePaths) {
+		MappedFile source(sourcePath);
+		if (!source.isOpen()) {
+			std::cout << "Texture failed to load at path: " << sourcePath << std::endl;
+			return false;
+		}
+		key = hashBytes(key, source.data(), source.size());
+	}
+
+	if (read(cachePath, key, false, texture)) {
+		return true;
+	}
+	if (!cook(sourcePaths, usage, compress, mipmaps, texture)) {
+		return false;
+	}
+	write(cachePath, key, texture);
+	size_t bytes = 0;
+	for (size_t size : texture.imageSizes) {
+		bytes += size * texture.faces;
+	}
+	std::cout << "TEXTURE:: cooked " << sourcePaths[0] << (sourcePaths.size() > 1 ? " and the other faces" : "") << " into " << cachePath
+		<< " as " << nameOf(texture.format) << ", " << texture.width << "x" << texture.height << " in " << texture.levels << " levels, "
+		<< bytes / 1024 << " KB" << std::endl;
+	return true;
+}
+
+bool TextureCooker::read(const std::string& path, unsigned long long key, bool trustPacked, CookedTexture& texture)
+{
+	AssetFile& file = texture.file;
+	if (!file.open(path)) {
+		return false;
+	}
+	KtxHeader header;
+	if (file.size() < sizeof(KtxHeader)) {
+		file.close();
+		return false;
+	}
+	std::memcpy(&header, file.data(), sizeof(KtxHeader));
+	if (!std::equal(KTX_IDENTIFIER, KTX_IDENTIFIER + 12, header.identifier) || header.endianness != KTX_ENDIANNESS
+		|| !isCookedFormat(header.glInternalFormat) || header.pixelWidth == 0 || header.pixelHeight == 0
+		|| header.pixelWidth > 16384 || header.pixelHeight > 16384 || header.pixelDepth != 0 || header.numberOfArrayElements != 0
+		|| (header.numberOfFaces != 1 && header.numberOfFaces != 6) || header.numberOfMipmapLevels == 0
+		|| header.numberOfMipmapLevels > mipLevels(header.pixelWidth, header.pixelHeight)
+		|| header.bytesOfKeyValueData > file.size() - sizeof(KtxHeader)) {
+		file.close();
+		return false;
+	}
+
+	//the key/value pairs, one of them has to be the key of the images
+	bool keyMatches = false;
+	size_t position = sizeof(KtxHeader);
+	size_t end = position + header.bytesOfKeyValueData;
+	while (end - position >= 4) {
+		unsigned int pairSize;
+		std::memcpy(&pairSize, file.data() + position, 4);
+		position += 4;
+		if (pairSize > end - position) {
+			break;
+		}
+		if (pairSize == sizeof(KTX_SOURCE_KEY) + sizeof(key) && std::memcmp(file.data() + position, KTX_SOURCE_KEY, sizeof(KTX_SOURCE_KEY)) == 0) {
+			unsigned long long fileKey;
+			std::memcpy(&fileKey, file.data() + position + sizeof(KTX_SOURCE_KEY), sizeof(fileKey));
+			keyMatches = fileKey == key;
+		}
+		position += std::min(padded(pairSize), end - position);
+	}
+	if (!keyMatches && !(trustPacked && file.packed())) {
+		file.close();
+		return false;
+	}
+
+	texture.format = header.glInternalFormat;
+	texture.width = static_cast<int>(header.pixelWidth);
+	texture.height = static_cast<int>(header.pixelHeight);
+	texture.faces = header.numberOfFaces;
+	texture.levels = header.numberOfMipmapLevels;
+	texture.images.clear();
+	texture.imageSizes.clear();
+	position = end;
+	for (unsigned int level = 0; level < texture.levels; level++) {
+		size_t expected = imageSize(texture.format, std::max(texture.width >> level, 1), std::max(texture.height >> level, 1));
+		unsigned int size = 0;
+		if (file.size() - position < 4) {
+			file.close();
+			return false;
+		}
+		std::memcpy(&size, file.data() + position, 4);
+		position += 4;
+		if (size != expected || (file.size() - position) / texture.faces < padded(size)) {
+			file.close();
+			return false;
+		}
+		texture.imageSizes.push_back(size);
+		for (unsigned int face = 0; face < texture.faces; face++) {
+			texture.images.push_back(file.data() + position);
+			position += padded(size);
+		}
+	}
+	return true;
+}
+
+bool TextureCooker::cook(const std::vector<std::string>& sourcePaths, TextureUsage usage, bool compress, bool mipmaps, CookedTexture& texture)
+{
+	std::vector<std::vector<unsigned char>> faces;
+	bool alpha = false;
+	int width = 0, height = 0;
+	for (const std::string& sourcePath : sourcePaths) {
+		int faceWidth, faceHeight, components;
+		unsigned char* data = stbi_load(sourcePath.c_str(), &faceWidth, &faceHeight, &components, 4);
+		if (!data || (!faces.empty() && (faceWidth != width || faceHeight != height))) {
+			std::cout << "Texture failed to load at path: " << sourcePath << std::endl;
+			stbi_image_free(data);
+			return false;
+		}
+		width = faceWidth;
+		height = faceHeight;
+		faces.push_back(std::vector<unsigned char>(data, data + static_cast<size_t>(width) * height * 4));
+		stbi_image_free(data);
+		for (size_t i = 3; i < faces.back().size() && (components == 2 || components == 4); i += 4) {
+			alpha = alpha || faces.back()[i] < 255;
+		}
+	}
+
+	if (usage == TEXTURE_NORMAL) {
+		texture.format = GL_COMPRESSED_RG_RGTC2;
+	}
+	else if (!compress) {
+		texture.format = GL_RGBA8;
+	}
+	else {
+		texture.format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	}
+	texture.width = width;
+	texture.height = height;
+	texture.faces = static_cast<unsigned int>(faces.size());
+	texture.levels = mipmaps ? mipLevels(width, height) : 1;
+
+	//level after level, the faces of a level one after another like in the file
+	std::vector<size_t> offsets;
+	size_t total = 0;
+	texture.imageSizes.clear();
+	for (unsigned int level = 0; level < texture.levels; level++) {
+		size_t size = imageSize(texture.format, std::max(width >> level, 1), std::max(height >> level, 1));
+		texture.imageSizes.push_back(size);
+		for (unsigned int face = 0; face < texture.faces; face++) {
+			offsets.push_back(total);
+			total += size;
+		}
+	}
+	texture.memory.resize(total);
+
+	std::vector<unsigned char> smaller;
+	for (unsigned int face = 0; face < texture.faces; face++) {
+		std::vector<unsigned char>& image = faces[face];
+		for (unsigned int level = 0; level < texture.levels; level++) {
+			int levelWidth = std::max(width >> level, 1), levelHeight = std::max(height >> level, 1);
+			encodeImage(image, levelWidth, levelHeight, texture.format, &texture.memory[offsets[level * texture.faces + face]]);
+			if (level + 1 < texture.levels) {
+				downsample(image, levelWidth, levelHeight, usage == TEXTURE_NORMAL, smaller);
+				image.swap(smaller);
+			}
+		}
+	}
+	texture.images.clear();
+	for (size_t offset : offsets) {
+		texture.images.push_back(texture.memory.data() + offset);
+	}
+	return true;
+}
+
+void TextureCooker::write(const std::string& path, unsigned long long key, const CookedTexture& texture)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cout << "WARNING::TEXTURE:: could not write " << path << std::endl;
+		return;
+	}
+	unsigned int pairSize = static_cast<unsigned int>(sizeof(KTX_SOURCE_KEY) + sizeof(key));
+	KtxHeader header;
+	std::memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+	header.endianness = KTX_ENDIANNESS;
+	header.glType = texture.compressed() ? 0 : GL_UNSIGNED_BYTE;
+	header.glTypeSize = 1;
+	header.glFormat = texture.compressed() ? 0 : GL_RGBA;
+	header.glInternalFormat = texture.format;
+	header.glBaseInternalFormat = baseFormatOf(texture.format);
+	header.pixelWidth = static_cast<unsigned int>(texture.width);
+	header.pixelHeight = static_cast<unsigned int>(texture.height);
+	header.pixelDepth = 0;
+	header.numberOfArrayElements = 0;
+	header.numberOfFaces = texture.faces;
+	header.numberOfMipmapLevels = texture.levels;
+	header.bytesOfKeyValueData = static_cast<unsigned int>(4 + padded(pairSize));
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	const char padding[4] = {};
+	file.write(reinterpret_cast<const char*>(&pairSize), sizeof(pairSize));
+	file.write(KTX_SOURCE_KEY, sizeof(KTX_SOURCE_KEY));
+	file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+	file.write(padding, padded(pairSize) - pairSize);
+
+	for (unsigned int level = 0; level < texture.levels; level++) {
+		unsigned int size = static_cast<unsigned int>(texture.imageSizes[level]);
+		file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+		for (unsigned int face = 0; face < texture.faces; face++) {
+			file.write(reinterpret_cast<const char*>(texture.images[level * texture.faces + face]), size);
+			file.write(padding, padded(size) - size);
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+#include "AssetArchive.h"
+
+#include <string>
+#include <vector>
+
+// what the texels of an image stand for, picks the encoding it is cooked into
+enum TextureUsage
+{
+	TEXTURE_COLOR,  // BC1, or BC3 where the image has alpha
+	TEXTURE_NORMAL  // BC5, x and y of a tangent space normal, z is sqrt(1 - x * x - y * y)
+};
+
+// a cooked texture ready for upload, level after level and the faces of a level one after another
+struct CookedTexture
+{
+	GLenum format = 0; // GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_RG_RGTC2 or GL_RGBA8
+	int width = 0;
+	int height = 0;
+	unsigned int faces = 0;
+	unsigned int levels = 0;
+	std::vector<const unsigned char*> images;
+	std::vector<size_t> imageSizes; // bytes of one face of every level
+
+	AssetFile file; // images point into the cache file when it was read, or into the asset archive
+	std::vector<unsigned char> memory; // or into this when the texture was just cooked
+
+	bool compressed() const
+	{
+		return format != GL_RGBA8;
+	}
+};
+
+// textures cooked once into a KTX 1.1 file next to their image, with their whole mip chain. A warm start maps the file
+// and hands the blocks straight to the GPU, instead of decoding a JPEG or PNG and generating mipmaps every time. The
+// file belongs to its images through a key hashed from their bytes and how they are cooked, changing either cooks
+// them again. A cooked texture in the asset archive was cooked together with it and is used without reading its images.
+class TextureCooker
+{
+private:
+	static bool read(const std::string& path, unsigned long long key, bool trustPacked, CookedTexture& texture);
+	static bool cook(const std::vector<std::string>& sourcePaths, TextureUsage usage, bool compress, bool mipmaps, CookedTexture& texture);
+	static void write(const std::string& path, unsigned long long key, const CookedTexture& texture);
+
+public:
+	// the cache file of the image at sourcePath, its extension replaced by extension
+	static std::string cachePath(const std::string& sourcePath, const std::string& extension = ".ktx");
+
+	// the images at sourcePaths, one or the six faces of a cubemap, read from cachePath or cooked into it. Colour is
+	// only compressed with compress, where the GPU has S3TC, and is RGBA8 otherwise. False if an image can't be loaded
+	static bool load(const std::vector<std::string>& sourcePaths, TextureUsage usage, bool compress, bool mipmaps, const std::string& cachePath, CookedTexture& texture);
+
+	// bytes of a width x height image in format
+	static size_t imageSize(GLenum format, int width, int height);
+};
@@ -0,0 +1,665 @@
+#ifndef TEXTURE_MANAGER_H
+#define TEXTURE_MANAGER_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include "GLExtensions.h"
+#include "TextureCooker.h"
+#include "AssetArchive.h"
+#include "GpuResources.h"
+#include "JobSystem.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+#include <condition_variable>
+
+// a counted reference to a texture of the TextureManager. Copies share the texture, it is deleted together with the
+// last handle to it
+class TextureHandle
+{
+public:
+    TextureHandle() : slot(-1)
+    {
+    }
+
+    TextureHandle(const TextureHandle& other);
+    TextureHandle(TextureHandle&& other) : slot(other.slot)
+    {
+        other.slot = -1;
+    }
+    TextureHandle& operator=(TextureHandle other)
+    {
+        std::swap(slot, other.slot);
+        return *this;
+    }
+    ~TextureHandle();
+
+    // the GL texture, 0 for an empty handle
+    unsigned int id() const;
+
+    // the GL texture for drawing. Marks it as used this frame and streams it in again if it was evicted, the ID
+    // changes when a texture is evicted, so draw code asks for it every time
+    unsigned int use() const;
+
+    bool valid() const
+    {
+        return slot >= 0;
+    }
+
+private:
+    friend class TextureManager;
+
+    // takes over a reference the manager already counted
+    explicit TextureHandle(int slot) : slot(slot)
+    {
+    }
+
+    int slot;
+};
+
+// uploads of streamed textures stop for the frame once they took this long, one piece still goes up every frame
+#define TEXTURE_STREAM_BUDGET_MS 2.0
+// the size of the pieces the images go up in
+#define TEXTURE_STREAM_CHUNK_BYTES (512 * 1024)
+// a texture has to go undrawn for this many frames before it is evicted to keep the GpuResources budget
+#define TEXTURE_EVICT_FRAMES 120
+
+// every texture loaded from an image file, shared by the whole process. Images are keyed by a hash of their
+// normalised path, so loading the same model twice or models that share textures never decodes or uploads an image
+// a second time. Images come cooked with their mip chain from the TextureCooker, storage is immutable
+// (glTexStorage2D) where the driver supports it.
+//
+// Textures are streamed: a load hands out a 1x1 placeholder right away and a worker of the JobSystem reads or cooks
+// the images meanwhile. update uploads what has arrived through a pixel buffer in small pieces, within a time budget
+// per frame. Levels go up from the smallest, so the texture keeps its ID and just gets sharper.
+//
+// The textures are GL objects of the GpuResources. While those are over budget, update evicts the texture that was
+// drawn least recently (through TextureHandle::use) back to its placeholder, it is streamed in again as soon as it
+// is drawn. Textures that are never drawn through use, like the skybox, are never evicted.
+class TextureManager
+{
+public:
+    static TextureManager& instance()
+    {
+        static TextureManager manager;
+        return manager;
+    }
+
+    // a mipmapped, repeating 2D texture of the image at path, cooked by the TextureCooker. srgb stores colour images
+    // as sRGB, for gamma correct lighting, normalMap cooks the image as a tangent space normal map (BC5, x and y only).
+    // An image that can't be loaded keeps its placeholder
+    TextureHandle load(const std::string& path, bool srgb = false, bool normalMap = false)
+    {
+        std::string normalized = AssetArchive::normalizePath(path);
+        unsigned long long key = hashPath(FNV_OFFSET, normalized);
+        key = (key ^ (normalMap ? KIND_NORMAL : srgb ? KIND_SRGB : KIND_LINEAR)) * FNV_PRIME;
+        int slot = find(key, normalized);
+        if (slot >= 0)
+            return reference(slot);
+
+        Source source = { GL_TEXTURE_2D, std::vector<std::string>{ path }, normalMap ? TEXTURE_NORMAL : TEXTURE_COLOR, srgb && !normalMap, true,
+            TextureCooker::cachePath(path) };
+        TextureHandle handle = add(key, normalized, source);
+        stream(handle.slot);
+        return handle;
+    }
+
+    // a cubemap of six images in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X and on, without mipmaps and clamped to
+    // the edges. The faces have to be the same size, they are cooked together into one file next to the first. Black
+    // until they arrive
+    TextureHandle loadCubemap(const std::vector<std::string>& faces)
+    {
+        std::string normalized;
+        for (unsigned int i = 0; i < faces.size(); i++)
+            normalized += AssetArchive::normalizePath(faces[i]) + '\n';
+        unsigned long long key = (hashPath(FNV_OFFSET, normalized) ^ KIND_CUBEMAP) * FNV_PRIME;
+        int slot = find(key, normalized);
+        if (slot >= 0)
+            return reference(slot);
+        if (faces.size() != 6)
+        {
+            std::cout << "Cubemap texture failed to load, it needs six faces" << std::endl;
+            return TextureHandle();
+        }
+
+        Source source = { GL_TEXTURE_CUBE_MAP, faces, TEXTURE_COLOR, false, false, TextureCooker::cachePath(faces[0], ".cube.ktx") };
+        TextureHandle handle = add(key, normalized, source);
+        stream(handle.slot);
+        return handle;
+    }
+
+    // evicts textures while the GpuResources are over budget and uploads pieces of the images the workers have
+    // finished, for about budgetMs. Call once a frame on the GL thread
+    void update(double budgetMs = TEXTURE_STREAM_BUDGET_MS)
+    {
+        if (released)
+            return;
+        frame++;
+        while (GpuResources::instance().overBudget() && evictLeastRecentlyUsed())
+            ;
+        collectArrivals();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (!streams.empty())
+        {
+            if (uploadNext(streams.front()))
+                streams.pop_front();
+            if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budgetMs)
+                break;
+        }
+    }
+
+    // waits for the images of handle and uploads all of them, for work that needs the real texture right away
+    void finish(const TextureHandle& handle)
+    {
+        if (released || handle.slot < 0)
+            return;
+        while (entries[handle.slot].streaming)
+        {
+            collectArrivals();
+            for (auto it = streams.begin(); it != streams.end(); ++it)
+            {
+                if (it->slot != handle.slot || it->serial != entries[handle.slot].serial)
+                    continue;
+                while (!uploadNext(*it))
+                    ;
+                streams.erase(it);
+                break;
+            }
+            if (!entries[handle.slot].streaming)
+                break;
+            std::unique_lock<std::mutex> lock(arrivalMutex);
+            arrivalSignal.wait(lock, [this] { return !arrivals.empty(); });
+        }
+    }
+
+    // waits for the images of every texture and uploads all of them
+    void finish()
+    {
+        if (released)
+            return;
+        while (true)
+        {
+            collectArrivals();
+            for (Stream& pending : streams)
+                while (!uploadNext(pending))
+                    ;
+            streams.clear();
+            std::unique_lock<std::mutex> lock(arrivalMutex);
+            if (inFlight == 0 && arrivals.empty())
+                break;
+            arrivalSignal.wait(lock, [this] { return inFlight == 0 || !arrivals.empty(); });
+        }
+    }
+
+    // bytes of all textures that are alive, as the GPU stores them
+    size_t memoryUsage() const
+    {
+        return bytes;
+    }
+
+    unsigned int textureCount() const
+    {
+        return static_cast<unsigned int>(slotOfKey.size());
+    }
+
+    // textures that still show their placeholder or aren't sharp yet
+    unsigned int streamingCount() const
+    {
+        return streaming;
+    }
+
+    // loads that were handed an already loaded texture instead of decoding the image again
+    unsigned int sharedLoads() const
+    {
+        return shared;
+    }
+
+    // textures evicted to keep the budget so far
+    unsigned int evictionCount() const
+    {
+        return evictions;
+    }
+
+    void report() const
+    {
+        std::cout << "TEXTURE:: " << textureCount() << " textures in " << memoryUsage() / (1024.0 * 1024.0) << " MB, "
+            << sharedLoads() << " loads shared, " << streamingCount() << " streaming, " << evictionCount() << " evicted" << std::endl;
+    }
+
+    // deletes every texture while the context is still there, once the workers are done with their images. Handles
+    // released afterwards do nothing
+    void releaseAll()
+    {
+        {
+            std::unique_lock<std::mutex> lock(arrivalMutex);
+            arrivalSignal.wait(lock, [this] { return inFlight == 0; });
+            arrivals.clear();
+        }
+        streams.clear();
+        pixelBuffer = GpuHandle();
+        entries.clear();
+        freeSlots.clear();
+        slotOfKey.clear();
+        bytes = 0;
+        streaming = 0;
+        released = true;
+    }
+
+private:
+    friend class TextureHandle;
+
+    static const unsigned long long FNV_OFFSET = 14695981039346656037ULL;
+    static const unsigned long long FNV_PRIME = 1099511628211ULL;
+    // what a path is loaded as, the same image may be loaded as more than one of these
+    enum Kind {
+        KIND_LINEAR = 1,
+        KIND_SRGB = 2,
+        KIND_CUBEMAP = 3,
+        KIND_NORMAL = 4
+    };
+
+    // where the images of a texture come from, kept to stream them in again after an eviction
+    struct Source {
+        GLenum target;
+        std::vector<std::string> paths;
+        TextureUsage usage;
+        bool srgb;
+        bool mipmaps;
+        std::string cachePath;
+    };
+
+    struct Entry {
+        unsigned long long key;
+        std::string path; // normalised, tells keys that collide apart
+        GpuHandle texture;
+        Source source;
+        unsigned int references;
+        size_t bytes;
+        unsigned long long serial; // tells the texture apart from later ones in the same slot
+        unsigned long long lastUsed; // frame it was last drawn in, 0 if it is never drawn through use
+        bool streaming;
+        bool evicted;
+    };
+
+    // a texture whose images are on their way from a worker to the GPU
+    struct Stream {
+        int slot;
+        unsigned long long serial;
+        GLenum target;
+        bool srgb;
+        std::unique_ptr<CookedTexture> cooked; // null if the images couldn't be loaded
+        unsigned int uploaded; // levels uploaded so far, the smallest first
+        unsigned int face; // of the level that is going up
+        unsigned int row;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<int> freeSlots;
+    std::unordered_map<unsigned long long, int> slotOfKey;
+    size_t bytes = 0;
+    unsigned int shared = 0;
+    unsigned int streaming = 0;
+    unsigned long long serials = 0;
+    unsigned long long frame = 1;
+    unsigned int evictions = 0;
+    bool released = false;
+
+    // streams whose images have arrived, in the order they did
+    std::deque<Stream> streams;
+    GpuHandle pixelBuffer;
+
+    // filled by the workers
+    std::mutex arrivalMutex;
+    std::condition_variable arrivalSignal;
+    std::vector<Stream> arrivals;
+    unsigned int inFlight = 0;
+
+    TextureManager()
+    {
+    }
+
+    // no texture is deleted here, the context is gone by the time statics are destroyed. See releaseAll
+    ~TextureManager()
+    {
+    }
+
+    TextureManager(const TextureManager&) = delete;
+    TextureManager& operator=(const TextureManager&) = delete;
+
+    // FNV-1a
+    static unsigned long long hashPath(unsigned long long hash, const std::string& path)
+    {
+        for (unsigned char c : path)
+            hash = (hash ^ c) * FNV_PRIME;
+        return hash;
+    }
+
+    int find(unsigned long long key, const std::string& path) const
+    {
+        auto it = slotOfKey.find(key);
+        if (it == slotOfKey.end() || entries[it->second].path != path)
+            return -1;
+        return it->second;
+    }
+
+    TextureHandle reference(int slot)
+    {
+        entries[slot].references++;
+        shared++;
+        return TextureHandle(slot);
+    }
+
+    // a new texture of source, its placeholder for now
+    TextureHandle add(unsigned long long key, const std::string& path, const Source& source)
+    {
+        GLint previous = 0;
+        glGetIntegerv(bindingOf(source.target), &previous);
+        size_t size = (source.target == GL_TEXTURE_CUBE_MAP ? 6 : 1) * 4;
+        Entry entry = { key, path, placeholder(source), source, 1, size, ++serials, 0, false, false };
+        entry.texture.setBytes(size);
+        glBindTexture(source.target, previous);
+        int slot;
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+            entries[slot] = std::move(entry);
+        }
+        else
+        {
+            slot = static_cast<int>(entries.size());
+            entries.push_back(std::move(entry));
+        }
+        // a key that collided keeps its first texture, the new one is still handed out but never shared
+        if (slotOfKey.count(key) == 0)
+            slotOfKey[key] = slot;
+        bytes += size;
+        return TextureHandle(slot);
+    }
+
+    void release(int slot)
+    {
+        if (released || slot < 0 || slot >= static_cast<int>(entries.size()))
+            return;
+        Entry& entry = entries[slot];
+        if (entry.references == 0 || --entry.references > 0)
+            return;
+        entry.texture = GpuHandle();
+        auto it = slotOfKey.find(entry.key);
+        if (it != slotOfKey.end() && it->second == slot)
+            slotOfKey.erase(it);
+        bytes -= entry.bytes;
+        if (entry.streaming)
+            streaming--;
+        entry.streaming = false;
+        freeSlots.push_back(slot);
+    }
+
+    static GLenum bindingOf(GLenum target)
+    {
+        return target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_BINDING_CUBE_MAP : GL_TEXTURE_BINDING_2D;
+    }
+
+    // a new texture with a single texel in every face, mutable so the streamed images can replace it. Grey for
+    // colour, a normal straight out of the surface for normal maps and black for cubemaps. Left bound
+    static GpuHandle placeholder(const Source& source)
+    {
+        GpuHandle texture = GpuResources::instance().create(GPU_TEXTURE, GPU_TEXTURES);
+        glBindTexture(source.target, texture.id());
+        bool cubemap = source.target == GL_TEXTURE_CUBE_MAP;
+        unsigned char grey = cubemap ? 0 : 128;
+        unsigned char texel[4] = { grey, grey, source.usage == TEXTURE_NORMAL ? (unsigned char)255 : grey, 255 };
+        for (unsigned int face = 0; face < (cubemap ? 6u : 1u); face++)
+        {
+            GLenum faceTarget = cubemap ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : source.target;
+            glTexImage2D(faceTarget, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+        }
+        if (cubemap)
+        {
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        }
+        else
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        return texture;
+    }
+
+    unsigned int use(int slot)
+    {
+        Entry& entry = entries[slot];
+        entry.lastUsed = frame;
+        if (entry.evicted)
+        {
+            entry.evicted = false;
+            stream(slot);
+        }
+        return entry.texture.id();
+    }
+
+    // puts the texture that was drawn least recently, and not for TEXTURE_EVICT_FRAMES, back to its placeholder.
+    // False if there is none
+    bool evictLeastRecentlyUsed()
+    {
+        int slot = -1;
+        for (unsigned int i = 0; i < entries.size(); i++)
+        {
+            const Entry& entry = entries[i];
+            if (entry.references == 0 || entry.streaming || entry.evicted || entry.lastUsed == 0 || entry.lastUsed + TEXTURE_EVICT_FRAMES > frame)
+                continue;
+            if (slot < 0 || entry.lastUsed < entries[slot].lastUsed || (entry.lastUsed == entries[slot].lastUsed && entry.bytes > entries[slot].bytes))
+                slot = static_cast<int>(i);
+        }
+        if (slot < 0)
+            return false;
+        Entry& entry = entries[slot];
+        GLint previous = 0;
+        glGetIntegerv(bindingOf(entry.source.target), &previous);
+        entry.texture = placeholder(entry.source);
+        glBindTexture(entry.source.target, previous);
+        size_t size = (entry.source.target == GL_TEXTURE_CUBE_MAP ? 6 : 1) * 4;
+        bytes += size - entry.bytes;
+        entry.bytes = size;
+        entry.texture.setBytes(size);
+        entry.serial = ++serials;
+        entry.evicted = true;
+        evictions++;
+        return true;
+    }
+
+    // reads or cooks the images of the texture in slot on a worker, they are uploaded by update once they arrive
+    void stream(int slot)
+    {
+        Entry& entry = entries[slot];
+        entry.streaming = true;
+        streaming++;
+        unsigned long long serial = entry.serial;
+        const Source& source = entry.source;
+        bool compress = compressColor(source.srgb);
+        {
+            std::lock_guard<std::mutex> lock(arrivalMutex);
+            inFlight++;
+        }
+        JobSystem::instance().submit([this, slot, serial, source, compress]() {
+            std::unique_ptr<CookedTexture> cooked(new CookedTexture());
+            if (!TextureCooker::load(source.paths, source.usage, compress, source.mipmaps, source.cachePath, *cooked))
+                cooked.reset();
+            Stream arrived = { slot, serial, source.target, source.srgb, std::move(cooked), 0, 0, 0 };
+            std::lock_guard<std::mutex> lock(arrivalMutex);
+            arrivals.push_back(std::move(arrived));
+            inFlight--;
+            arrivalSignal.notify_all();
+        });
+    }
+
+    void collectArrivals()
+    {
+        std::lock_guard<std::mutex> lock(arrivalMutex);
+        for (Stream& arrived : arrivals)
+            streams.push_back(std::move(arrived));
+        arrivals.clear();
+    }
+
+    // uploads the next piece of stream: rows of a face of the smallest level that isn't there yet, about
+    // TEXTURE_STREAM_CHUNK_BYTES of them. A level becomes the base level once all its faces are complete. True once
+    // the stream is done with
+    bool uploadNext(Stream& stream)
+    {
+        Entry& entry = entries[stream.slot];
+        if (entry.references == 0 || entry.serial != stream.serial)
+            return true; // released while the images were on their way
+        if (!stream.cooked)
+        {
+            entry.streaming = false;
+            streaming--;
+            return true;
+        }
+        const CookedTexture& cooked = *stream.cooked;
+        GLenum internalFormat = stream.srgb ? srgbFormatOf(cooked.format) : cooked.format;
+        bool storage = glExtensions().textureStorage;
+        unsigned int level = cooked.levels - 1 - stream.uploaded;
+        GLsizei width = std::max(cooked.width >> level, 1);
+        GLsizei height = std::max(cooked.height >> level, 1);
+        // the binding of the active unit is put back afterwards, a GLStateCache may rely on it
+        GLint previous = 0;
+        glGetIntegerv(bindingOf(stream.target), &previous);
+        glBindTexture(stream.target, entry.texture.id());
+
+        // the level is allocated before its first rows go up, all levels at once with immutable storage
+        if (stream.face == 0 && stream.row == 0 && (!storage || stream.uploaded == 0))
+        {
+            if (storage)
+                glTexStorage2D(stream.target, cooked.levels, internalFormat, cooked.width, cooked.height);
+            for (unsigned int face = 0; face < cooked.faces && !storage; face++)
+            {
+                GLenum faceTarget = stream.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : stream.target;
+                if (cooked.compressed())
+                    glCompressedTexImage2D(faceTarget, level, internalFormat, width, height, 0, static_cast<GLsizei>(cooked.imageSizes[level]), NULL);
+                else
+                    glTexImage2D(faceTarget, level, internalFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            }
+        }
+
+        // rows of texels, or of 4x4 blocks for the compressed formats
+        unsigned int rowHeight = cooked.compressed() ? 4 : 1;
+        unsigned int rows = (height + rowHeight - 1) / rowHeight;
+        size_t rowSize = cooked.imageSizes[level] / rows;
+        unsigned int count = std::min(rows - stream.row, std::max(static_cast<unsigned int>(TEXTURE_STREAM_CHUNK_BYTES / rowSize), 1u));
+        size_t size = rowSize * count;
+        const unsigned char* source = cooked.images[level * cooked.faces + stream.face] + rowSize * stream.row;
+
+        // through the pixel buffer, orphaned every time so the driver never waits for the copy of the piece before
+        if (!pixelBuffer.valid())
+            pixelBuffer = GpuResources::instance().create(GPU_BUFFER, GPU_STAGING);
+        GpuResources::bufferData(GL_PIXEL_UNPACK_BUFFER, pixelBuffer, size, NULL, GL_STREAM_DRAW);
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped != nullptr)
+            std::memcpy(mapped, source, size);
+        // the contents of the buffer are lost if unmapping fails, the rows then come straight from the images
+        bool buffered = mapped != nullptr && glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+        if (!buffered)
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        GLenum faceTarget = stream.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + stream.face : stream.target;
+        GLint y = static_cast<GLint>(stream.row * rowHeight);
+        GLsizei pieceHeight = std::min(static_cast<GLsizei>(count * rowHeight), height - y);
+        const void* pixels = buffered ? NULL : source;
+        if (cooked.compressed())
+            glCompressedTexSubImage2D(faceTarget, level, 0, y, width, pieceHeight, internalFormat, static_cast<GLsizei>(size), pixels);
+        else
+            glTexSubImage2D(faceTarget, level, 0, y, width, pieceHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        stream.row += count;
+        if (stream.row == rows)
+        {
+            stream.row = 0;
+            stream.face++;
+        }
+        if (stream.face == cooked.faces)
+        {
+            stream.face = 0;
+            stream.uploaded++;
+            glTexParameteri(stream.target, GL_TEXTURE_BASE_LEVEL, level);
+        }
+        glBindTexture(stream.target, previous);
+
+        if (stream.uploaded < cooked.levels)
+            return false;
+        size_t total = storageSize(cooked);
+        bytes += total - entry.bytes;
+        entry.bytes = total;
+        entry.texture.setBytes(total);
+        entry.streaming = false;
+        streaming--;
+        return true;
+    }
+
+    // colour is cooked into S3TC where the GPU has it, in its sRGB flavour for sRGB textures
+    static bool compressColor(bool srgb)
+    {
+        return srgb ? glExtensions().textureCompressionS3tcSrgb : glExtensions().textureCompressionS3tc;
+    }
+
+    static GLenum srgbFormatOf(GLenum format)
+    {
+        switch (format)
+        {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        case GL_RGBA8: return GL_SRGB8_ALPHA8;
+        default: return format;
+        }
+    }
+
+    static size_t storageSize(const CookedTexture& cooked)
+    {
+        size_t size = 0;
+        for (unsigned int level = 0; level < cooked.levels; level++)
+            size += cooked.imageSizes[level] * cooked.faces;
+        return size;
+    }
+};
+
+inline TextureHandle::TextureHandle(const TextureHandle& other) : slot(other.slot)
+{
+    if (slot >= 0 && !TextureManager::instance().released)
+        TextureManager::instance().entries[slot].references++;
+}
+
+inline TextureHandle::~TextureHandle()
+{
+    if (slot >= 0)
+        TextureManager::instance().release(slot);
+}
+
+inline unsigned int TextureHandle::id() const
+{
+    TextureManager& manager = TextureManager::instance();
+    if (slot < 0 || manager.released)
+        return 0;
+    return manager.entries[slot].texture.id();
+}
+
+inline unsigned int TextureHandle::use() const
+{
+    TextureManager& manager = TextureManager::instance();
+    if (slot < 0 || manager.released)
+        return 0;
+    return manager.use(slot);
+}
+#endif
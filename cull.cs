@@ -0,0 +1,172 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+// same layout as DrawElementsIndirectCommand, instanceCount is reset to 0 before the dispatch
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+// one per instance of the static batch
+struct CullItem {
+    uint command;
+    uint transform;
+};
+
+layout (std430, binding = 0) readonly buffer Transforms {
+    mat4 transforms[];
+};
+layout (std430, binding = 1) buffer Commands {
+    DrawCommand commands[];
+};
+layout (std430, binding = 2) readonly buffer Items {
+    CullItem items[];
+};
+// bounding sphere (center, radius) of each command's mesh in model space
+layout (std430, binding = 3) readonly buffer Bounds {
+    vec4 bounds[];
+};
+// compacted transform indices, read as the per instance vertex attribute of the batch
+layout (std430, binding = 4) writeonly buffer VisibleInstances {
+    uint visibleInstances[];
+};
+// error of every level of detail of each command's draw in model units, negative past its last level. Level l of a
+// draw is the command l places after its full detail one
+layout (std430, binding = 6) readonly buffer LodErrors {
+    vec4 lodErrors[];
+};
+// the level every item was drawn with in the previous frame
+layout (std430, binding = 7) buffer ItemLods {
+    uint itemLods[];
+};
+// region of every transform from regionFirstTransform on, and which regions are drawn as their proxy this frame
+layout (std430, binding = 8) readonly buffer TransformRegions {
+    uint transformRegions[];
+};
+layout (std430, binding = 9) readonly buffer ProxyRegions {
+    uint proxyRegions[];
+};
+
+uniform int itemCount;
+uniform vec4 planes[6]; // frustum planes, normals point inwards
+
+// hierarchical z buffer of the previous frame, every texel holds the farthest depth below it
+uniform bool useHiZ;
+uniform sampler2D hiZ;
+uniform int hiZLevels;
+uniform vec2 hiZSize;
+uniform mat4 previousViewProjection;
+
+// level of detail, see selectLod in Mesh.h
+uniform vec3 cameraPosition;
+uniform float lodPixelsPerUnit; // 0 draws everything at full detail
+uniform float lodPixelError;
+uniform float lodHysteresis;
+
+// instances of these transforms are drawn by an ImpostorAtlas from impostorFade.y on, see Impostor.h
+uniform int impostorFirstTransform;
+uniform int impostorTransformCount;
+uniform vec2 impostorFade; // 0 switches impostors off
+
+// instances of these transforms are left to the proxy of their region, see RegionProxies.h
+uniform int regionFirstTransform;
+uniform int regionTransformCount; // 0 switches region proxies off
+
+bool insideFrustum(vec3 center, float radius)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        if (dot(planes[i].xyz, center) + planes[i].w < -radius)
+            return false;
+    }
+    return true;
+}
+
+// true if the sphere is certainly behind the depth buffer of the previous frame
+bool occluded(vec3 center, float radius)
+{
+    // screen space bounds of the sphere's box
+    vec3 minimum = vec3(1.0);
+    vec3 maximum = vec3(0.0);
+    for (int i = 0; i < 8; i++)
+    {
+        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = previousViewProjection * vec4(corner, 1.0);
+        // crossing the near plane, nothing can be said about it
+        if (clip.w <= 0.0)
+            return false;
+        vec3 ndc = clip.xyz / clip.w * 0.5 + 0.5;
+        minimum = min(minimum, ndc);
+        maximum = max(maximum, ndc);
+    }
+    minimum.xy = clamp(minimum.xy, 0.0, 1.0);
+    maximum.xy = clamp(maximum.xy, 0.0, 1.0);
+
+    // the level where the box covers at most 2x2 texels
+    vec2 extent = (maximum.xy - minimum.xy) * hiZSize;
+    int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, hiZLevels - 1);
+    // textureSize with a per invocation level gives wrong results on llvmpipe, mip sizes follow the usual rule anyway
+    ivec2 levelSize = max(ivec2(hiZSize) >> level, ivec2(1));
+    ivec2 lower = clamp(ivec2(minimum.xy * vec2(levelSize)), ivec2(0), levelSize - 1);
+    ivec2 upper = clamp(ivec2(maximum.xy * vec2(levelSize)), ivec2(0), levelSize - 1);
+
+    float farthest = max(max(texelFetch(hiZ, lower, level).r, texelFetch(hiZ, ivec2(upper.x, lower.y), level).r),
+                         max(texelFetch(hiZ, ivec2(lower.x, upper.y), level).r, texelFetch(hiZ, upper, level).r));
+    return minimum.z > farthest;
+}
+
+// same rule as selectLod in Mesh.h, errors are scaled by the model's scale
+uint selectLod(vec4 errors, vec3 center, float radius, float scale, uint current)
+{
+    uint levelCount = 1u;
+    while (levelCount < 4u && errors[levelCount] >= 0.0)
+        levelCount++;
+    float distance = length(center - cameraPosition) - radius;
+    if (lodPixelsPerUnit <= 0.0 || levelCount == 1u || distance <= 0.0)
+        return 0u;
+    float pixelsPerUnit = lodPixelsPerUnit * scale / distance;
+    uint level = min(current, levelCount - 1u);
+    while (level > 0u && errors[level] * pixelsPerUnit > lodPixelError)
+        level--;
+    while (level + 1u < levelCount && errors[level + 1u] * pixelsPerUnit <= lodPixelError * (1.0 - lodHysteresis))
+        level++;
+    return level;
+}
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= uint(itemCount))
+        return;
+
+    CullItem item = items[index];
+    mat4 model = transforms[item.transform];
+    // hidden instances have a collapsed transform
+    if (model[3][3] == 0.0)
+        return;
+    // far enough to be only the impostor, measured from the origin like light_object.vs does
+    if (impostorFade.y > 0.0 && item.transform - uint(impostorFirstTransform) < uint(impostorTransformCount) && length(model[3].xyz - cameraPosition) >= impostorFade.y)
+        return;
+    uint regionTransform = item.transform - uint(regionFirstTransform);
+    if (regionTransform < uint(regionTransformCount) && proxyRegions[transformRegions[regionTransform]] != 0u)
+        return;
+
+    vec4 sphere = bounds[item.command];
+    vec3 center = vec3(model * vec4(sphere.xyz, 1.0));
+    float scale = max(max(length(model[0].xyz), length(model[1].xyz)), length(model[2].xyz));
+    float radius = sphere.w * scale;
+
+    if (!insideFrustum(center, radius))
+        return;
+    if (useHiZ && occluded(center, radius))
+        return;
+
+    uint level = selectLod(lodErrors[item.command], center, radius, scale, itemLods[index]);
+    itemLods[index] = level;
+    uint command = item.command + level;
+    uint slot = atomicAdd(commands[command].instanceCount, 1u);
+    visibleInstances[commands[command].baseInstance + slot] = item.transform;
+}
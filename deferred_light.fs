@@ -0,0 +1,107 @@
+#version 330 core
+// adds one kind of light to the light buffer, using the G-buffer written by the GBUFFER shader variants.
+// The light functions are the ones of light_object.fs, so both renderers give the same picture.
+// DIRECTIONAL_LIGHT, POINT_LIGHT or SPOT_LIGHT is defined by DeferredRenderer
+out vec4 FragColor;
+
+struct DirLight {
+    vec3 direction;
+	
+    vec3 ambient;
+    vec3 diffuse;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+  
+    float constant;
+    float linear;
+    float quadratic;
+  
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;       
+};
+
+#ifdef POINT_LIGHT
+flat in vec4 LightPosition; // xyz and the range in w
+flat in vec3 Ambient;
+flat in vec3 Diffuse;
+flat in vec3 Attenuation;   // constant, linear, quadratic
+#endif
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform vec2 screenSize;
+uniform vec3 viewPos;
+uniform float shininess;
+uniform bool specular;
+#ifdef DIRECTIONAL_LIGHT
+uniform DirLight dirLight;
+#endif
+#ifdef SPOT_LIGHT
+uniform SpotLight spotLight;
+uniform vec4 volume; // position and range of the light
+#endif
+
+vec3 CalcSpecular(vec3 lightColor, vec3 lightDir, vec3 normal, vec3 viewDir);
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / screenSize;
+    vec4 packedNormal = texture(gNormal, uv);
+    // nothing was drawn here or the surface is unlit
+    if (packedNormal.a == 0.0)
+        discard;
+    float depth = texture(gDepth, uv).r;
+    vec4 position = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec3 fragPos = position.xyz / position.w;
+    vec3 norm = normalize(packedNormal.xyz * 2.0 - 1.0);
+    vec3 albedo = texture(gAlbedo, uv).rgb;
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+#ifdef DIRECTIONAL_LIGHT
+    vec3 lightDir = normalize(-dirLight.direction);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 result = dirLight.ambient * albedo + dirLight.diffuse * diff * albedo + CalcSpecular(dirLight.diffuse, lightDir, norm, viewDir);
+#endif
+#ifdef POINT_LIGHT
+    float distance = length(LightPosition.xyz - fragPos);
+    // the light is cut off at its range, where it has faded below what an 8 bit color can show
+    if (distance > LightPosition.w)
+        discard;
+    vec3 lightDir = (LightPosition.xyz - fragPos) / distance;
+    float diff = max(dot(norm, lightDir), 0.0);
+    float attenuation = 1.0 / (Attenuation.x + Attenuation.y * distance + Attenuation.z * (distance * distance));
+    vec3 result = (Ambient * albedo + Diffuse * diff * albedo + CalcSpecular(Diffuse, lightDir, norm, viewDir)) * attenuation;
+#endif
+#ifdef SPOT_LIGHT
+    float distance = length(spotLight.position - fragPos);
+    if (distance > volume.w)
+        discard;
+    vec3 lightDir = normalize(spotLight.position - fragPos);
+    float diff = max(dot(norm, lightDir), 0.0);
+    float attenuation = 1.0 / (spotLight.constant + spotLight.linear * distance + spotLight.quadratic * (distance * distance));    
+    float theta = dot(lightDir, normalize(-spotLight.direction)); 
+    float epsilon = spotLight.cutOff - spotLight.outerCutOff;
+    float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
+    vec3 result = (spotLight.ambient * albedo + spotLight.diffuse * diff * albedo + CalcSpecular(spotLight.specular, lightDir, norm, viewDir)) * attenuation * intensity;
+#endif
+
+    FragColor = vec4(result, 1.0);
+}
+
+// specular highlight of one light, nothing unless specular is set
+vec3 CalcSpecular(vec3 lightColor, vec3 lightDir, vec3 normal, vec3 viewDir)
+{
+    if (!specular)
+        return vec3(0.0);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    return lightColor * spec;
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#version 330 core
+// POINT_LIGHT: the box around a point light's range, one instance per light
+// SPOT_LIGHT:  the box around the spot light's range
+// otherwise:   a triangle that covers the whole screen
+layout (location = 0) in vec3 aPos;
+#ifdef POINT_LIGHT
+layout (location = 1) in vec4 aLightPosition; // xyz and the range in w
+layout (location = 2) in vec3 aAmbient;
+layout (location = 3) in vec3 aDiffuse;
+layout (location = 4) in vec3 aAttenuation; // constant, linear, quadratic
+
+flat out vec4 LightPosition;
+flat out vec3 Ambient;
+flat out vec3 Diffuse;
+flat out vec3 Attenuation;
+
+#endif
+#ifdef SPOT_LIGHT
+uniform vec4 volume; // position and range of the light
+#endif
+uniform mat4 viewProjection;
+
+void main()
+{
+#ifdef POINT_LIGHT
+    LightPosition = aLightPosition;
+    Ambient = aAmbient;
+    Diffuse = aDiffuse;
+    Attenuation = aAttenuation;
+    gl_Position = viewProjection * vec4(aLightPosition.xyz + aPos * aLightPosition.w, 1.0);
+#elif defined(SPOT_LIGHT)
+    gl_Position = viewProjection * vec4(volume.xyz + aPos * volume.w, 1.0);
+#else
+    gl_Position = vec4(aPos, 1.0);
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#version 330 core
+
+// depth pre-pass, only the depth test and depth write happen.
+// Used with the vertex shader of the lighting pass so both produce exactly the same depth
+#ifdef CROSSFADE
+// the pixels the lighting pass dithers out must not be in the depth buffer either, same as light_object.fs
+flat in float ImpostorWeight;
+
+float CrossfadeThreshold()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+}
+#endif
+
+void main()
+{
+#ifdef CROSSFADE
+    if (CrossfadeThreshold() < ImpostorWeight)
+        discard;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#version 430 core
+layout (local_size_x = 8, local_size_y = 8) in;
+
+// builds one level of the hierarchical z buffer. Level 0 is a copy of the depth buffer, every other level keeps the
+// farthest depth of the texels it covers in the level above. Odd sizes pull in the extra row and column.
+uniform sampler2D source;
+uniform int sourceLevel;
+uniform bool copyDepth;
+
+layout (r32f, binding = 0) uniform writeonly image2D destination;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(destination);
+    if (texel.x >= size.x || texel.y >= size.y)
+        return;
+
+    if (copyDepth)
+    {
+        imageStore(destination, texel, vec4(texelFetch(source, texel, 0).r));
+        return;
+    }
+
+    ivec2 sourceSize = textureSize(source, sourceLevel);
+    ivec2 base = texel * 2;
+    float depth = 0.0;
+    int lastX = (sourceSize.x & 1) != 0 && texel.x == size.x - 1 ? 2 : 1;
+    int lastY = (sourceSize.y & 1) != 0 && texel.y == size.y - 1 ? 2 : 1;
+    for (int y = 0; y <= lastY; y++)
+    {
+        for (int x = 0; x <= lastX; x++)
+            depth = max(depth, texelFetch(source, min(base + ivec2(x, y), sourceSize - 1), sourceLevel).r);
+    }
+    imageStore(destination, texel, vec4(depth));
+}
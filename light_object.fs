@@ -1,5 +1,11 @@
 #version 330 core
+#ifdef GBUFFER
+layout (location = 0) out vec4 gLight;  // light that is already known, the baked lightmap
+layout (location = 1) out vec4 gAlbedo;
+layout (location = 2) out vec4 gNormal; // packed into 0..1
+#else
 out vec4 FragColor;
+#endif
 
 struct Material {
     sampler2D diffuse;
@@ -41,90 +47,169 @@ struct SpotLight {
     vec3 specular;       
 };
 
+// variants are compiled by ShaderVariants, which defines:
+// NR_POINT_LIGHTS  number of point lights
+// FLASHLIGHT       the flashlight is on
+// SPECULAR         add specular highlights
+// LIGHTMAP         the directional and point lights are baked into the lightmap, see LightmapBaker
+// GBUFFER          only write the G-buffer, the lights are added in screen space by DeferredRenderer
+// CROSSFADE        dither the model out while it fades into its impostor
+// IMPOSTOR         shade a quad of an ImpostorAtlas, albedo and normal come from the atlas
+#ifndef NR_POINT_LIGHTS
 #define NR_POINT_LIGHTS 30
+#endif
+// impostors have no lightmap coords, they compute the static lights like the variants without LIGHTMAP
+#if defined(LIGHTMAP) && !defined(IMPOSTOR)
+#define BAKED_LIGHTS
+#endif
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+in vec2 LightmapCoords;
+#if defined(CROSSFADE) || defined(IMPOSTOR)
+flat in float ImpostorWeight;
+#endif
 
 uniform vec3 viewPos;
+#ifdef IMPOSTOR
+// premultiplied by coverage, so filtering never pulls in the color of empty texels
+uniform sampler2D impostorAlbedo;
+uniform sampler2D impostorNormal;
+#endif
+#ifdef BAKED_LIGHTS
+// diffuse and ambient light of the directional and point lights, baked by LightmapBaker
+uniform sampler2D lightmap;
+#else
 uniform DirLight dirLight;
+#if NR_POINT_LIGHTS > 0
 uniform PointLight pointLights[NR_POINT_LIGHTS];
+#endif
+#endif
 uniform SpotLight spotLight;
 uniform Material material;
 
 // function prototypes
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcStaticLights(vec3 normal, vec3 viewDir, vec3 albedo);
+float CrossfadeThreshold();
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 albedo);
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo);
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo);
+vec3 CalcSpecular(vec3 lightColor, vec3 lightDir, vec3 normal, vec3 viewDir);
 
 void main()
 {    
     // properties
+#ifdef IMPOSTOR
+    vec4 impostor = texture(impostorAlbedo, TexCoords);
+    // the impostor covers the pixels its model leaves out while they crossfade
+    if (impostor.a < 0.5 || CrossfadeThreshold() >= ImpostorWeight)
+        discard;
+    vec3 albedo = impostor.rgb / impostor.a;
+    vec4 packedNormal = texture(impostorNormal, TexCoords);
+    vec3 norm = normalize(packedNormal.xyz / packedNormal.a * 2.0 - 1.0);
+#else
+#ifdef CROSSFADE
+    if (CrossfadeThreshold() < ImpostorWeight)
+        discard;
+#endif
     vec3 norm = normalize(Normal);
+    vec3 albedo = vec3(texture(material.diffuse, TexCoords));
+#endif
     vec3 viewDir = normalize(viewPos - FragPos);
     
+#ifdef GBUFFER
+#if defined(BAKED_LIGHTS)
+    gLight = vec4(texture(lightmap, LightmapCoords).rgb * albedo, 1.0);
+#elif defined(LIGHTMAP)
+    // the lighting pass leaves the static lights out when there is a lightmap
+    gLight = vec4(CalcStaticLights(norm, viewDir, albedo), 1.0);
+#else
+    gLight = vec4(0.0, 0.0, 0.0, 1.0);
+#endif
+    gAlbedo = vec4(albedo, 1.0);
+    gNormal = vec4(norm * 0.5 + 0.5, 1.0);
+#else
     // == =====================================================
     // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
     // For each phase, a calculate function is defined that calculates the corresponding color
     // per lamp. In the main() function we take all the calculated colors and sum them up for
     // this fragment's final color.
     // == =====================================================
-    // phase 1: directional lighting
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    // phase 2: point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
+#ifdef BAKED_LIGHTS
+    // phase 1 and 2: the static lights, baked
+    vec3 result = texture(lightmap, LightmapCoords).rgb * albedo;
+#else
+    // phase 1 and 2: directional and point lights
+    vec3 result = CalcStaticLights(norm, viewDir, albedo);
+#endif
+#ifdef FLASHLIGHT
     // phase 3: spot light
-    result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
+    result += CalcSpotLight(spotLight, norm, FragPos, viewDir, albedo);    
+#endif
     
     FragColor = vec4(result, 1.0);
+#endif
+}
+
+#ifndef BAKED_LIGHTS
+// calculates the color of the directional light and all point lights.
+vec3 CalcStaticLights(vec3 normal, vec3 viewDir, vec3 albedo)
+{
+    // phase 1: directional lighting
+    vec3 result = CalcDirLight(dirLight, normal, viewDir, albedo);
+    // phase 2: point lights
+#if NR_POINT_LIGHTS > 0
+    for(int i = 0; i < NR_POINT_LIGHTS; i++)
+        result += CalcPointLight(pointLights[i], normal, FragPos, viewDir, albedo);    
+#endif
+    return result;
+}
+#endif
+
+#if defined(CROSSFADE) || defined(IMPOSTOR)
+// 4x4 ordered dither, a model with ImpostorWeight w keeps the pixels at or above w and its impostor takes the rest
+float CrossfadeThreshold()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
 }
+#endif
 
 // calculates the color when using a directional light.
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 albedo)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    return (ambient + diffuse);
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    return (ambient + diffuse + CalcSpecular(light.specular, lightDir, normal, viewDir));
 }
 
 // calculates the color when using a point light.
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    return (ambient + diffuse);
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    return (ambient + diffuse + CalcSpecular(light.specular, lightDir, normal, viewDir)) * attenuation;
 }
 
 // calculates the color when using a spot light.
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
@@ -133,9 +218,19 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    ambient *= attenuation * intensity;
-    diffuse *= attenuation * intensity;
-    return (ambient + diffuse);
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    return (ambient + diffuse + CalcSpecular(light.specular, lightDir, normal, viewDir)) * attenuation * intensity;
+}
+
+// specular highlight of one light, nothing unless the variant has SPECULAR
+vec3 CalcSpecular(vec3 lightColor, vec3 lightDir, vec3 normal, vec3 viewDir)
+{
+#ifdef SPECULAR
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    return lightColor * spec;
+#else
+    return vec3(0.0);
+#endif
 }
\ No newline at end of file
@@ -1,21 +1,116 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 1) in vec2 aNormal; // octahedral encoded, see VertexLayout in Mesh.h
 layout (location = 2) in vec2 aTexCoords;
+#ifdef INSTANCED
+layout (location = 7) in uint aTransform; // per instance, offset by the draw's baseInstance
+#endif
+layout (location = 8) in vec2 aLightmapCoords;
+#ifdef IMPOSTOR
+// aPos is a corner of the quad in -1..1, the instance is only placed by its origin
+layout (location = 9) in vec3 aOrigin;
+#endif
+
+#ifdef INSTANCED
+// one transform per instance of the static batch
+layout (std430, binding = 0) readonly buffer Transforms {
+    mat4 transforms[];
+};
+// scale and offset of each instance's tile in the lightmap atlas
+layout (std430, binding = 5) readonly buffer LightmapRects {
+    vec4 lightmapRects[];
+};
+#else
+uniform mat4 model;
+uniform vec4 lightmapRect; // scale and offset of this surface's tile in the lightmap atlas
+#endif
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+out vec2 LightmapCoords;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+#if defined(CROSSFADE) || defined(IMPOSTOR)
+// instances turn into their impostor between these distances of their origin, 0 switches impostors off. See
+// impostorWeight in Impostor.h
+uniform vec2 impostorFade;
+uniform vec3 viewPos;
+flat out float ImpostorWeight;
+
+float impostorWeight(vec3 origin)
+{
+    if (impostorFade.y <= 0.0)
+        return 0.0;
+    return clamp((length(origin - viewPos) - impostorFade.x) / max(impostorFade.y - impostorFade.x, 1e-4), 0.0, 1.0);
+}
+#endif
+
+#ifdef IMPOSTOR
+// the atlas holds IMPOSTOR_AZIMUTHS x IMPOSTOR_ELEVATIONS views, set by ShaderVariants
+#ifndef IMPOSTOR_AZIMUTHS
+#define IMPOSTOR_AZIMUTHS 16
+#endif
+#ifndef IMPOSTOR_ELEVATIONS
+#define IMPOSTOR_ELEVATIONS 3
+#endif
+uniform vec4 impostorBounds; // bounding sphere of the model
+
+// direction towards the camera of a captured view, same as impostorDirection in Impostor.h
+vec3 impostorDirection(int azimuth, int elevation)
+{
+    float a = float(azimuth) * 6.28318531 / float(IMPOSTOR_AZIMUTHS);
+    float e = float(elevation) * 1.57079633 / float(IMPOSTOR_ELEVATIONS);
+    return vec3(sin(a) * cos(e), sin(e), cos(a) * cos(e));
+}
+#endif
+
+// unit vector from its octahedral encoding, see octEncode in Mesh.h
+vec3 octDecode(vec2 p)
+{
+    vec3 v = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    // the lower half was folded over the upper one
+    float folded = max(-v.z, 0.0);
+    v.x += v.x >= 0.0 ? -folded : folded;
+    v.y += v.y >= 0.0 ? -folded : folded;
+    return normalize(v);
+}
+
+// the depth pre-pass runs this shader too, its depth has to match the lighting pass exactly
+invariant gl_Position;
+
 void main()
 {
+#ifdef IMPOSTOR
+    // the captured view closest to the direction of the camera, the quad faces exactly that way so it lines up with
+    // the tile
+    vec3 center = aOrigin + impostorBounds.xyz;
+    vec3 toCamera = normalize(viewPos - center);
+    int azimuth = int(mod(round(atan(toCamera.x, toCamera.z) * float(IMPOSTOR_AZIMUTHS) / 6.28318531), float(IMPOSTOR_AZIMUTHS)));
+    int elevation = clamp(int(round(asin(clamp(toCamera.y, -1.0, 1.0)) * float(IMPOSTOR_ELEVATIONS) / 1.57079633)), 0, IMPOSTOR_ELEVATIONS - 1);
+    vec3 direction = impostorDirection(azimuth, elevation);
+    vec3 right = normalize(cross(vec3(0.0, 1.0, 0.0), direction));
+    vec3 up = cross(direction, right);
+    FragPos = center + (aPos.x * right + aPos.y * up) * impostorBounds.w;
+    Normal = direction;
+    TexCoords = (vec2(azimuth, elevation) + aPos.xy * 0.5 + 0.5) / vec2(IMPOSTOR_AZIMUTHS, IMPOSTOR_ELEVATIONS);
+    LightmapCoords = vec2(0.0);
+    ImpostorWeight = impostorWeight(aOrigin);
+#else
+#ifdef INSTANCED
+    mat4 model = transforms[aTransform];
+    vec4 lightmapRect = lightmapRects[aTransform];
+#endif
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    Normal = mat3(transpose(inverse(model))) * octDecode(aNormal);  
     TexCoords = aTexCoords;
-    
+    LightmapCoords = aLightmapCoords * lightmapRect.xy + lightmapRect.zw;
+#ifdef CROSSFADE
+    ImpostorWeight = impostorWeight(model[3].xyz);
+#endif
+#endif
+
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
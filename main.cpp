@@ -6,12 +6,14 @@
 #include <GLFW/glfw3.h>
 #include <irrKlang/irrKlang.h>
 
-#include <ft2build.h>
-#include FT_FREETYPE_H
 
 //other includes
 #include <iostream>
 #include <map>
+#include <unordered_map>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
 
 #include "shader.h"
 #include "MazeHandler.h"
@@ -20,20 +22,40 @@
 
 #include "Model.h"
 #include "Mesh.h"
+#include "RenderQueue.h"
+#include "GLExtensions.h"
+#include "StaticBatch.h"
+#include "GpuCulling.h"
+#include "LightmapBaker.h"
+#include "ShaderVariants.h"
+#include "GpuTimer.h"
+#include "DeferredRenderer.h"
+#include "Impostor.h"
+#include "RegionProxies.h"
+#include "TextRenderer.h"
+#include "AssetArchive.h"
+#include "GpuResources.h"
 
 #include "stb_image.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void processInput(GLFWwindow* window, CollisionDetector* detector, InteractionDetector* interactionDetector);
-unsigned int loadCubemap(vector<std::string> faces);
-unsigned int loadTexture(char const* path);
 void generateMaze(int width, int height);
 
 // settings
 const unsigned int SCR_WIDTH = 1920;
 const unsigned int SCR_HEIGHT = 1080;
 
+// lightmap resolution, per building and for the whole floor
+const unsigned int BUILDING_LIGHTMAP_SIZE = 64;
+const unsigned int FLOOR_LIGHTMAP_SIZE = 2048;
+
+// maze cells per side of a region that is drawn as one proxy when far away, and the size of a cell (see MazeHandler)
+const unsigned int HLOD_REGION_CELLS = 8;
+const glm::vec2 MAZE_CELL_SIZE = glm::vec2(16.25f, 14.5f);
+
 // camera
 glm::vec3 cameraPos = glm::vec3(16.0f, 7.0f, -10.0f);
 glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
@@ -76,33 +98,84 @@ bool checkCollectedObjects(int ID);
 //start flag
 bool hasMoved = false;
 
-//text data
-struct Character {
-    unsigned int TextureID;  // ID handle of the glyph texture
-    glm::ivec2   Size;       // Size of glyph
-    glm::ivec2   Bearing;    // Offset from baseline to left/top of glyph
-    unsigned int Advance;    // Offset to advance to next glyph
-};
-
-std::map<char, Character> Characters;
-
-void renderText(Shader& s, std::string text, float x, float y, float scale, glm::vec3 color, unsigned int& VAO, unsigned int& VBO, bool centerAlignment);
-int prepareTextRendering(Shader& shader, unsigned int& VAO, unsigned int& VBO);
-
 //flashlight setting
 bool flashOn = false;
 
+//render settings
+bool useStaticBatch = false; // F1, multi draw indirect path, only available on OpenGL 4.3+
+bool useGpuCulling = true;   // F2, compute shader culling of the static batch
+bool useHiZ = true;          // F3, occlusion culling against the previous frame's depth
+bool useSpecular = false;    // F4, specular highlights
+bool useDepthPrePass = false; // F5, depth only pass so the lighting shader runs once per pixel
+bool showTimings = false;    // F6, GPU time of the depth pre-pass and the opaque pass
+bool useDeferred = false;    // F7, G-buffer and light volumes instead of lighting every fragment
+bool useLod = true;          // F8, simplified meshes for instances far away
+bool useImpostors = true;    // F9, camera facing quads for far away buildings
+bool useHlod = true;         // F10, one merged proxy for every far away region of the maze
+glm::vec2 impostorFadeRange = glm::vec2(0.0f); // distances buildings fade into their impostor, set once the atlas exists
+
+// uniforms of a scene shader that change every frame
+struct FrameUniforms {
+    Uniform<glm::mat4> projection;
+    Uniform<glm::mat4> view;
+    Uniform<glm::vec3> viewPos;
+    Uniform<glm::vec3> spotLightPosition;
+    Uniform<glm::vec3> spotLightDirection;
+    Uniform<glm::vec2> impostorFade;
+    Uniform<float> animationTime;
+};
+// resolved once per program, shader variants are compiled on demand
+std::unordered_map<unsigned int, FrameUniforms> frameUniformCache;
+
+StaticLights sceneLights(const vector<glm::vec3>& pointLightPositions);
+void setupLighting(Shader& shader, const StaticLights& lights);
+DeferredSpotLight flashlight();
+const FrameUniforms& frameUniformsOf(Shader& shader);
+void updateFrameUniforms(Shader& shader, const glm::mat4& projection, const glm::mat4& view);
+bool validateGpuCulling(GpuCuller& culler, const glm::vec3& spawn, const glm::vec3& center);
+std::string formatTiming(const char* name, const GpuTimer& timer);
+irrklang::ISoundSource* addSound(irrklang::ISoundEngine* engine, const char* path);
+
 //umph sound engine
 irrklang::ISoundEngine* umphSoundEngine = irrklang::createIrrKlangDevice();
-irrklang::ISoundSource* umphSound = umphSoundEngine->addSoundSourceFromFile("Sound/umph.mp3");
+irrklang::ISoundSource* umphSound = nullptr;
 
 glm::mat4 lukasModel = glm::mat4(1.0f);
 
 int main(int argc, char* argv[]) {
+    // the flags may come in any order
+    bool validateCulling = false;
+    bool cookAssets = false;
+    for (int i = 1; i < argc; i++) {
+        std::string flag = argv[i];
+        // --validate-culling checks the GPU culling against the CPU and exits, works headless on a software renderer
+        if (flag == "--validate-culling") {
+            validateCulling = true;
+        }
+        // --cook loads the scene once and packs every asset it opened into assets.pack, later runs read them from there
+        else if (flag == "--cook") {
+            cookAssets = true;
+        }
+        // --gpu-budget <MB> is the memory the GPU objects may take before textures that weren't drawn for a while are
+        // evicted, 0 for no limit
+        else if (flag == "--gpu-budget" && i + 1 < argc) {
+            GpuResources::instance().setBudget(static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10)) * 1024 * 1024);
+        }
+    }
+    if (cookAssets) {
+        AssetArchive::instance().record();
+    }
+    else {
+        AssetArchive::instance().mount("assets.pack");
+    }
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    if (validateCulling) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
@@ -110,10 +183,16 @@ int main(int argc, char* argv[]) {
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    // glfw window creation
+    // glfw window creation, the optional OpenGL 4.3 paths are simply unavailable on a 3.3 context
     // --------------------
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Horror game", NULL, NULL);
     if (window == NULL)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Horror game", NULL, NULL);
+    }
+    if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -122,6 +201,7 @@ int main(int argc, char* argv[]) {
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetKeyCallback(window, key_callback);
 
     // tell GLFW to capture our mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -133,6 +213,7 @@ int main(int argc, char* argv[]) {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // configure global opengl state
     // -----------------------------
@@ -147,6 +228,7 @@ int main(int argc, char* argv[]) {
     vector<glm::vec3> pointLightPositions = maze.getLightPositions();
     vector<glm::vec3> trashPositions = maze.getTrashPositions();
     cameraPos = maze.spawnLocation();
+    StaticLights staticLights = sceneLights(pointLightPositions);
 
     // plane vertices
     float planeVertices[] = {
@@ -159,52 +241,6 @@ int main(int argc, char* argv[]) {
         -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
     };
 
-    // cube vertices
-    float vertices[] = {
-        // positions          // normals           // texture coords
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
-         0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  0.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
-
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
-
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  1.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
-
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f
-    };
-
     float skyboxVertices[] = {
         // positions          
         -1.0f,  1.0f, -1.0f,
@@ -250,62 +286,12 @@ int main(int argc, char* argv[]) {
          1.0f, -1.0f,  1.0f
     };
 
-    // cubes
-    // -----    
-    unsigned int VBO, VAO;
-    
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-
-    glBindVertexArray(VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // texture coord attribute
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    // light VAO
-    unsigned int lightCubeVAO;
-    glGenVertexArrays(1, &lightCubeVAO);
-    glBindVertexArray(lightCubeVAO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // plane
-    // -----
-    unsigned int PLANEVBO, PLANEVAO;
-
-    glGenVertexArrays(1, &PLANEVAO);
-    glGenBuffers(1, &PLANEVBO);
-
-    glBindVertexArray(PLANEVAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, PLANEVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), planeVertices, GL_STATIC_DRAW);
-
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // normals coord attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    // texture coord attribute
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
     // skybox
     // ------
-    unsigned int skyboxVAO, skyboxVBO;
-    glGenVertexArrays(1, &skyboxVAO);
-    glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
+    GpuHandle skyboxVAO = GpuResources::instance().create(GPU_VERTEX_ARRAY, GPU_GEOMETRY);
+    GpuHandle skyboxVBO = GpuResources::instance().create(GPU_BUFFER, GPU_GEOMETRY);
+    glBindVertexArray(skyboxVAO.id());
+    GpuResources::bufferData(GL_ARRAY_BUFFER, skyboxVBO, sizeof(skyboxVertices), skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
@@ -319,33 +305,93 @@ int main(int argc, char* argv[]) {
         "Skybox/Spacebox/back.png"
     };
 
-    unsigned int cubemapTexture = loadCubemap(faces);
+    TextureHandle skyboxTexture = TextureManager::instance().loadCubemap(faces);
+    unsigned int cubemapTexture = skyboxTexture.id();
 
     // load and create a texture 
     // -------------------------
-    unsigned int texture = loadTexture("floor.jpg");
-
-    // configure shaders
-    // -----------------
+    TextureHandle floorTexture = TextureManager::instance().load("floor.jpg");
+    Material floorMaterial(vector<Texture>{ Texture{ floorTexture.id(), "texture_diffuse", "floor.jpg", floorTexture } });
+
+    // floor mesh, built from the plane vertices so it can be queued and batched like the models
+    vector<Vertex> floorVertices;
+    for (unsigned int i = 0; i < 6; i++) {
+        Vertex vertex = {};
+        vertex.Position = glm::vec3(planeVertices[i * 8], planeVertices[i * 8 + 1], planeVertices[i * 8 + 2]);
+        vertex.Normal = glm::vec3(planeVertices[i * 8 + 3], planeVertices[i * 8 + 4], planeVertices[i * 8 + 5]);
+        vertex.TexCoords = glm::vec2(planeVertices[i * 8 + 6], planeVertices[i * 8 + 7]);
+        floorVertices.push_back(vertex);
+    }
+    Mesh floorMesh(floorVertices, vector<unsigned int>{ 0, 1, 2, 3, 4, 5 }, floorMaterial);
+
+    glm::mat4 floorModel = glm::mat4(1.0f);
+    glm::vec3 floorPosition = glm::vec3(maze.getMazeWidth() / 1.4, -1.5f, -maze.getMazeHeight() / 3.1);
+    floorModel = glm::translate(floorModel, floorPosition);
+    floorModel = glm::rotate(floorModel, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    floorModel = glm::rotate(floorModel, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    glm::vec3 floorSize = glm::vec3(maze.getMazeWidth() * 100, maze.getMazeHeight() * 100, 1.0);
+    floorModel = glm::scale(floorModel, floorSize);
+    floorSize = glm::vec3(floorSize.y, floorSize.z * 10, floorSize.x);
+
+    // configure shaders, all programs of the first frame compile at the same time or come from shaders.cache
+    // -------------------------------------------------------------------------------------------------------
+    Shader::beginParallelCompile();
     Shader skyboxShader("Skybox/skybox.vs", "Skybox/skybox.fs");
-    Shader lightingShader("light_object.vs", "light_object.fs");
     Shader textShader("text.vs", "text.fs");
-    Shader modelShader("model_loading.vs", "model_loading.fs");
+    // model textures always live on the same units, so the samplers are assigned once per variant
+    ShaderVariants modelShaders("model_loading.vs", "model_loading.fs", Material::assignSamplerUnits);
+    ShaderVariants lightingShaders("light_object.vs", "light_object.fs", [&staticLights](Shader& shader) {
+        Material::assignSamplerUnits(shader);
+        setupLighting(shader, staticLights);
+        shader.setInt("lightmap", LIGHTMAP_TEXTURE_UNIT);
+    });
+    lightingShaders.define("NR_POINT_LIGHTS", static_cast<int>(staticLights.pointLights.size()));
+    lightingShaders.define("IMPOSTOR_AZIMUTHS", IMPOSTOR_AZIMUTHS);
+    lightingShaders.define("IMPOSTOR_ELEVATIONS", IMPOSTOR_ELEVATIONS);
+    // same vertex shader as the lighting, so the pre-pass depth matches exactly
+    ShaderVariants depthShaders("light_object.vs", "depth_only.fs");
+    modelShaders.prepare(0);
+    depthShaders.prepare(0);
+    // the lightmap is baked further down, it usually succeeds
+    lightingShaders.prepare(SHADER_LIGHTMAP);
+    lightingShaders.prepare(SHADER_LIGHTMAP | SHADER_FLASHLIGHT);
+    // the impostor atlas is captured with the G-buffer variant, far buildings fade into impostors from the start
+    lightingShaders.prepare(SHADER_GBUFFER);
+    lightingShaders.prepare(SHADER_LIGHTMAP | SHADER_IMPOSTOR);
+    lightingShaders.prepare(SHADER_LIGHTMAP | SHADER_CROSSFADE);
+    if (glExtensions().multiDrawIndirect) {
+        modelShaders.prepare(SHADER_INSTANCED);
+        depthShaders.prepare(SHADER_INSTANCED);
+        lightingShaders.prepare(SHADER_LIGHTMAP | SHADER_INSTANCED);
+        lightingShaders.prepare(SHADER_LIGHTMAP | SHADER_INSTANCED | SHADER_FLASHLIGHT);
+        lightingShaders.prepare(SHADER_LIGHTMAP | SHADER_INSTANCED | SHADER_CROSSFADE);
+    }
+    Shader::finishParallelCompile();
+    modelShaders.get(0);
 
     skyboxShader.use();
     skyboxShader.setInt("skybox", 0);
 
-    lightingShader.use();
-    lightingShader.setInt("material.diffuse", 0);
+    // resolve the uniforms that change every frame
+    // --------------------------------------------
+    Uniform<glm::mat4> skyboxProjection = skyboxShader.uniform<glm::mat4>("projection");
+    Uniform<glm::mat4> skyboxView = skyboxShader.uniform<glm::mat4>("view");
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    //text rendering
-    unsigned int textVAO, textVBO;
-    if (prepareTextRendering(textShader, textVAO, textVBO) == -1) {
+    //text rendering from distance fields, the bitmap glyphs are the fallback for a FreeType without them. The hints
+    //never change so they are laid out once
+    TextRenderer textRenderer;
+    if (!textRenderer.loadDistanceField("fonts/arial.ttf", 48, "fonts/arial.sdf") && !textRenderer.load("fonts/arial.ttf", 48)) {
         return -1;
     }
+    textShader.use();
+    textShader.setMat4("projection", glm::ortho(0.0f, static_cast<float>(SCR_WIDTH), 0.0f, static_cast<float>(SCR_HEIGHT)));
+    textShader.setBool("distanceField", textRenderer.isDistanceField());
+    TextLayout movementHint = textRenderer.layout("movement: z, q, s, d  utility: g for flashlight, f for interaction", 0.4f, true);
+    TextLayout startHint = textRenderer.layout("move to start", 0.4f, true);
+    TextLayout interactHint = textRenderer.layout("Press 'F' to interact", 0.4f, true);
 
     // create collision detector object
     // --------------------------------
@@ -354,14 +400,23 @@ int main(int argc, char* argv[]) {
 
     // create mesh 
     // -----------
-    Model building("Meshes/City meshes/building.obj");
-    Model spaceship("Meshes/Ufo/UFO.obj");
-    Model trash("Meshes/Trash Pile/Garbage Bag obj.obj");
+    // imported side by side, only the uploads wait for each other
+    vector<Model> models = Model::loadAll({ "Meshes/City meshes/building.obj", "Meshes/Ufo/UFO.obj", "Meshes/Trash Pile/Garbage Bag obj.obj" });
+    Model& building = models[0];
+    Model& spaceship = models[1];
+    Model& trash = models[2];
+    TextureManager::instance().report();
+    // a skinned UFO plays its first clip, each one half a second behind the previous so they don't move in lockstep
+    unsigned int spaceshipFeatures = spaceship.animated() ? SHADER_SKINNED : 0;
+    vector<glm::vec4> spaceshipAnimations(pointLightPositions.size());
+    for (unsigned int i = 0; i < spaceshipAnimations.size(); i++) {
+        spaceshipAnimations[i] = spaceship.animationOf(0, 1.0f, i * 0.5f);
+    }
 
     // instance meshes
     // ---------------
     // building
-    glm::mat4* buildingModelMatrices = new glm::mat4[positions.size()];
+    vector<glm::mat4> buildingModelMatrices(positions.size());
     for (int i = 0; i < positions.size(); i++) {
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::translate(model, positions.at(i));
@@ -369,7 +424,7 @@ int main(int argc, char* argv[]) {
     }
 
     // spaceship
-    glm::mat4* spaceShipModelMatrices = new glm::mat4[pointLightPositions.size()];
+    vector<glm::mat4> spaceShipModelMatrices(pointLightPositions.size());
     for (int i = 0; i < pointLightPositions.size(); i++) {
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::translate(model, pointLightPositions.at(i));
@@ -378,7 +433,7 @@ int main(int argc, char* argv[]) {
     }
 
     // trash
-    glm::mat4* trashModelMatrices = new glm::mat4[trashPositions.size()];
+    vector<glm::mat4> trashModelMatrices(trashPositions.size());
     for (int i = 0; i < trashPositions.size(); i++) {
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::translate(model, trashPositions.at(i));
@@ -386,10 +441,131 @@ int main(int argc, char* argv[]) {
         trashModelMatrices[i] = model;
     }
 
+    // bake the static lights into a lightmap, only the flashlight is left to compute per fragment
+    // --------------------------------------------------------------------------------------------
+    LightmapBaker lightmapBaker(staticLights);
+    // the buildings also get lightmap texels on their bounding box, for the region proxies
+    LightmapCharts buildingCharts = LightmapBaker::unwrap(building.meshes, BUILDING_LIGHTMAP_SIZE, true);
+    LightmapCharts floorCharts = LightmapBaker::unwrap(floorMesh, FLOOR_LIGHTMAP_SIZE);
+    // the levels of detail keep the lightmap coords, so they are built after unwrapping
+    building.buildLods("Meshes/City meshes/building.lod");
+    spaceship.buildLods("Meshes/Ufo/UFO.lod");
+
+    // far away buildings are drawn as impostors, they start fading in where the atlas has enough resolution
+    // -------------------------------------------------------------------------------------------------------
+    // the atlas and the region proxies are rendered from the building textures, everything else keeps streaming
+    building.finishTextures();
+    ImpostorAtlas buildingImpostors(building, lightingShaders.get(SHADER_GBUFFER));
+    impostorFadeRange = glm::vec2(1.0f, 1.2f) * buildingImpostors.fullResolutionDistance(lodPixelsPerUnit(glm::radians(fov), SCR_HEIGHT));
+    unsigned int buildingLightmaps = lightmapBaker.add(building.meshes, buildingModelMatrices, buildingCharts);
+    unsigned int trashLightmaps = lightmapBaker.add(building.meshes, trashModelMatrices, buildingCharts);
+    unsigned int floorLightmap = lightmapBaker.add(floorMesh, vector<glm::mat4>{ floorModel }, floorCharts);
+    bool useLightmaps = lightmapBaker.bake("lightmap.cache");
+    if (useLightmaps) {
+        glActiveTexture(GL_TEXTURE0 + LIGHTMAP_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, lightmapBaker.getTexture());
+        glActiveTexture(GL_TEXTURE0);
+    }
+    // everything lit by the static lights uses the variant of light_object.fs that fits the frame, the ones needed
+    // right away are compiled here
+    unsigned int staticLightingFeatures = useLightmaps ? SHADER_LIGHTMAP : 0;
+    lightingShaders.get(staticLightingFeatures);
+    lightingShaders.get(staticLightingFeatures | SHADER_FLASHLIGHT);
+
+    // far away regions of the maze are drawn as one merged proxy each, lit by the lightmap of their buildings. The
+    // maze is new on every start, so the cache next to it only saves the work while it stays the same
+    // ----------------------------------------------------------------------------------------------------------------
+    RegionProxies buildingRegions(buildingModelMatrices, MAZE_CELL_SIZE * static_cast<float>(HLOD_REGION_CELLS));
+    buildingRegions.build(building.meshes, buildingModelMatrices, useLightmaps ? lightmapBaker.getRects(buildingLightmaps, static_cast<unsigned int>(positions.size())) : vector<glm::vec4>(),
+        buildingCharts, lightingShaders.get(SHADER_GBUFFER), "maze.hlod");
+
+    // draws are collected per frame and sorted to avoid redundant state changes
+    // ------------------------------------------------------------------------
+    RenderQueue renderQueue;
+    // level of detail every instance was drawn with, the next one is picked starting from it
+    vector<unsigned int> spaceshipLods(pointLightPositions.size(), 0);
+    vector<unsigned int> buildingLods(positions.size(), 0);
+    vector<unsigned int> trashLods(trashPositions.size(), 0);
+
+    // on OpenGL 4.3 all static geometry is packed into one batch and drawn with a handful of indirect draws
+    // -----------------------------------------------------------------------------------------------------
+    StaticBatch staticBatch;
+    Shader* lightingBatchShader = nullptr;
+    Shader* modelBatchShader = nullptr;
+    Shader* crossfadeBatchShader = nullptr;
+    unsigned int buildingBatchTransform = 0;
+    unsigned int trashBatchTransform = 0;
+    vector<bool> trashHiddenInBatch(trashPositions.size(), false);
+    if (glExtensions().multiDrawIndirect) {
+        lightingBatchShader = &lightingShaders.get(staticLightingFeatures | SHADER_INSTANCED);
+        lightingShaders.get(staticLightingFeatures | SHADER_INSTANCED | SHADER_FLASHLIGHT);
+        modelBatchShader = &modelShaders.get(spaceshipFeatures | SHADER_INSTANCED);
+        // buildings fade into their impostors, nothing else has to pay for the dithering
+        crossfadeBatchShader = &lightingShaders.get(staticLightingFeatures | SHADER_INSTANCED | SHADER_CROSSFADE);
+
+        staticBatch.add(spaceship, *modelBatchShader, spaceShipModelMatrices, vector<glm::vec4>(), spaceshipAnimations);
+        buildingBatchTransform = staticBatch.add(building, *crossfadeBatchShader, buildingModelMatrices,
+            lightmapBaker.getRects(buildingLightmaps, static_cast<unsigned int>(positions.size())));
+        trashBatchTransform = staticBatch.add(building, *lightingBatchShader, trashModelMatrices,
+            lightmapBaker.getRects(trashLightmaps, static_cast<unsigned int>(trashPositions.size())));
+        staticBatch.add(floorMesh, *lightingBatchShader, vector<glm::mat4>{ floorModel }, lightmapBaker.getRects(floorLightmap, 1));
+        staticBatch.build();
+        useStaticBatch = true;
+    }
+
+    // per instance visibility of the static batch is decided by a compute shader
+    // --------------------------------------------------------------------------
+    GpuCuller* gpuCuller = nullptr;
+    if (lightingBatchShader != nullptr && glExtensions().computeShaders) {
+        gpuCuller = new GpuCuller(staticBatch);
+        gpuCuller->setImpostors(buildingBatchTransform, static_cast<unsigned int>(positions.size()));
+        gpuCuller->setRegions(buildingBatchTransform, buildingRegions.getRegionOfInstances(), buildingRegions.regionCount());
+    }
+    if (validateCulling) {
+        bool valid = gpuCuller != nullptr && validateGpuCulling(*gpuCuller, cameraPos, floorPosition);
+        if (gpuCuller == nullptr) {
+            std::cout << "GPU culling needs OpenGL 4.3" << std::endl;
+        }
+        TextureManager::instance().releaseAll();
+        GpuResources::instance().releaseAll();
+        glfwTerminate();
+        return valid ? 0 : 1;
+    }
+
+    // everything is uploaded, baked and batched, the CPU copies of the geometry are not needed anymore
+    building.releaseGeometry();
+    spaceship.releaseGeometry();
+    trash.releaseGeometry();
+    floorMesh.releaseGeometry();
+    GpuResources::instance().report();
+
+    // GPU time of the passes, shown with F6
+    GpuTimer prePassTimer;
+    GpuTimer opaqueTimer;
+    GpuTimer lightingTimer;
+
+    // the deferred renderer, F7. Its G-buffer is allocated on first use
+    // -----------------------------------------------------------------
+    DeferredRenderer deferredRenderer(staticLights);
+    vector<DeferredSpotLight> spotLights(1, flashlight());
+
     // play background sound
     // ---------------------
     irrklang::ISoundEngine* SoundEngine = irrklang::createIrrKlangDevice();
-    SoundEngine->play2D("Sound/background sound.mp3", true);
+    if (irrklang::ISoundSource* backgroundSound = addSound(SoundEngine, "Sound/background sound.mp3")) {
+        SoundEngine->play2D(backgroundSound, true);
+    }
+    umphSound = addSound(umphSoundEngine, "Sound/umph.mp3");
+
+    // everything the scene opens has been opened by now, once the textures are in
+    if (cookAssets) {
+        TextureManager::instance().finish();
+        bool packed = AssetArchive::instance().write("assets.pack");
+        TextureManager::instance().releaseAll();
+        GpuResources::instance().releaseAll();
+        glfwTerminate();
+        return packed ? 0 : 1;
+    }
 
     while (!glfwWindowShouldClose(window))
     {
@@ -409,6 +585,9 @@ int main(int argc, char* argv[]) {
         // -------------
         processInput(window, &detector, &interactionDetector);
 
+        // textures whose images arrived get a few more levels
+        TextureManager::instance().update();
+
         if (hasMoved) {
             processYSpeed(deltaTime);
             processY(deltaTime, &detector);
@@ -421,132 +600,214 @@ int main(int argc, char* argv[]) {
         // ----------
         glm::mat4 projection = glm::perspective(glm::radians(fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100000.0f);
         glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-        glm::mat4 model = glm::mat4(1.0f);
-
-        // render lights
-        // -------------
-        lightingShader.use();
-        lightingShader.setVec3("viewPos", cameraPos);
-        lightingShader.setFloat("material.shininess", 90.0f);
-
-        lightingShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        lightingShader.setVec3("dirLight.ambient", 0.01f, 0.01f, 0.01f);
-        lightingShader.setVec3("dirLight.diffuse", 0.05f, 0.05f, 0.05f);
-        // point light 1
-        for (int i = 0; i < 30; i++) {
-            lightingShader.setVec3("pointLights[" + std::to_string(i) + "].position", pointLightPositions.at(i));
-            lightingShader.setVec3("pointLights[" + std::to_string(i) + "].ambient", 0.9f,2.0f, 1.0f);
-            lightingShader.setVec3("pointLights[" + std::to_string(i) + "].diffuse", 0.0f, 2.0f, 0.0f);
-            lightingShader.setFloat("pointLights[" + std::to_string(i) + "].constant", 1.0f);
-            lightingShader.setFloat("pointLights[" + std::to_string(i) + "].linear", 0.09f);
-            lightingShader.setFloat("pointLights[" + std::to_string(i) + "].quadratic", 0.032f);
-        }
-        // spotLight
-        lightingShader.setVec3("spotLight.position", cameraPos);
-        lightingShader.setVec3("spotLight.direction", cameraFront);
-        if (flashOn) {
-            lightingShader.setVec3("spotLight.ambient", 1.0f, 1.5f, 1.0f);
-            lightingShader.setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-        }
-        else {
-            lightingShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-            lightingShader.setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
-
-        }
-        lightingShader.setFloat("spotLight.constant", 1.0f);
-        lightingShader.setFloat("spotLight.linear", 0.09f);
-        lightingShader.setFloat("spotLight.quadratic", 0.032f);
-        lightingShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-        lightingShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
-
-        // draw light sources
-        // ------------------
-        modelShader.use();
-        modelShader.setMat4("projection", projection);
-        modelShader.setMat4("view", view);
-        for (unsigned int i = 0; i < 30; i++) {
-            modelShader.setMat4("model", spaceShipModelMatrices[i]);
-            spaceship.Draw(modelShader);
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        glm::vec2 impostorFade = useImpostors ? impostorFadeRange : glm::vec2(0.0f);
+        LodView lodView = { cameraPos, useLod ? lodPixelsPerUnit(glm::radians(fov), framebufferHeight) : 0.0f, impostorFade };
+        // the static batch can only leave the buildings of a proxy out when it is culled on the GPU
+        bool drawRegionProxies = useHlod && (!useStaticBatch || (gpuCuller != nullptr && useGpuCulling));
+        buildingRegions.select(drawRegionProxies ? lodView : LodView{ cameraPos, 0.0f, impostorFade });
+
+        // queue the scene
+        // ---------------
+        renderQueue.begin(cameraPos, 2000.0f); // depth range roughly covers the diagonal of a 50x50 maze
+
+        // only compile in the lighting this frame needs, the deferred renderer adds the lights after the G-buffer pass
+        unsigned int lightingFeatures = staticLightingFeatures | (flashOn ? SHADER_FLASHLIGHT : 0) | (useSpecular ? SHADER_SPECULAR : 0);
+        unsigned int sceneFeatures = useDeferred ? (staticLightingFeatures | SHADER_GBUFFER) : lightingFeatures;
+        Shader& staticLightingShader = lightingShaders.get(sceneFeatures);
+        Shader& modelShader = modelShaders.get(spaceshipFeatures | (useDeferred ? SHADER_GBUFFER : 0));
+        Shader& crossfadeShader = lightingShaders.get(sceneFeatures | SHADER_CROSSFADE);
+        Shader& impostorShader = lightingShaders.get(sceneFeatures | SHADER_IMPOSTOR);
+        buildingImpostors.begin();
+
+        // light sources
+        if (!useStaticBatch) {
+            for (unsigned int i = 0; i < 30; i++) {
+                spaceshipLods[i] = spaceship.selectLod(spaceShipModelMatrices[i], lodView, spaceshipLods[i]);
+                spaceship.Submit(renderQueue, modelShader, spaceShipModelMatrices[i], PASS_OPAQUE, glm::vec4(0.0f), spaceshipLods[i], spaceshipAnimations[i]);
+            }
         }
 
-        // render buildings
-        // ----------------
-        lightingShader.use();
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", view);
-
+        // buildings
         for (unsigned int i = 0; i < positions.size(); i++) {
             MazeObject* mazeObject = new MazeObject(positions.at(i), glm::vec3(20, 25.0f, 15.0f));
-            //draw instanced mesh
-            lightingShader.setMat4("model", buildingModelMatrices[i]);
-            building.Draw(lightingShader);
             //add mesh to collision detector
             detector.addMazeObject(mazeObject);
+            //the proxy of the region stands in for it
+            if (buildingRegions.isProxy(i)) {
+                continue;
+            }
+            //far away buildings are impostors, the static batch leaves them out on its own
+            float impostor = impostorWeight(positions.at(i), cameraPos, impostorFade);
+            if (impostor > 0.0f) {
+                buildingImpostors.add(positions.at(i));
+            }
+            //draw instanced mesh
+            if (!useStaticBatch && impostor < 1.0f) {
+                buildingLods[i] = building.selectLod(buildingModelMatrices[i], lodView, buildingLods[i]);
+                building.Submit(renderQueue, impostor > 0.0f ? crossfadeShader : staticLightingShader, buildingModelMatrices[i], PASS_OPAQUE, lightmapBaker.getRect(buildingLightmaps + i), buildingLods[i]);
+            }
         }
+        unsigned int regionProxyCount = buildingRegions.submit(renderQueue, staticLightingShader);
 
-        // render interaction objects
-        // --------------------------
-        lightingShader.use();
-        lightingShader.setMat4("view", view);
-        lightingShader.setMat4("projection", projection);
+        // interaction objects
         for (unsigned int i = 0; i < trashPositions.size(); i++) {
             if (!checkCollectedObjects(i)) {
                 InteractionObject* interactionObject = new InteractionObject(trashPositions[i], glm::vec3(8.0f, 14.0f, 8.0f), i);
                 interactionDetector.addInteractionObject(*interactionObject);
                 detector.addMazeObject(interactionObject);
-                lightingShader.setMat4("model", trashModelMatrices[i]);
-                building.Draw(lightingShader);
+                if (!useStaticBatch) {
+                    trashLods[i] = building.selectLod(trashModelMatrices[i], lodView, trashLods[i]);
+                    building.Submit(renderQueue, staticLightingShader, trashModelMatrices[i], PASS_OPAQUE, lightmapBaker.getRect(trashLightmaps + i), trashLods[i]);
+                }
+            }
+            else if (lightingBatchShader != nullptr && !trashHiddenInBatch[i]) {
+                staticBatch.hide(trashBatchTransform + i);
+                trashHiddenInBatch[i] = true;
             }
         }
 
-        // render plane
-        // ------------
-        lightingShader.use();
-        lightingShader.setMat4("view", view);
-        lightingShader.setMat4("projection", projection);
-
-        glBindVertexArray(PLANEVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, PLANEVBO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
-
-        model = glm::mat4(1.0f);
-        glm::vec3 position = glm::vec3(maze.getMazeWidth() / 1.4, -1.5f, -maze.getMazeHeight() / 3.1);
-        model = glm::translate(model, position);
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        glm::vec3 size = glm::vec3(maze.getMazeWidth() * 100, maze.getMazeHeight() * 100, 1.0);
-        model = glm::scale(model, size);
-        lightingShader.setMat4("model", model);
-        size = glm::vec3(size.y, size.z * 10, size.x);
-        MazeObject *mazeObject = new MazeObject(position, size);
+        // plane
+        if (!useStaticBatch) {
+            floorMesh.Submit(renderQueue, staticLightingShader, floorModel, PASS_OPAQUE, lightmapBaker.getRect(floorLightmap));
+        }
+        MazeObject *mazeObject = new MazeObject(floorPosition, floorSize);
         detector.addMazeObject(mazeObject);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        // draw the scene
+        // --------------
+        if (useDeferred) {
+            deferredRenderer.resize(framebufferWidth, framebufferHeight);
+            deferredRenderer.beginGeometryPass();
+        }
+        if (useStaticBatch) {
+            Shader& lightingBatchVariant = lightingShaders.get(sceneFeatures | SHADER_INSTANCED);
+            if (&lightingBatchVariant != lightingBatchShader) {
+                staticBatch.replaceShader(*lightingBatchShader, lightingBatchVariant);
+                lightingBatchShader = &lightingBatchVariant;
+            }
+            Shader& modelBatchVariant = modelShaders.get(spaceshipFeatures | (useDeferred ? SHADER_GBUFFER : 0) | SHADER_INSTANCED);
+            if (&modelBatchVariant != modelBatchShader) {
+                staticBatch.replaceShader(*modelBatchShader, modelBatchVariant);
+                modelBatchShader = &modelBatchVariant;
+            }
+            Shader& crossfadeBatchVariant = lightingShaders.get(sceneFeatures | SHADER_INSTANCED | SHADER_CROSSFADE);
+            if (&crossfadeBatchVariant != crossfadeBatchShader) {
+                staticBatch.replaceShader(*crossfadeBatchShader, crossfadeBatchVariant);
+                crossfadeBatchShader = &crossfadeBatchVariant;
+            }
+            updateFrameUniforms(*modelBatchShader, projection, view);
+            updateFrameUniforms(*lightingBatchShader, projection, view);
+            updateFrameUniforms(*crossfadeBatchShader, projection, view);
+            updateFrameUniforms(impostorShader, projection, view);
+            updateFrameUniforms(staticLightingShader, projection, view);
+            if (gpuCuller != nullptr && useGpuCulling) {
+                gpuCuller->setProxyRegions(buildingRegions.getProxyRegions());
+                gpuCuller->cull(projection * view, useHiZ, lodView);
+            }
+            else if (gpuCuller != nullptr) {
+                gpuCuller->reset();
+            }
+            if (useDepthPrePass) {
+                Shader& depthBatchShader = depthShaders.get(SHADER_INSTANCED);
+                Shader& crossfadeDepthShader = depthShaders.get(SHADER_INSTANCED | SHADER_CROSSFADE);
+                updateFrameUniforms(depthBatchShader, projection, view);
+                updateFrameUniforms(crossfadeDepthShader, projection, view);
+                prePassTimer.begin();
+                staticBatch.drawDepth(renderQueue.state, *lightingBatchShader, depthBatchShader);
+                staticBatch.drawDepth(renderQueue.state, *crossfadeBatchShader, crossfadeDepthShader);
+                prePassTimer.end();
+                glDepthFunc(GL_LEQUAL);
+            }
+            opaqueTimer.begin();
+            staticBatch.draw(renderQueue.state);
+            buildingImpostors.draw(renderQueue.state, impostorShader);
+            opaqueTimer.end();
+            glDepthFunc(GL_LESS);
+            // only the static batch is in the depth buffer yet, which is exactly the set of occluders
+            if (gpuCuller != nullptr && useGpuCulling && useHiZ) {
+                gpuCuller->updateHiZ(framebufferWidth, framebufferHeight, projection * view, useDeferred ? deferredRenderer.framebuffer() : 0);
+            }
+            // the region proxies come after the Hi-Z capture: a region that switches back to its buildings would
+            // otherwise have them culled behind its own proxy for a frame
+            renderQueue.execute();
+        }
+        else {
+            updateFrameUniforms(modelShader, projection, view);
+            updateFrameUniforms(staticLightingShader, projection, view);
+            updateFrameUniforms(crossfadeShader, projection, view);
+            updateFrameUniforms(impostorShader, projection, view);
+            if (useDepthPrePass) {
+                Shader& depthShader = depthShaders.get(0);
+                Shader& crossfadeDepthShader = depthShaders.get(SHADER_CROSSFADE);
+                updateFrameUniforms(depthShader, projection, view);
+                updateFrameUniforms(crossfadeDepthShader, projection, view);
+                renderQueue.setDepthShader(staticLightingShader, depthShader);
+                renderQueue.setDepthShader(crossfadeShader, crossfadeDepthShader);
+                prePassTimer.begin();
+                renderQueue.executeDepthPrePass();
+                prePassTimer.end();
+                // LEQUAL instead of EQUAL, draws without a pre-pass (the UFOs) still need a normal depth test
+                glDepthFunc(GL_LEQUAL);
+            }
+            // sorted by shader, material and mesh
+            opaqueTimer.begin();
+            renderQueue.execute();
+            buildingImpostors.draw(renderQueue.state, impostorShader);
+            opaqueTimer.end();
+            glDepthFunc(GL_LESS);
+        }
+        if (!useDepthPrePass) {
+            prePassTimer.reset();
+        }
+        if (useDeferred) {
+            spotLights[0].position = cameraPos;
+            spotLights[0].direction = cameraFront;
+            lightingTimer.begin();
+            deferredRenderer.lightingPass(projection, view, cameraPos, lightingFeatures, spotLights);
+            lightingTimer.end();
+            // skybox and text are drawn forward on top
+            deferredRenderer.present();
+        }
+        else {
+            lightingTimer.reset();
+        }
 
         // draw skybox as last
         // -------------------
         glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
         skyboxShader.use();
         view = glm::mat4(glm::mat3(glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp))); // remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
+        skyboxShader.set(skyboxView, view);
+        skyboxShader.set(skyboxProjection, projection);
 
         // skybox cube
-        glBindVertexArray(skyboxVAO);
+        glBindVertexArray(skyboxVAO.id());
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
         glDrawArrays(GL_TRIANGLES, 0, 36);
         glBindVertexArray(0);
         glDepthFunc(GL_LESS); // set depth function back to default
 
-        //render text
+        //render text, all of it in one draw
+        textRenderer.begin();
         if (hasMoved != true) {
-            renderText(textShader, "movement: z, q, s, d  utility: g for flashlight, f for interaction", (float)SCR_WIDTH / 2 -60.0f, (float)SCR_HEIGHT / 2 + 15.0f, 0.4f, glm::vec3(1.0f, 1.0f, 1.0f), textVAO, textVBO, true);
-            renderText(textShader, "move to start", (float)SCR_WIDTH / 2, (float)SCR_HEIGHT / 2 - 15.0f, 0.4f, glm::vec3(1.0f, 1.0f, 1.0f), textVAO, textVBO, true);
+            textRenderer.add(movementHint, (float)SCR_WIDTH / 2 -60.0f, (float)SCR_HEIGHT / 2 + 15.0f, glm::vec3(1.0f, 1.0f, 1.0f));
+            textRenderer.add(startHint, (float)SCR_WIDTH / 2, (float)SCR_HEIGHT / 2 - 15.0f, glm::vec3(1.0f, 1.0f, 1.0f));
         }
         else if (canInteract) {
-            renderText(textShader, "Press 'F' to interact", (float)SCR_WIDTH / 2, (float)SCR_HEIGHT / 2, 0.4f, glm::vec3(1.0f, 1.0f, 1.0f), textVAO, textVBO, true);
+            textRenderer.add(interactHint, (float)SCR_WIDTH / 2, (float)SCR_HEIGHT / 2, glm::vec3(1.0f, 1.0f, 1.0f));
+        }
+        if (showTimings) {
+            std::string timings = formatTiming("depth pre-pass (F5)", prePassTimer) + "   " + formatTiming("opaque", opaqueTimer) + "   " + formatTiming("deferred lights (F7)", lightingTimer)
+                + "   impostors (F9): " + std::to_string(buildingImpostors.size()) + "   region proxies (F10): " + std::to_string(regionProxyCount)
+                + "   textures: " + std::to_string(TextureManager::instance().textureCount()) + " / " + std::to_string(TextureManager::instance().memoryUsage() / (1024 * 1024)) + " MB"
+                + " (" + std::to_string(TextureManager::instance().streamingCount()) + " streaming, " + std::to_string(TextureManager::instance().evictionCount()) + " evicted)"
+                + "   gpu: " + std::to_string(GpuResources::instance().memoryUsage() / (1024 * 1024)) + " / " + std::to_string(GpuResources::instance().memoryBudget() / (1024 * 1024)) + " MB";
+            textRenderer.add(timings, 10.0f, (float)SCR_HEIGHT - 30.0f, 0.4f, glm::vec3(1.0f, 1.0f, 1.0f), false);
         }
+        textRenderer.draw(renderQueue.state, textShader);
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
@@ -554,8 +815,10 @@ int main(int argc, char* argv[]) {
         glfwPollEvents();
     }
 
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    delete gpuCuller;
+    TextureManager::instance().releaseAll();
+    // the scene still holds handles, they find their objects already gone when it is destroyed after the context
+    GpuResources::instance().releaseAll();
 
     glfwTerminate();
     return 0;
@@ -608,6 +871,179 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn) {
     cameraFront = glm::normalize(front);
 }
 
+// debug toggles, handled on key press so they flip exactly once
+void key_callback(GLFWwindow*, int key, int, int action, int) {
+    if (action != GLFW_PRESS) {
+        return;
+    }
+    if (key == GLFW_KEY_F1 && glExtensions().multiDrawIndirect) {
+        useStaticBatch = !useStaticBatch;
+    }
+    if (key == GLFW_KEY_F2) {
+        useGpuCulling = !useGpuCulling;
+    }
+    if (key == GLFW_KEY_F3) {
+        useHiZ = !useHiZ;
+    }
+    if (key == GLFW_KEY_F4) {
+        useSpecular = !useSpecular;
+    }
+    if (key == GLFW_KEY_F5) {
+        useDepthPrePass = !useDepthPrePass;
+    }
+    if (key == GLFW_KEY_F6) {
+        showTimings = !showTimings;
+    }
+    if (key == GLFW_KEY_F7) {
+        useDeferred = !useDeferred;
+    }
+    if (key == GLFW_KEY_F8) {
+        useLod = !useLod;
+    }
+    if (key == GLFW_KEY_F9) {
+        useImpostors = !useImpostors;
+    }
+    if (key == GLFW_KEY_F10) {
+        useHlod = !useHlod;
+    }
+}
+
+// frustum culls the static batch on the GPU and the CPU from a few camera poses and compares the results
+bool validateGpuCulling(GpuCuller& culler, const glm::vec3& spawn, const glm::vec3& center) {
+    glm::mat4 projection = glm::perspective(glm::radians(fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100000.0f);
+    bool valid = true;
+    // looking around from the spawn
+    for (int i = 0; i < 8; i++) {
+        float yaw = glm::radians(45.0f * i);
+        glm::vec3 direction = glm::vec3(cos(yaw), -0.1f, sin(yaw));
+        valid = culler.validate(projection * glm::lookAt(spawn, spawn + direction, cameraUp)) && valid;
+    }
+    // the whole maze from above
+    valid = culler.validate(projection * glm::lookAt(center + glm::vec3(0.0f, 800.0f, 0.0f), center, glm::vec3(0.0f, 0.0f, -1.0f))) && valid;
+    culler.reset();
+    std::cout << (valid ? "GPU culling matches the CPU" : "GPU culling does NOT match the CPU") << std::endl;
+    return valid;
+}
+
+// "name: 1.23 ms", or "name: off" for a pass that didn't run lately
+std::string formatTiming(const char* name, const GpuTimer& timer) {
+    std::ostringstream text;
+    text << name << ": ";
+    if (timer.milliseconds() < 0.0f) {
+        text << "off";
+    }
+    else {
+        text << std::fixed << std::setprecision(2) << timer.milliseconds() << " ms";
+    }
+    return text.str();
+}
+
+// a sound source of the file at path, played straight out of the asset archive when it is packed. The archive stays
+// mapped as long as the game runs, so irrKlang doesn't need a copy
+irrklang::ISoundSource* addSound(irrklang::ISoundEngine* engine, const char* path) {
+    AssetFile file(path);
+    if (!file.packed()) {
+        return engine->addSoundSourceFromFile(path);
+    }
+    return engine->addSoundSourceFromMemory(const_cast<unsigned char*>(file.data()), static_cast<irrklang::ik_s32>(file.size()), path, false);
+}
+
+// the lights that never move: a dim directional light and the green lights of the UFOs
+StaticLights sceneLights(const vector<glm::vec3>& pointLightPositions) {
+    StaticLights lights;
+    lights.dirLight.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+    lights.dirLight.ambient = glm::vec3(0.01f, 0.01f, 0.01f);
+    lights.dirLight.diffuse = glm::vec3(0.05f, 0.05f, 0.05f);
+    for (int i = 0; i < 30; i++) {
+        StaticPointLight light;
+        light.position = pointLightPositions.at(i);
+        light.ambient = glm::vec3(0.9f, 2.0f, 1.0f);
+        light.diffuse = glm::vec3(0.0f, 2.0f, 0.0f);
+        light.constant = 1.0f;
+        light.linear = 0.09f;
+        light.quadratic = 0.032f;
+        lights.pointLights.push_back(light);
+    }
+    return lights;
+}
+
+// uploads the material and light settings that never change
+void setupLighting(Shader& shader, const StaticLights& lights) {
+    shader.use();
+    shader.setInt("material.diffuse", 0);
+    shader.setFloat("material.shininess", 90.0f);
+
+    shader.setVec3("dirLight.direction", lights.dirLight.direction);
+    shader.setVec3("dirLight.ambient", lights.dirLight.ambient);
+    shader.setVec3("dirLight.diffuse", lights.dirLight.diffuse);
+    shader.setVec3("dirLight.specular", lights.dirLight.diffuse);
+    for (unsigned int i = 0; i < lights.pointLights.size(); i++) {
+        const StaticPointLight& light = lights.pointLights[i];
+        shader.setVec3("pointLights[" + std::to_string(i) + "].position", light.position);
+        shader.setVec3("pointLights[" + std::to_string(i) + "].ambient", light.ambient);
+        shader.setVec3("pointLights[" + std::to_string(i) + "].diffuse", light.diffuse);
+        shader.setVec3("pointLights[" + std::to_string(i) + "].specular", light.diffuse);
+        shader.setFloat("pointLights[" + std::to_string(i) + "].constant", light.constant);
+        shader.setFloat("pointLights[" + std::to_string(i) + "].linear", light.linear);
+        shader.setFloat("pointLights[" + std::to_string(i) + "].quadratic", light.quadratic);
+    }
+    const DeferredSpotLight spotLight = flashlight();
+    shader.setFloat("spotLight.constant", spotLight.constant);
+    shader.setFloat("spotLight.linear", spotLight.linear);
+    shader.setFloat("spotLight.quadratic", spotLight.quadratic);
+    shader.setFloat("spotLight.cutOff", spotLight.cutOff);
+    shader.setFloat("spotLight.outerCutOff", spotLight.outerCutOff);
+    // only variants with FLASHLIGHT evaluate the spot light, so it can stay switched on
+    shader.setVec3("spotLight.ambient", spotLight.ambient);
+    shader.setVec3("spotLight.diffuse", spotLight.diffuse);
+    shader.setVec3("spotLight.specular", spotLight.specular);
+}
+
+// the player's flashlight, position and direction follow the camera every frame
+DeferredSpotLight flashlight() {
+    DeferredSpotLight light;
+    light.position = cameraPos;
+    light.direction = cameraFront;
+    light.cutOff = glm::cos(glm::radians(12.5f));
+    light.outerCutOff = glm::cos(glm::radians(15.0f));
+    light.constant = 1.0f;
+    light.linear = 0.09f;
+    light.quadratic = 0.032f;
+    light.ambient = glm::vec3(1.0f, 1.5f, 1.0f);
+    light.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+    light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    return light;
+}
+
+const FrameUniforms& frameUniformsOf(Shader& shader) {
+    auto it = frameUniformCache.find(shader.ID);
+    if (it != frameUniformCache.end()) {
+        return it->second;
+    }
+    FrameUniforms uniforms;
+    uniforms.projection = shader.uniform<glm::mat4>("projection");
+    uniforms.view = shader.uniform<glm::mat4>("view");
+    uniforms.viewPos = shader.uniform<glm::vec3>("viewPos");
+    uniforms.spotLightPosition = shader.uniform<glm::vec3>("spotLight.position");
+    uniforms.spotLightDirection = shader.uniform<glm::vec3>("spotLight.direction");
+    uniforms.impostorFade = shader.uniform<glm::vec2>("impostorFade");
+    uniforms.animationTime = shader.uniform<float>("animationTime");
+    return frameUniformCache[shader.ID] = uniforms;
+}
+
+// sets camera and flashlight, uniforms a variant doesn't use are skipped by GL
+void updateFrameUniforms(Shader& shader, const glm::mat4& projection, const glm::mat4& view) {
+    const FrameUniforms& uniforms = frameUniformsOf(shader);
+    shader.use();
+    shader.set(uniforms.projection, projection);
+    shader.set(uniforms.view, view);
+    shader.set(uniforms.viewPos, cameraPos);
+    shader.set(uniforms.spotLightPosition, cameraPos);
+    shader.set(uniforms.spotLightDirection, cameraFront);
+    shader.set(uniforms.impostorFade, useImpostors ? impostorFadeRange : glm::vec2(0.0f));
+    shader.set(uniforms.animationTime, static_cast<float>(glfwGetTime()));
+}
+
 void processInput(GLFWwindow* window, CollisionDetector* detector, InteractionDetector* interactionDetector){
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
@@ -653,7 +1089,7 @@ void processInput(GLFWwindow* window, CollisionDetector* detector, InteractionDe
         cameraPos = newPos;
     } 
     //play umph sound on collision
-    if (detector->checkCameraCollisions(newPos, cameraSize) && !umphSoundEngine->isCurrentlyPlaying(umphSound)) {
+    if (detector->checkCameraCollisions(newPos, cameraSize) && umphSound != nullptr && !umphSoundEngine->isCurrentlyPlaying(umphSound)) {
         umphSoundEngine->play2D(umphSound, false);
     }
     if (canTransitionCrouch && (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_CONTROL) == GLFW_PRESS)) {
@@ -710,242 +1146,6 @@ void processYSpeed(float deltaTime) {
     ySpeed = ySpeed + acceleration * deltaTime;
 }
 
-unsigned int loadCubemap(vector<std::string> faces)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrComponents;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrComponents, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
-}
-
-int prepareTextRendering(Shader &shader,unsigned int &textVAO, unsigned int &textVBO) {
-    glm::mat4 projection = glm::ortho(0.0f, static_cast<float>(SCR_WIDTH), 0.0f, static_cast<float>(SCR_HEIGHT));
-    shader.use();
-    glUniformMatrix4fv(glGetUniformLocation(shader.ID, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-
-    // FreeType
-    // --------
-    FT_Library ft;
-    // All functions return a value different than 0 whenever an error occurred
-    if (FT_Init_FreeType(&ft))
-    {
-        std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
-        return -1;
-    }
-
-    // find path to font
-    std::string font_name = "fonts/arial.ttf";
-    if (font_name.empty())
-    {
-        std::cout << "ERROR::FREETYPE: Failed to load font_name" << std::endl;
-        return -1;
-    }
-
-    // load font as face
-    FT_Face face;
-    if (FT_New_Face(ft, font_name.c_str(), 0, &face)) {
-        std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
-        return -1;
-    }
-    else {
-        // set size to load glyphs as
-        FT_Set_Pixel_Sizes(face, 0, 48);
-        // disable byte-alignment restriction
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-        // load first 128 characters of ASCII set
-        for (unsigned char c = 0; c < 128; c++)
-        {
-            // Load character glyph 
-            if (FT_Load_Char(face, c, FT_LOAD_RENDER))
-            {
-                std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
-                continue;
-            }
-            // generate texture
-            unsigned int texture;
-            glGenTextures(1, &texture);
-            glBindTexture(GL_TEXTURE_2D, texture);
-            glTexImage2D(
-                GL_TEXTURE_2D,
-                0,
-                GL_RED,
-                face->glyph->bitmap.width,
-                face->glyph->bitmap.rows,
-                0,
-                GL_RED,
-                GL_UNSIGNED_BYTE,
-                face->glyph->bitmap.buffer
-            );
-            // set texture options
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            // now store character for later use
-            Character character = {
-                texture,
-                glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-                glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-                static_cast<unsigned int>(face->glyph->advance.x)
-            };
-            Characters.insert(std::pair<char, Character>(c, character));
-        }
-        glBindTexture(GL_TEXTURE_2D, 0);
-    }
-    // destroy FreeType once we're finished
-    FT_Done_Face(face);
-    FT_Done_FreeType(ft);
-
-    // configure VAO/VBO for texture quads
-    // -----------------------------------
-    glGenVertexArrays(1, &textVAO);
-    glGenBuffers(1, &textVBO);
-    glBindVertexArray(textVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    return 0;
-}
-
-pair<float, float> calculateCenterIndentation(std::string text, bool x, bool y, float scale) {
-    pair<float, float> indent = pair<float, float>(0.0f,0.0f);
-
-    // iterate through all characters
-    std::string::const_iterator c;
-
-    for (c = text.begin(); c != text.end(); c++)
-    {
-        Character ch = Characters[*c];
-
-        if (x) {
-            indent.first += ch.Size.x * scale;
-        }
-        if (y && indent.second < ch.Size.y * scale) {
-            indent.second = ch.Size.y * scale;
-        }
-    }
-
-    indent.first /= 2;
-    indent.second /= 2;
-
-    return indent;
-}
-
-void renderText(Shader& s, std::string text, float x, float y, float scale, glm::vec3 color, unsigned int& VAO, unsigned int& VBO, bool centerAlignment) {
-    // activate corresponding render state	
-    s.use();
-    glUniform3f(glGetUniformLocation(s.ID, "textColor"), color.x, color.y, color.z);
-    glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(VAO);
-
-    pair<float, float> indent;
-    if (centerAlignment) {
-        indent = calculateCenterIndentation(text, true, true, scale);
-    }
-    else {
-        indent = calculateCenterIndentation(text, false, true, scale);
-    }
-
-    // iterate through all characters
-    std::string::const_iterator c;
-
-    for (c = text.begin(); c != text.end(); c++)
-    {
-        Character ch = Characters[*c];
-
-        float xpos = x + ch.Bearing.x * scale - indent.first;
-        float ypos = y - (ch.Size.y - ch.Bearing.y) * scale - indent.second;
-
-        float w = ch.Size.x * scale;
-        float h = ch.Size.y * scale;
-        // update VBO for each character
-        float vertices[6][4] = {
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos,     ypos,       0.0f, 1.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-            { xpos + w, ypos + h,   1.0f, 0.0f }
-        };
-        // render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-        // update content of VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        // render quad
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        // now advance cursors for next glyph (note that advance is number of 1/64 pixels)
-        x += (ch.Advance >> 6) * scale; // bitshift by 6 to get value in pixels (2^6 = 64)
-    }
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-}
-
-unsigned int loadTexture(char const* path)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
-
 bool checkCollectedObjects(int ID) {
     for (int i = 0; i < collectedIDs.size(); i++)
     {
@@ -1,5 +1,12 @@
 #version 330 core
+#ifdef GBUFFER
+// unlit, the color goes straight into the light buffer and no light adds anything to it
+layout (location = 0) out vec4 gLight;
+layout (location = 1) out vec4 gAlbedo;
+layout (location = 2) out vec4 gNormal;
+#else
 out vec4 FragColor;
+#endif
 
 in vec2 TexCoords;
 
@@ -7,5 +14,11 @@ uniform sampler2D texture_diffuse1;
 
 void main()
 {    
+#ifdef GBUFFER
+    gLight = texture(texture_diffuse1, TexCoords);
+    gAlbedo = vec4(0.0);
+    gNormal = vec4(0.5, 0.5, 0.5, 0.0);
+#else
     FragColor = texture(texture_diffuse1, TexCoords);
+#endif
 }
\ No newline at end of file
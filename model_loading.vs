@@ -1,16 +1,83 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 1) in vec2 aNormal; // octahedral encoded, see VertexLayout in Mesh.h
 layout (location = 2) in vec2 aTexCoords;
+#ifdef INSTANCED
+layout (location = 7) in uint aTransform; // per instance, offset by the draw's baseInstance
+
+// one transform per instance of the static batch
+layout (std430, binding = 0) readonly buffer Transforms {
+    mat4 transforms[];
+};
+#else
+uniform mat4 model;
+#endif
+#ifdef SKINNED
+layout (location = 5) in uvec4 aBoneIds;
+layout (location = 6) in vec4 aBoneWeights;
+
+// skinning matrices of every bone at every baked frame, see AnimationBaker: a bone takes three texels holding the
+// rows of its matrix, a frame takes one line
+uniform sampler2D boneMatrices;
+uniform float animationTime; // seconds
+// per instance first frame, frame count, frames per second and time offset of the clip, see Model::animationOf
+#ifdef INSTANCED
+layout (std430, binding = 10) readonly buffer Animations {
+    vec4 animations[];
+};
+#else
+uniform vec4 animation;
+#endif
+
+mat4 boneMatrix(uint bone, int frame)
+{
+    int x = int(bone) * 3;
+    return transpose(mat4(texelFetch(boneMatrices, ivec2(x, frame), 0), texelFetch(boneMatrices, ivec2(x + 1, frame), 0),
+        texelFetch(boneMatrices, ivec2(x + 2, frame), 0), vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+// the bones of the vertex blended at the current time of clip, between the two baked frames around it
+mat4 skinMatrix(vec4 clip)
+{
+    float total = dot(aBoneWeights, vec4(1.0));
+    if (clip.y < 1.0 || total <= 0.0)
+        return mat4(1.0);
+    float time = mod(max(animationTime + clip.w, 0.0) * clip.z, clip.y);
+    int frame = int(time);
+    float blend = time - float(frame);
+    // the clips loop, the last frame blends into the first
+    int first = int(clip.x) + frame;
+    int second = int(clip.x) + (frame + 1) % int(clip.y);
+    mat4 skin = mat4(0.0);
+    for (int i = 0; i < 4; i++)
+    {
+        if (aBoneWeights[i] > 0.0)
+            skin += aBoneWeights[i] * ((1.0 - blend) * boneMatrix(aBoneIds[i], first) + blend * boneMatrix(aBoneIds[i], second));
+    }
+    // the weights lost precision as bytes
+    return skin / total;
+}
+#endif
 
 out vec2 TexCoords;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
+#ifdef INSTANCED
+    mat4 model = transforms[aTransform];
+#endif
+#ifdef SKINNED
+#ifdef INSTANCED
+    vec4 position = skinMatrix(animations[aTransform]) * vec4(aPos, 1.0);
+#else
+    vec4 position = skinMatrix(animation) * vec4(aPos, 1.0);
+#endif
+#else
+    vec4 position = vec4(aPos, 1.0);
+#endif
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * model * position;
 }
\ No newline at end of file
@@ -4,97 +4,122 @@
 #include <glad/glad.h>
 #include <glm/glm/glm.hpp>
 
+#include "GLExtensions.h"
+#include "ShaderCache.h"
+#include "AssetArchive.h"
+#include "GpuResources.h"
+
 #include <string>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+
+// pre-resolved uniform location. The type parameter only makes sure a handle is set with the
+// value type it was resolved for; resolve handles once at load time and reuse them every frame.
+template <typename T>
+struct Uniform
+{
+    GLint location = -1;
+
+    bool valid() const
+    {
+        return location != -1;
+    }
+};
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly. defines (e.g. "#define FLASHLIGHT\n") are inserted into every
+    // stage right after its #version line, see ShaderVariants.h
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string& defines = std::string())
     {
-        // 1. retrieve the vertex/fragment source code from filePath
+        // 1. retrieve the vertex/fragment source code from filePath, or from the asset archive
         std::string vertexCode;
         std::string fragmentCode;
         std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-            // if geometry shader path is present, also load a geometry shader
-            if (geometryPath != nullptr)
-            {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure& e)
+        readSource(vertexPath, vertexCode);
+        readSource(fragmentPath, fragmentCode);
+        // if geometry shader path is present, also load a geometry shader
+        if (geometryPath != nullptr)
+            readSource(geometryPath, geometryCode);
+        if (!defines.empty())
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+            vertexCode = injectDefines(vertexCode, defines);
+            fragmentCode = injectDefines(fragmentCode, defines);
+            geometryCode = injectDefines(geometryCode, defines);
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        // 2. compile shaders, or load the program from the cache
+        std::vector<ShaderStage> stages;
+        stages.push_back(ShaderStage{ GL_VERTEX_SHADER, "VERTEX", vertexCode });
+        stages.push_back(ShaderStage{ GL_FRAGMENT_SHADER, "FRAGMENT", fragmentCode });
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
         if (geometryPath != nullptr)
+            stages.push_back(ShaderStage{ GL_GEOMETRY_SHADER, "GEOMETRY", geometryCode });
+        build(stages);
+    }
+    // constructor for a compute program, only valid when glExtensions().computeShaders is set
+    // ------------------------------------------------------------------------
+    explicit Shader(const char* computePath)
+    {
+        std::string computeCode;
+        readSource(computePath, computeCode);
+        build(std::vector<ShaderStage>{ ShaderStage{ GL_COMPUTE_SHADER, "COMPUTE", computeCode } });
+    }
+    // shaders constructed between these two calls only start compiling and linking, so the driver can work on all
+    // of them at once when it has KHR_parallel_shader_compile. Their uniforms are looked up by finishParallelCompile
+    // (or by calling finish on one of them earlier), don't use them before. They have to outlive the batch.
+    // ------------------------------------------------------------------------
+    static void beginParallelCompile()
+    {
+        parallelBatch().active = true;
+        parallelBatch().start = std::chrono::steady_clock::now();
+        parallelBatch().cacheHits = glExtensions().programBinary ? ShaderCache::instance().hitCount() : 0;
+    }
+    static void finishParallelCompile()
+    {
+        ParallelBatch& batch = parallelBatch();
+        for (unsigned int i = 0; i < batch.shaders.size(); i++)
+            batch.shaders[i]->finish();
+        if (glExtensions().programBinary)
+            ShaderCache::instance().flush();
+        unsigned int cached = glExtensions().programBinary ? ShaderCache::instance().hitCount() - batch.cacheHits : 0;
+        std::cout << "SHADER:: " << batch.programs << " programs ready in "
+            << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batch.start).count() << " ms, "
+            << cached << " from the cache" << (glExtensions().parallelShaderCompile ? ", compiled in parallel" : "") << std::endl;
+        batch = ParallelBatch();
+    }
+    // waits until the program is linked, checks it for errors and looks up its uniforms. Only does something for
+    // shaders of a parallel batch, every other shader is finished by its constructor
+    // ------------------------------------------------------------------------
+    void finish()
+    {
+        if (!pending)
+            return;
+        pending = false;
+        for (unsigned int i = 0; i < pendingStages.size(); i++)
         {
-            const char* gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            checkCompileErrors(pendingStages[i].first, pendingStages[i].second);
+            glDeleteShader(pendingStages[i].first);
         }
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if (geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
+        pendingStages.clear();
         checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if (geometryPath != nullptr)
-            glDeleteShader(geometry);
-
+        GLint linked = GL_FALSE;
+        glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+        if (linked && glExtensions().programBinary)
+        {
+            ShaderCache::instance().store(ID, cacheKey);
+            if (!parallelBatch().active)
+                ShaderCache::instance().flush();
+        }
+        // look up every active uniform once so nothing has to ask the driver by name afterwards
+        reflectUniforms();
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -102,66 +127,269 @@ public:
     {
         glUseProgram(ID);
     }
-    // utility uniform functions
+    // uniform lookup, answered from the table built at link time (-1 if the uniform isn't active)
+    // ------------------------------------------------------------------------
+    GLint getUniformLocation(const std::string& name) const
+    {
+        auto it = uniformLocations.find(name);
+        return it != uniformLocations.end() ? it->second : -1;
+    }
+    // ------------------------------------------------------------------------
+    template <typename T>
+    Uniform<T> uniform(const std::string& name) const
+    {
+        Uniform<T> handle;
+        handle.location = getUniformLocation(name);
+        return handle;
+    }
+    // typed uniform functions, these never touch a string
+    // ------------------------------------------------------------------------
+    void set(Uniform<bool> handle, bool value) const
+    {
+        glUniform1i(handle.location, (int)value);
+    }
+    void set(Uniform<int> handle, int value) const
+    {
+        glUniform1i(handle.location, value);
+    }
+    void set(Uniform<float> handle, float value) const
+    {
+        glUniform1f(handle.location, value);
+    }
+    void set(Uniform<glm::vec2> handle, const glm::vec2& value) const
+    {
+        glUniform2fv(handle.location, 1, &value[0]);
+    }
+    void set(Uniform<glm::vec3> handle, const glm::vec3& value) const
+    {
+        glUniform3fv(handle.location, 1, &value[0]);
+    }
+    void set(Uniform<glm::vec3> handle, float x, float y, float z) const
+    {
+        glUniform3f(handle.location, x, y, z);
+    }
+    void set(Uniform<glm::vec4> handle, const glm::vec4& value) const
+    {
+        glUniform4fv(handle.location, 1, &value[0]);
+    }
+    void set(Uniform<glm::mat2> handle, const glm::mat2& mat) const
+    {
+        glUniformMatrix2fv(handle.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void set(Uniform<glm::mat3> handle, const glm::mat3& mat) const
+    {
+        glUniformMatrix3fv(handle.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void set(Uniform<glm::mat4> handle, const glm::mat4& mat) const
+    {
+        glUniformMatrix4fv(handle.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    // utility uniform functions, convenient for load time setup
     // ------------------------------------------------------------------------
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(getUniformLocation(name), (int)value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string& name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(getUniformLocation(name), 1, &value[0]);
     }
     void setVec2(const std::string& name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(getUniformLocation(name), x, y);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string& name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(getUniformLocation(name), 1, &value[0]);
     }
     void setVec3(const std::string& name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(getUniformLocation(name), x, y, z);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string& name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(getUniformLocation(name), 1, &value[0]);
     }
     void setVec4(const std::string& name, float x, float y, float z, float w)
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(getUniformLocation(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string& name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string& name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string& name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
+    }
+
+    // inserts defines after the #version line, which has to stay the first line of a GLSL source. If defines starts
+    // with a #version line of its own, that one replaces the version of the source.
+    // A #line directive keeps the line numbers in compile errors pointing at the file
+    // ------------------------------------------------------------------------
+    static std::string injectDefines(const std::string& source, const std::string& defines)
+    {
+        size_t version = source.find("#version");
+        size_t lineEnd = version != std::string::npos ? source.find('\n', version) : std::string::npos;
+        if (source.empty() || lineEnd == std::string::npos)
+            return source;
+        std::string versionLine = source.substr(version, lineEnd + 1 - version);
+        std::string body = defines;
+        if (defines.compare(0, 8, "#version") == 0)
+        {
+            size_t definesLineEnd = defines.find('\n');
+            versionLine = defines.substr(0, definesLineEnd + 1);
+            body = definesLineEnd != std::string::npos ? defines.substr(definesLineEnd + 1) : std::string();
+        }
+        int nextLine = 2 + (int)std::count(source.begin(), source.begin() + version, '\n');
+        return source.substr(0, version) + versionLine + body + "#line " + std::to_string(nextLine) + "\n" + source.substr(lineEnd + 1);
     }
 
 private:
+    struct ShaderStage
+    {
+        GLenum type;
+        const char* name; // for error messages
+        std::string source;
+    };
+
+    struct ParallelBatch
+    {
+        bool active = false;
+        std::vector<Shader*> shaders;
+        unsigned int programs = 0;
+        unsigned int cacheHits = 0;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // uniform name -> location, filled once after linking
+    std::unordered_map<std::string, GLint> uniformLocations;
+    // compiled stages and the cache key of a link that finish hasn't checked yet
+    std::vector<std::pair<unsigned int, std::string>> pendingStages;
+    unsigned long long cacheKey = 0;
+    bool pending = false;
+    // owns ID, copies of the shader share the program
+    GpuHandle program;
+
+    static ParallelBatch& parallelBatch()
+    {
+        static ParallelBatch batch;
+        return batch;
+    }
+
+    // the source at path, from the asset archive when it is packed
+    // ------------------------------------------------------------------------
+    static void readSource(const char* path, std::string& code)
+    {
+        AssetFile file(path);
+        if (!file.isOpen())
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return;
+        }
+        code.assign(reinterpret_cast<const char*>(file.data()), file.size());
+    }
+
+    // links the program from the cached binary if there is one, compiles and links the stages otherwise
+    // ------------------------------------------------------------------------
+    void build(const std::vector<ShaderStage>& stages)
+    {
+        program = GpuResources::instance().create(GPU_PROGRAM, GPU_PROGRAMS);
+        ID = program.id();
+        if (parallelBatch().active)
+            parallelBatch().programs++;
+        if (glExtensions().programBinary)
+        {
+            std::vector<std::string> sources;
+            for (unsigned int i = 0; i < stages.size(); i++)
+                sources.push_back(stages[i].source);
+            cacheKey = ShaderCache::keyOf(sources);
+            if (ShaderCache::instance().load(ID, cacheKey))
+            {
+                reflectUniforms();
+                return;
+            }
+            // a rejected binary leaves a program that failed to link behind, start over with a fresh one
+            program = GpuResources::instance().create(GPU_PROGRAM, GPU_PROGRAMS);
+            ID = program.id();
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        for (unsigned int i = 0; i < stages.size(); i++)
+        {
+            const char* code = stages[i].source.c_str();
+            unsigned int shader = glCreateShader(stages[i].type);
+            glShaderSource(shader, 1, &code, NULL);
+            glCompileShader(shader);
+            glAttachShader(ID, shader);
+            pendingStages.push_back(std::make_pair(shader, std::string(stages[i].name)));
+        }
+        glLinkProgram(ID);
+        pending = true;
+        // the errors are checked once the driver is done, right away unless this is part of a parallel batch
+        if (parallelBatch().active)
+            parallelBatch().shaders.push_back(this);
+        else
+            finish();
+    }
+
+    // queries all active uniforms of the linked program and stores their locations.
+    // arrays are reported once as "name[0]", so every element and the bare name get an entry as well.
+    // ------------------------------------------------------------------------
+    void reflectUniforms()
+    {
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        if (maxLength <= 0)
+            return;
+
+        std::vector<GLchar> nameBuffer(maxLength);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, nameBuffer.data());
+            std::string name(nameBuffer.data(), length);
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            if (location == -1) // members of uniform blocks have no location
+                continue;
+            uniformLocations[name] = location;
+
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                uniformLocations[base] = location;
+                for (GLint element = 1; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+                }
+            }
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -1,12 +1,21 @@
 #version 330 core
 in vec2 TexCoords;
+in vec3 TextColor;
 out vec4 color;
 
+// glyph atlas, coverage in the red channel or the signed distance to the outline with 0.5 on it
 uniform sampler2D text;
-uniform vec3 textColor;
+uniform bool distanceField;
 
 void main()
 {    
-    vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, TexCoords).r);
-    color = vec4(textColor, 1.0) * sampled;
+    float alpha = texture(text, TexCoords).r;
+    if (distanceField)
+    {
+        // the edge is smoothed over about one pixel, whatever the scale of the text
+        float width = 0.7 * fwidth(alpha);
+        alpha = smoothstep(0.5 - width, 0.5 + width, alpha);
+    }
+    vec4 sampled = vec4(1.0, 1.0, 1.0, alpha);
+    color = vec4(TextColor, 1.0) * sampled;
 }
\ No newline at end of file